@@ -26,6 +26,10 @@
 
 #include "bitmap.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /* bitmap 内容数据中，要求每行的字节数是 4 的倍数，这是用于填充空白部分的随机信息。 */
 static char str_to_fill[3] = {70, 82, 76};
 
@@ -65,6 +69,7 @@ init_job(
     char                *argv[],    /* 输入 - 从 main() 传过来的参数内容 */
     bitmap_job_data_t   *job        /* 输入 - 一个任务对象 */
 ) {
+    const char          *value;
     int i;
 
     /* 检查命令行参数个数。 */
@@ -85,6 +90,17 @@ init_job(
     job->title = argv[3];
     job->num_options = cupsParseOptions(argv[5], 0, &( job->options ));
 
+    /* 份数和是否逐份输出。 */
+    job->copies = atoi(argv[4]);
+    if ( job->copies < 1 ) {
+        job->copies = 1;
+    }
+    job->collate = (
+        job_option_bool("Collate", job->num_options, job->options, 0) ||
+        ( ( value = cupsGetOption("multiple-document-handling", job->num_options, job->options) ) != NULL &&
+          ! strcasecmp(value, "separate-documents-collated-copies") )
+    );
+
     return FUNCTION_SUCCESS;
 }
 
@@ -239,6 +255,191 @@ pixel_24bit_matrix_upsidedown(
     return FUNCTION_SUCCESS;
 }
 
+/*
+ * bitmap_24bit_is_gray() - 判断一段 24 位像素是否全部 R == G == B。
+ *                          SSE2 下一次比较 16 个字节：把数据与错开一个字节的自身
+ *                          比较，每个像素的前两个字节都应与下一个字节相等。
+ */
+int                                     /* 输出 - 1 全为灰色，0 不是 */
+bitmap_24bit_is_gray(
+    const bitmap_24bit_pixel    *pixels,    /* 输入 - 像素 */
+    size_t                      count       /* 输入 - 像素个数 */
+) {
+    const uint8_t       *p = (const uint8_t *) pixels;
+    const size_t        size = count * sizeof(bitmap_24bit_pixel);
+    size_t              index = 0;
+#ifdef __SSE2__
+    /* 16 个字节的起点与像素边界错开 0、1、2 个字节时，需要比较的字节位置。 */
+    static const int    masks[3] = { 0xb6db, 0xdb6d, 0x6db6 };
+    __m128i             x, y;
+
+    for ( ; index + 48 + 1 <= size; index += 48 ) {
+        x = _mm_loadu_si128((const __m128i *) ( p + index ));
+        y = _mm_loadu_si128((const __m128i *) ( p + index + 1 ));
+        if ( ( _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & masks[0] ) != masks[0] ) {
+            return 0;
+        }
+        x = _mm_loadu_si128((const __m128i *) ( p + index + 16 ));
+        y = _mm_loadu_si128((const __m128i *) ( p + index + 17 ));
+        if ( ( _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & masks[1] ) != masks[1] ) {
+            return 0;
+        }
+        x = _mm_loadu_si128((const __m128i *) ( p + index + 32 ));
+        y = _mm_loadu_si128((const __m128i *) ( p + index + 33 ));
+        if ( ( _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & masks[2] ) != masks[2] ) {
+            return 0;
+        }
+    }
+#endif
+
+    for ( ; index < size; index += 3 ) {
+        if ( p[index] != p[index + 1] || p[index + 1] != p[index + 2] ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * bitmap_row_is_solid() - 判断一行像素是否全部相同。像素相同等价于整行与错开一个
+ *                         像素的自身相等，SSE2 下一次比较 16 个字节，遇到不同的
+ *                         字节马上返回，大多数不是纯色的行只看开头几个字节。
+ */
+int                                     /* 输出 - 1 全部相同，0 不是 */
+bitmap_row_is_solid(
+    const uint8_t       *row,           /* 输入 - 像素行 */
+    size_t              size,           /* 输入 - 行的字节数 */
+    unsigned            pixel_size      /* 输入 - 每像素的字节数 */
+) {
+    size_t              index = 0;
+
+    if ( pixel_size == 0 || size <= pixel_size ) {
+        return 1;
+    }
+    size -= pixel_size;
+#ifdef __SSE2__
+    for ( ; index + 16 <= size; index += 16 ) {
+        if ( _mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *) ( row + index )),
+                _mm_loadu_si128((const __m128i *) ( row + index + pixel_size ))
+        )) != 0xffff ) {
+            return 0;
+        }
+    }
+#endif
+
+    for ( ; index < size; index ++ ) {
+        if ( row[index] != row[index + pixel_size] ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * bitmap_fill_row() - 用第一个像素填满一行。各字节相同的像素（白、黑和灰色）用
+ *                     memset()，其他像素按已经填好的部分成倍复制。stream 为 1 且
+ *                     这一行不小于 BITMAP_STREAM_ROW_BYTES 时，对齐之后用 SSE2 的
+ *                     non-temporal 存储按 48 字节（1 和 3 字节像素的公倍数）一组写入，
+ *                     不把马上用不到的页缓冲读进缓存。
+ */
+void
+bitmap_fill_row(
+    void                *row,           /* 输入 - 像素行，第一个像素已经写好 */
+    size_t              count,          /* 输入 - 像素个数 */
+    unsigned            pixel_size,     /* 输入 - 每像素的字节数，能整除 48 */
+    int                 stream          /* 输入 - 是否用 non-temporal 存储 */
+) {
+    uint8_t             *p = (uint8_t *) row;
+    const size_t        size = count * pixel_size;
+    size_t              filled = pixel_size,
+                        limit = size,
+                        length;
+    unsigned            index;
+    int                 same = 1;
+#ifdef __SSE2__
+    size_t              aligned = 0;
+    __m128i             x, y, z;
+#endif
+
+    for ( index = 1; index < pixel_size; index ++ ) {
+        same = same && ( p[index] == p[0] );
+    }
+
+#ifdef __SSE2__
+    if ( stream && size >= BITMAP_STREAM_ROW_BYTES && 48 % pixel_size == 0 ) {
+        /* 先按普通方式填到第一个 16 字节对齐处之后的 48 个字节。 */
+        aligned = (size_t) ( ( 16 - ( (uintptr_t) p & 15 ) ) & 15 );
+        limit = aligned + 48;
+    }
+#endif
+
+    if ( same ) {
+        memset(p + filled, p[0], limit - filled);
+        filled = limit;
+    }
+    while ( filled < limit ) {
+        length = ( filled < limit - filled )? filled: limit - filled;
+        memcpy(p + filled, p, length);
+        filled += length;
+    }
+
+#ifdef __SSE2__
+    if ( limit < size ) {
+        /* 48 是像素大小的倍数，对齐处的 48 个字节就是之后每一组的内容。 */
+        x = _mm_load_si128((const __m128i *) ( p + aligned ));
+        y = _mm_load_si128((const __m128i *) ( p + aligned + 16 ));
+        z = _mm_load_si128((const __m128i *) ( p + aligned + 32 ));
+        for ( ; filled + 48 <= size; filled += 48 ) {
+            _mm_stream_si128((__m128i *) ( p + filled ), x);
+            _mm_stream_si128((__m128i *) ( p + filled + 16 ), y);
+            _mm_stream_si128((__m128i *) ( p + filled + 32 ), z);
+        }
+        _mm_sfence();
+        memcpy(p + filled, p + aligned, size - filled);
+    }
+#endif
+}
+
+/*
+ * bitmap_24bit_to_8bit() - 把灰色的 24 位像素阵原地压缩为 8 位像素阵，每个像素
+ *                          只留一个字节。
+ */
+bitmap_8bit_pixel *                     /* 输出 - 8 位像素阵（与输入同一块内存） */
+bitmap_24bit_to_8bit(
+    bitmap_24bit_pixel  *pixels,        /* 输入 - 像素阵 */
+    size_t              count           /* 输入 - 像素个数 */
+) {
+    const uint8_t       *src = (const uint8_t *) pixels;
+    uint8_t             *dst = (uint8_t *) pixels;
+    size_t              index;
+
+    for ( index = 0; index < count; index ++ ) {
+        dst[index] = src[index * 3];
+    }
+
+    return (bitmap_8bit_pixel *) pixels;
+}
+
+/*
+ * bitmap_size_fits() - 检查一张 bitmap 能否用一个文件表示：bf_size 和
+ *                      bi_data_size 都只有 32 位。
+ */
+int                                     /* 输出 - 1 可以，0 太大 */
+bitmap_size_fits(
+    unsigned            width,          /* 输入 - 图像宽度 */
+    unsigned            height,         /* 输入 - 图像高度 */
+    unsigned            pixel_size      /* 输入 - 每个像素的字节数 */
+) {
+    unsigned long long  row_bytes = ( (unsigned long long) width * pixel_size + 3 ) / 4 * 4;
+
+    return ( row_bytes * height
+             + sizeof(bitmap_file_header) + sizeof(bitmap_info_header) + sizeof(bitmap_8bit_palette)
+             <= UINT32_MAX );
+}
+
 int
 init_8bit_header(
     bitmap_file_header *file_header,
@@ -387,3 +588,62 @@ pixel_8bit_matrix_upsidedown(
 
     return FUNCTION_SUCCESS;
 }
+
+/*
+ * set_bitmap_resolution() - 按 dpi 设置位图头部中的分辨率。
+ *                           bitmap 中的分辨率以 px/m 为单位，一般取 raster 页头的
+ *                           HWResolution（或重采样后的目标分辨率）。
+ */
+int                                     /* 输出 - 1 成功, 0 失败 */
+set_bitmap_resolution(
+    bitmap_info_header  *info_header,   /* 输入 - 位图头部信息 */
+    unsigned            x_dpi,          /* 输入 - 横向分辨率 (dpi) */
+    unsigned            y_dpi           /* 输入 - 纵向分辨率 (dpi) */
+) {
+    info_header->bi_x_res = (uint32_t) ( ( (unsigned long long) x_dpi * BITMAP_INCHES_PER_METER_X100 + 50 ) / 100 );
+    info_header->bi_y_res = (uint32_t) ( ( (unsigned long long) y_dpi * BITMAP_INCHES_PER_METER_X100 + 50 ) / 100 );
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * bitmap_write_sink() - 向输出流写入一个完整的 bitmap 文件，每一行（含补齐字节）
+ *                       直接拼进输出缓冲段，不再逐个像素 fwrite()。
+ *                       palette 为 NULL 时不写调色板。像素点阵同样是从下到上排序的。
+ */
+int                                     /* 输出 - 1 成功, 0 失败 */
+bitmap_write_sink(
+    bitmap_file_header          file_header,    /* 输入 - 文件头部信息 */
+    bitmap_info_header          info_header,    /* 输入 - 位图头部信息 */
+    const bitmap_8bit_palette   *palette,       /* 输入 - 调色板，可为 NULL */
+    const void                  *pixels,        /* 输入 - 像素点阵 */
+    output_sink_t               *sink           /* 输入 - 输出流 */
+) {
+    const uint8_t       *row = (const uint8_t *) pixels;
+    size_t              row_bytes = (size_t) info_header.bi_width * ( info_header.bi_bit_size / 8 );
+    size_t              pad_bytes = ( 4 - row_bytes % 4 ) % 4;
+    const char          *pad = &(str_to_fill[3 - pad_bytes]);
+    uint8_t             *out;
+    unsigned            index;
+
+    if (
+        ! output_write(sink, &file_header, sizeof(bitmap_file_header))
+        || ! output_write(sink, &info_header, sizeof(bitmap_info_header))
+        || ( palette != NULL && ! output_write(sink, palette, sizeof(bitmap_8bit_palette)) )
+    ) {
+        return FUNCTION_FAILURE;
+    }
+
+    for ( index = 0; index < info_header.bi_height; index ++, row += row_bytes ) {
+        if ( ( out = output_reserve(sink, row_bytes + pad_bytes) ) != NULL ) {
+            memcpy(out, row, row_bytes);
+            memcpy(out + row_bytes, pad, pad_bytes);
+            output_commit(sink, row_bytes + pad_bytes);
+        } else if ( ! output_write(sink, row, row_bytes) || ! output_write(sink, pad, pad_bytes) ) {
+            /* 一行比缓冲段还长时走这里。 */
+            return FUNCTION_FAILURE;
+        }
+    }
+
+    return ( sink->failed )? FUNCTION_FAILURE: FUNCTION_SUCCESS;
+}
@@ -33,6 +33,8 @@
 #include <cups/cups.h>
 #include <string.h>
 #include <fcntl.h>
+#include "output.h"
+#include "options.h"
 
 #ifndef FUNCTION_SUCCESS
 #define FUNCTION_SUCCESS                    1       /* 定义函数成功默认返回 1 */
@@ -51,6 +53,8 @@
 #define BITMAP_INFO_NON_COMPRESSION         0       /* 压缩方式 0 为不压缩 */
 #define BITMAP_INFO_DEFAULT_X_RES           0       /* 横向分辨率的默认值 */
 #define BITMAP_INFO_DEFAULT_Y_RES           0       /* 纵向分辨率的默认值 */
+#define BITMAP_INCHES_PER_METER_X100        3937    /* 1 米 = 39.37 英寸，用于把 dpi 换算为 px/m */
+#define BITMAP_STREAM_ROW_BYTES             ( 64 * 1024 ) /* 不小于这个字节数的纯色行用 non-temporal 存储填充 */
 /*
  * 一般有的地方会说上面的这两个值可以为 0，但是在 KolourPaint 输出的文件中，这个值
  * 好像被设定为 3,780，或者叫做 0xec4。到底有什么特定含义呢？我还不太清楚。
@@ -127,6 +131,8 @@ typedef struct {
                     *title;         /* 任务标题 */
     int             num_options;    /* 命令行选项个数 */
     cups_option_t   *options;       /* 命令行选项 */
+    int             copies,         /* 份数 */
+                    collate;        /* 多份时是否逐份输出（1 2 3 1 2 3） */
 } bitmap_job_data_t;
 
 /*
@@ -137,6 +143,11 @@ extern int init_24bit_header(bitmap_file_header *file_header, bitmap_info_header
 extern int set_24bit_pixel_color(bitmap_24bit_pixel *pixel, uint8_t red, uint8_t green, uint8_t blue);
 extern int bitmap_24bit_write(bitmap_file_header file_header, bitmap_info_header info_header, bitmap_24bit_pixel *pixels, FILE *fp);
 extern int pixel_24bit_matrix_upsidedown(bitmap_24bit_pixel *pixels, unsigned width, unsigned height);
+extern int bitmap_24bit_is_gray(const bitmap_24bit_pixel *pixels, size_t count);
+extern bitmap_8bit_pixel *bitmap_24bit_to_8bit(bitmap_24bit_pixel *pixels, size_t count);
+extern int bitmap_row_is_solid(const uint8_t *row, size_t size, unsigned pixel_size);
+extern void bitmap_fill_row(void *row, size_t count, unsigned pixel_size, int stream);
+extern int bitmap_size_fits(unsigned width, unsigned height, unsigned pixel_size);
 
 extern int init_8bit_header(bitmap_file_header *file_header, bitmap_info_header *info_header, unsigned width, unsigned height);
 extern int init_8bit_w_palette(bitmap_8bit_palette *palette);
@@ -144,6 +155,9 @@ extern int set_8bit_pixel_color(bitmap_8bit_pixel *pixel, uint8_t value);
 extern int bitmap_8bit_write(bitmap_file_header file_header, bitmap_info_header info_header, bitmap_8bit_palette palette, bitmap_8bit_pixel *pixels, FILE *fp);
 extern int pixel_8bit_matrix_upsidedown(bitmap_8bit_pixel *pixels, unsigned width, unsigned height);
 
+extern int set_bitmap_resolution(bitmap_info_header *info_header, unsigned x_dpi, unsigned y_dpi);
+extern int bitmap_write_sink(bitmap_file_header file_header, bitmap_info_header info_header, const bitmap_8bit_palette *palette, const void *pixels, output_sink_t *sink);
+
 extern void log_error(char *type, char *content);
 extern void log_debug(char *type, char *content);
 
@@ -0,0 +1,101 @@
+/*
+ * cachefile.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 缓存文件（PPD 缓存、raster 页索引）的读写。缓存文件默认放在 /tmp 这样的公共
+ * 目录中，别的用户可以抢先放一个文件或符号链接，所以只映射自己所有、组和其他
+ * 用户不可写的普通文件，不跟随符号链接。写入时先写临时文件再 rename()，并发的
+ * 任务不会读到写了一半的文件。文件内容的检查由调用者负责。
+ */
+
+#define _GNU_SOURCE
+
+#include "cachefile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * cachefile_map() - 只读映射一个可信的缓存文件。
+ */
+void *                                  /* 输出 - 映射的内容，没有文件或文件不可信时为 MAP_FAILED */
+cachefile_map(
+    const char          *path,          /* 输入 - 缓存文件路径 */
+    size_t              *size           /* 输出 - 文件的大小 */
+) {
+    struct stat         st;
+    void                *image = MAP_FAILED;
+    int                 fd;
+
+    *size = 0;
+    if ( ( fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW) ) < 0 ) {
+        return MAP_FAILED;
+    }
+    if (
+        fstat(fd, &st) == 0 && st.st_size > 0
+        && S_ISREG(st.st_mode)
+        && st.st_uid == geteuid()
+        && ( st.st_mode & ( S_IWGRP | S_IWOTH ) ) == 0
+    ) {
+        *size = (size_t) st.st_size;
+        image = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    } else {
+        fprintf(stderr, "DEBUG: Ignoring untrusted cache file \"%s\"\n", path);
+    }
+    close(fd);
+
+    return image;
+}
+
+/*
+ * cachefile_write() - 把内容写入缓存文件：先写临时文件，再 rename()。
+ */
+void
+cachefile_write(
+    const char          *path,          /* 输入 - 缓存文件路径 */
+    const void          *image,         /* 输入 - 文件内容 */
+    size_t              size            /* 输入 - 内容的大小 */
+) {
+    char                temp_path[1024 + 8];
+    int                 fd;
+
+    snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", path);
+    if ( ( fd = mkstemp(temp_path) ) < 0 ) {
+        fprintf(stderr, "DEBUG: Unable to create cache file \"%s\"\n", path);
+        return;
+    }
+
+    if ( write(fd, image, size) != (ssize_t) size || fchmod(fd, 0644) != 0 || close(fd) != 0 ) {
+        unlink(temp_path);
+        return;
+    }
+    if ( rename(temp_path, path) != 0 ) {
+        unlink(temp_path);
+    }
+}
@@ -0,0 +1,443 @@
+/*
+ * colorlut.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 颜色管理。伽马、对比度、亮度这类逐通道的校正预先算成 1D 查找表，8 位输入直接
+ * 查 256 项的表，16 位输入查 65536 项的表，顺便代替了 (x + 129) / 257 的换算。
+ * device link 一类的颜色转换用 3D 查找表加四面体插值，四个顶点的加权求和用
+ * GCC 向量扩展一次算完 R, G, B 三个通道。
+ *
+ * 查找表可以由任务选项生成，也可以从 .cube 文件读入：
+ *
+ *     bitmap-gamma=2.2            输出 = 输入 ^ (1 / 2.2)
+ *     bitmap-contrast=120         对比度 (%)，以 50% 灰为中心
+ *     bitmap-brightness=90        亮度 (%)
+ *     bitmap-color-lut=/path/to/file.cube
+ */
+
+#include "colorlut.h"
+#include <math.h>
+
+#define COLORLUT_NODE_SCALE     16      /* 3D 查找表格点值放大的倍数 */
+#define COLORLUT_NODE_SHIFT     12      /* 插值结果还原时右移的位数 (256 * 16 = 2^12) */
+#define COLORLUT_MAX_GRID       65      /* 3D 查找表每边格点数的上限 */
+
+/* 一次处理 R, G, B 和一个空位的向量类型（GCC 向量扩展）。 */
+typedef int32_t colorlut_v4si __attribute__ ((vector_size (16)));
+
+/*
+ * .cube 文件中的 1D 查找表。
+ */
+typedef struct {
+    unsigned    size;           /* 表项数，0 表示没有 */
+    float       *table;         /* size 项，每项 R, G, B */
+} colorlut_table1d_t;
+
+/*
+ * colorlut_clamp() - 把数值截断到 0.0 ~ 1.0。
+ */
+static double
+colorlut_clamp(
+    double      x
+) {
+    return ( x < 0.0 )? 0.0: ( x > 1.0 )? 1.0: x;
+}
+
+/*
+ * colorlut_curve() - 计算一个通道的 1D 校正。
+ */
+static double                               /* 输出 - 校正后的值 (0.0 ~ 1.0) */
+colorlut_curve(
+    double                      x,          /* 输入 - 输入值 (0.0 ~ 1.0) */
+    unsigned                    channel,    /* 输入 - 通道 */
+    double                      gamma,      /* 输入 - 伽马 */
+    double                      contrast,   /* 输入 - 对比度（倍数） */
+    double                      brightness, /* 输入 - 亮度（倍数） */
+    const colorlut_table1d_t    *table1d    /* 输入 - 文件中的 1D 查找表 */
+) {
+    double      pos;
+    unsigned    index;
+
+    if ( gamma != 1.0 ) {
+        x = pow(x, 1.0 / gamma);
+    }
+    x = colorlut_clamp(( x - 0.5 ) * contrast + 0.5);
+    x = colorlut_clamp(x * brightness);
+
+    if ( table1d->size >= 2 ) {
+        pos = x * ( table1d->size - 1 );
+        index = (unsigned) pos;
+        if ( index >= table1d->size - 1 ) {
+            index = table1d->size - 2;
+        }
+        pos -= index;
+        x = table1d->table[index * 3 + channel] * ( 1.0 - pos )
+          + table1d->table[( index + 1 ) * 3 + channel] * pos;
+        x = colorlut_clamp(x);
+    }
+
+    return x;
+}
+
+/*
+ * colorlut_build_curves() - 生成 8 位和 16 位输入的 1D 查找表。
+ */
+static void
+colorlut_build_curves(
+    colorlut_t                  *lut,       /* 输入 - 颜色查找表 */
+    double                      gamma,      /* 输入 - 伽马 */
+    double                      contrast,   /* 输入 - 对比度（倍数） */
+    double                      brightness, /* 输入 - 亮度（倍数） */
+    const colorlut_table1d_t    *table1d    /* 输入 - 文件中的 1D 查找表 */
+) {
+    const int   identity = ( gamma == 1.0 && contrast == 1.0 && brightness == 1.0 && table1d->size == 0 );
+    unsigned    channel, value;
+
+    for ( channel = 0; channel < 3; channel ++ ) {
+        for ( value = 0; value < 0x100; value ++ ) {
+            lut->curve8[channel][value] = (uint8_t) ( 255.0 * colorlut_curve(
+                value / 255.0, channel, gamma, contrast, brightness, table1d
+            ) + 0.5 );
+        }
+        for ( value = 0; value < 0x10000; value ++ ) {
+            /* 恒等时与原来的 16 位转 8 位公式保持一致。 */
+            lut->curve16[channel][value] = identity? (uint8_t) ( ( value + 129 ) / 257 ):
+                (uint8_t) ( 255.0 * colorlut_curve(
+                    value / 65535.0, channel, gamma, contrast, brightness, table1d
+                ) + 0.5 );
+        }
+    }
+}
+
+/*
+ * colorlut_read_cube() - 读取 .cube 文件。文件中可以有 1D 表、3D 表，或者两者
+ *                        都有（此时 1D 表的数据在前）。
+ */
+static int                                  /* 输出 - 1 成功，0 失败 */
+colorlut_read_cube(
+    colorlut_t                  *lut,       /* 输入 - 颜色查找表 */
+    const char                  *filename,  /* 输入 - 文件名 */
+    colorlut_table1d_t          *table1d    /* 输出 - 1D 查找表 */
+) {
+    FILE        *fp;
+    char        line[256];
+    float       rgb[3],
+                domain_min[3] = { 0.0f, 0.0f, 0.0f },
+                domain_max[3] = { 1.0f, 1.0f, 1.0f };
+    unsigned    size1d = 0, size3d = 0, count = 0, total, channel, index;
+    float       *values = NULL;
+
+    if ( ( fp = fopen(filename, "r") ) == NULL ) {
+        log_error("Error", "Unable to open color LUT file!");
+        return FUNCTION_FAILURE;
+    }
+
+    while ( fgets(line, sizeof(line), fp) != NULL ) {
+        if ( line[0] == '#' || line[0] == '\n' || line[0] == '\r' || line[0] == '\0' ) {
+            continue;
+        } else if ( sscanf(line, "LUT_1D_SIZE %u", &size1d) == 1 ) {
+            continue;
+        } else if ( sscanf(line, "LUT_3D_SIZE %u", &size3d) == 1 ) {
+            continue;
+        } else if ( sscanf(line, "DOMAIN_MIN %f %f %f", domain_min, domain_min + 1, domain_min + 2) == 3 ) {
+            continue;
+        } else if ( sscanf(line, "DOMAIN_MAX %f %f %f", domain_max, domain_max + 1, domain_max + 2) == 3 ) {
+            continue;
+        } else if ( sscanf(line, "%f %f %f", rgb, rgb + 1, rgb + 2) != 3 ) {
+            /* TITLE、LUT_*_INPUT_RANGE 之类的关键字用不到。 */
+            continue;
+        }
+
+        if ( values == NULL ) {
+            if (
+                ( size1d == 0 && size3d == 0 ) ||
+                ( size1d != 0 && ( size1d < 2 || size1d > 0x10000 ) ) ||
+                ( size3d != 0 && ( size3d < 2 || size3d > COLORLUT_MAX_GRID ) )
+            ) {
+                log_error("Error", "Bad LUT size in color LUT file!");
+                fclose(fp);
+                return FUNCTION_FAILURE;
+            }
+            if ( ( values = (float *) malloc(sizeof(float) * 3 * ( size1d + size3d * size3d * size3d )) ) == NULL ) {
+                fclose(fp);
+                return FUNCTION_FAILURE;
+            }
+        }
+
+        total = size1d + size3d * size3d * size3d;
+        if ( count < total ) {
+            for ( channel = 0; channel < 3; channel ++ ) {
+                values[count * 3 + channel] = ( rgb[channel] - domain_min[channel] )
+                                            / ( domain_max[channel] - domain_min[channel] );
+            }
+            count ++;
+        }
+    }
+    fclose(fp);
+
+    if ( values == NULL || count != size1d + size3d * size3d * size3d ) {
+        log_error("Error", "Truncated color LUT file!");
+        free(values);
+        return FUNCTION_FAILURE;
+    }
+
+    table1d->size = size1d;
+    table1d->table = values;
+
+    if ( size3d != 0 ) {
+        /* .cube 中红色变化最快，与这里格点的排列一致。 */
+        if ( ( lut->lut3d = (int32_t *) calloc((size_t) size3d * size3d * size3d * 4, sizeof(int32_t)) ) == NULL ) {
+            return FUNCTION_FAILURE;
+        }
+        lut->grid = size3d;
+        for ( index = 0; index < size3d * size3d * size3d; index ++ ) {
+            for ( channel = 0; channel < 3; channel ++ ) {
+                lut->lut3d[index * 4 + channel] = (int32_t) (
+                    colorlut_clamp(values[( size1d + index ) * 3 + channel])
+                    * 255 * COLORLUT_NODE_SCALE + 0.5
+                );
+            }
+        }
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * colorlut_from_job() - 按任务选项生成颜色查找表。
+ */
+colorlut_t *                            /* 输出 - 颜色查找表，不需要颜色管理时为 NULL */
+colorlut_from_job(
+    bitmap_job_data_t   *job            /* 输入 - 任务数据 */
+) {
+    const char          *value,
+                        *filename = cupsGetOption("bitmap-color-lut", job->num_options, job->options);
+    double              gamma = 1.0,
+                        contrast = 1.0,
+                        brightness = 1.0;
+    colorlut_table1d_t  table1d = { 0, NULL };
+    colorlut_t          *lut;
+    unsigned            channel;
+
+    if ( ( value = cupsGetOption("bitmap-gamma", job->num_options, job->options) ) != NULL && atof(value) > 0.0 ) {
+        gamma = atof(value);
+    }
+    if ( ( value = cupsGetOption("bitmap-contrast", job->num_options, job->options) ) != NULL && atof(value) >= 0.0 ) {
+        contrast = atof(value) / 100.0;
+    }
+    if ( ( value = cupsGetOption("bitmap-brightness", job->num_options, job->options) ) != NULL && atof(value) >= 0.0 ) {
+        brightness = atof(value) / 100.0;
+    }
+
+    if ( gamma == 1.0 && contrast == 1.0 && brightness == 1.0 && filename == NULL ) {
+        return NULL;
+    }
+
+    if ( ( lut = (colorlut_t *) calloc(1, sizeof(colorlut_t)) ) == NULL ) {
+        return NULL;
+    }
+    for ( channel = 0; channel < 3; channel ++ ) {
+        if ( ( lut->curve16[channel] = (uint8_t *) malloc(0x10000) ) == NULL ) {
+            colorlut_free(lut);
+            return NULL;
+        }
+    }
+
+    if ( filename != NULL && ! colorlut_read_cube(lut, filename, &table1d) ) {
+        log_error("Warning", "Color LUT file ignored.");
+        free(table1d.table);
+        table1d.size = 0;
+        table1d.table = NULL;
+    }
+
+    colorlut_build_curves(lut, gamma, contrast, brightness, &table1d);
+    free(table1d.table);
+
+    fprintf(stderr, "DEBUG: Color LUT: gamma=%g contrast=%g brightness=%g 3D grid=%u\n",
+        gamma, contrast, brightness, lut->grid);
+
+    return lut;
+}
+
+/*
+ * colorlut_tetrahedral() - 3D 查找表的四面体插值。
+ */
+static inline void
+colorlut_tetrahedral(
+    const colorlut_t    *lut,           /* 输入 - 颜色查找表 */
+    uint8_t             *rgb            /* 输入/输出 - R, G, B */
+) {
+    const unsigned      n = lut->grid,
+                        dr = 4,
+                        dg = 4 * n,
+                        db = 4 * n * n;
+    unsigned            ir, ig, ib;
+    int32_t             fr, fg, fb, w0, w1, w2, w3;
+    const int32_t       *c0, *c1, *c2, *c3;
+    colorlut_v4si       v0, v1, v2, v3, out;
+
+    /* 8 位输入值在格点间的位置，小数部分放大 256 倍。 */
+    fr = rgb[0] * ( n - 1 ) * 256 / 255;
+    fg = rgb[1] * ( n - 1 ) * 256 / 255;
+    fb = rgb[2] * ( n - 1 ) * 256 / 255;
+    ir = fr >> 8, ig = fg >> 8, ib = fb >> 8;
+    if ( ir == n - 1 ) ir --;
+    if ( ig == n - 1 ) ig --;
+    if ( ib == n - 1 ) ib --;
+    fr -= ir << 8, fg -= ig << 8, fb -= ib << 8;
+
+    c0 = lut->lut3d + ir * dr + ig * dg + ib * db;
+    c3 = c0 + dr + dg + db;
+
+    if ( fr >= fg ) {
+        if ( fg >= fb ) {
+            c1 = c0 + dr, c2 = c0 + dr + dg;
+            w0 = 256 - fr, w1 = fr - fg, w2 = fg - fb, w3 = fb;
+        } else if ( fr >= fb ) {
+            c1 = c0 + dr, c2 = c0 + dr + db;
+            w0 = 256 - fr, w1 = fr - fb, w2 = fb - fg, w3 = fg;
+        } else {
+            c1 = c0 + db, c2 = c0 + dr + db;
+            w0 = 256 - fb, w1 = fb - fr, w2 = fr - fg, w3 = fg;
+        }
+    } else {
+        if ( fb > fg ) {
+            c1 = c0 + db, c2 = c0 + dg + db;
+            w0 = 256 - fb, w1 = fb - fg, w2 = fg - fr, w3 = fr;
+        } else if ( fb > fr ) {
+            c1 = c0 + dg, c2 = c0 + dg + db;
+            w0 = 256 - fg, w1 = fg - fb, w2 = fb - fr, w3 = fr;
+        } else {
+            c1 = c0 + dg, c2 = c0 + dr + dg;
+            w0 = 256 - fg, w1 = fg - fr, w2 = fr - fb, w3 = fb;
+        }
+    }
+
+    memcpy(&v0, c0, sizeof(v0));
+    memcpy(&v1, c1, sizeof(v1));
+    memcpy(&v2, c2, sizeof(v2));
+    memcpy(&v3, c3, sizeof(v3));
+    out = v0 * w0 + v1 * w1 + v2 * w2 + v3 * w3;
+    /* 权值之和为 256，格点值放大了 16 倍，合计右移 12 位。 */
+    out = ( out + ( 1 << ( COLORLUT_NODE_SHIFT - 1 ) ) ) >> COLORLUT_NODE_SHIFT;
+
+    rgb[0] = (uint8_t) out[0];
+    rgb[1] = (uint8_t) out[1];
+    rgb[2] = (uint8_t) out[2];
+}
+
+/*
+ * colorlut_convert_color() - 把一行 RGB raster 数据转换为 24 位像素，同时套用
+ *                            颜色查找表。
+ */
+void
+colorlut_convert_color(
+    const colorlut_t    *lut,           /* 输入 - 颜色查找表 */
+    const uint8_t       *line,          /* 输入 - Raster 数据 */
+    unsigned            bits,           /* 输入 - 每个颜色的位数（8 或 16） */
+    unsigned            num_pixels,     /* 输入 - 像素个数 */
+    bitmap_24bit_pixel  *output         /* 输出 - 像素行 */
+) {
+    const uint16_t      *line16 = (const uint16_t *) line;
+    uint8_t             rgb[3],
+                        last_in[3] = { 0, 0, 0 },
+                        last_out[3];
+    int                 cached = 0;
+    unsigned            index;
+
+    for ( index = 0; index < num_pixels; index ++ ) {
+        if ( bits == 8 ) {
+            rgb[0] = lut->curve8[0][line[0]];
+            rgb[1] = lut->curve8[1][line[1]];
+            rgb[2] = lut->curve8[2][line[2]];
+            line += 3;
+        } else {
+            rgb[0] = lut->curve16[0][line16[0]];
+            rgb[1] = lut->curve16[1][line16[1]];
+            rgb[2] = lut->curve16[2][line16[2]];
+            line16 += 3;
+        }
+
+        if ( lut->grid ) {
+            /* 相邻像素颜色相同的情况很多，记住上一次的插值结果。 */
+            if ( cached && ! memcmp(rgb, last_in, 3) ) {
+                memcpy(rgb, last_out, 3);
+            } else {
+                memcpy(last_in, rgb, 3);
+                colorlut_tetrahedral(lut, rgb);
+                memcpy(last_out, rgb, 3);
+                cached = 1;
+            }
+        }
+
+        set_24bit_pixel_color(output + index, rgb[0], rgb[1], rgb[2]);
+    }
+}
+
+/*
+ * colorlut_convert_bw() - 把一行灰度 raster 数据转换为 8 位像素，同时套用 1D
+ *                         曲线。灰度使用绿色通道的曲线。
+ */
+void
+colorlut_convert_bw(
+    const colorlut_t    *lut,           /* 输入 - 颜色查找表 */
+    const uint8_t       *line,          /* 输入 - Raster 数据 */
+    unsigned            bits,           /* 输入 - 每个颜色的位数（8 或 16） */
+    unsigned            num_pixels,     /* 输入 - 像素个数 */
+    bitmap_8bit_pixel   *output         /* 输出 - 像素行 */
+) {
+    const uint16_t      *line16 = (const uint16_t *) line;
+    unsigned            index;
+
+    if ( bits == 8 ) {
+        for ( index = 0; index < num_pixels; index ++ ) {
+            output[index].b8p_value = lut->curve8[1][line[index]];
+        }
+    } else {
+        for ( index = 0; index < num_pixels; index ++ ) {
+            output[index].b8p_value = lut->curve16[1][line16[index]];
+        }
+    }
+}
+
+/*
+ * colorlut_free() - 释放颜色查找表。
+ */
+void
+colorlut_free(
+    colorlut_t          *lut            /* 输入 - 颜色查找表 */
+) {
+    unsigned            channel;
+
+    if ( lut == NULL ) {
+        return;
+    }
+    for ( channel = 0; channel < 3; channel ++ ) {
+        free(lut->curve16[channel]);
+    }
+    free(lut->lut3d);
+    free(lut);
+}
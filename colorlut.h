@@ -0,0 +1,48 @@
+/*
+ * colorlut.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_COLORLUT_H
+#define __LEISRASTERFILTER_COLORLUT_H
+
+#include "bitmap.h"
+
+/*
+ * 颜色查找表。每个通道一条 1D 曲线（伽马、对比度、亮度，或者从文件读入），
+ * 外加一张可选的 3D 查找表（device link），在像素转换的同一个循环里完成。
+ */
+typedef struct {
+    uint8_t     curve8[3][0x100];       /* 8 位输入的 1D 曲线，按 R, G, B 排列 */
+    uint8_t     *curve16[3];            /* 16 位输入的 1D 曲线，各 65536 项 */
+    unsigned    grid;                   /* 3D 查找表每边的格点数，0 表示没有 */
+    int32_t     *lut3d;                 /* 3D 查找表，每个格点 4 个 int32（R, G, B, 0） */
+} colorlut_t;
+
+extern colorlut_t *colorlut_from_job(bitmap_job_data_t *job);
+extern void colorlut_convert_color(const colorlut_t *lut, const uint8_t *line, unsigned bits, unsigned num_pixels, bitmap_24bit_pixel *output);
+extern void colorlut_convert_bw(const colorlut_t *lut, const uint8_t *line, unsigned bits, unsigned num_pixels, bitmap_8bit_pixel *output);
+extern void colorlut_free(colorlut_t *lut);
+
+#endif
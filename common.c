@@ -25,14 +25,33 @@
  */
 
 #include <stdarg.h>
+#include <math.h>
+#include <time.h>
 #include "sample.h"			/* Common sample driver header */
 
+/*
+ * 状态线程的数据。
+ */
+static pthread_t        StatusThread;
+static pthread_mutex_t  StatusLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   StatusWake = PTHREAD_COND_INITIALIZER;
+static int              StatusRunning = 0,      /* 状态线程已启动 */
+                        StatusStop = 0;         /* 要求状态线程结束 */
+static ppdcache_t       *StatusPPD = NULL;
+static double           StatusInterval = STATUS_DEFAULT_INTERVAL;
+static const progress_t *StatusProgress = NULL;
+
+/*
+ * 过滤器启动的时刻，用于统计启动耗时和第一页的耗时。
+ */
+static struct timespec  StartTime;
+
 /*
  * GetStatus() - 读取状态信息。
  */
 int                     /* 输出 - 1 成功, 0 失败 */
 GetStatus(
-    ppd_file_t *ppd,    /* I - PPD file for printer */
+    ppdcache_t *ppd,    /* I - PPD file for printer */
     double     timeout  /* I - Timeout in seconds */
 ) {
     char        buffer[1024],   /* Buffer for back-channel data */
@@ -59,7 +78,7 @@ GetStatus(
     // }
 
     strcpy(buffer, "IL999,999,999,999\nOK\n");
-    bytes = sizeof(buffer);
+    bytes = strlen(buffer);
 
     /* 以 '\0' 作为 buffer 的终止符。 */
     buffer[bytes] = '\0';
@@ -180,17 +199,32 @@ GetStatus(
 
 
 /*
- * Initialize() - 打开 PPD 文件并分析（parse）选项。
+ * ElapsedTime() - 从 Initialize() 开始到现在经过的时间。
  */
-ppd_file_t                  /* 输出 - 用于打印机的 PPD 文件 */
+double                  /* 输出 - 经过的时间（毫秒） */
+ElapsedTime(void) {
+    struct timespec     now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ( now.tv_sec - StartTime.tv_sec ) * 1e3 + ( now.tv_nsec - StartTime.tv_nsec ) / 1e6;
+}
+
+/*
+ * Initialize() - 打开 PPD 文件并分析（parse）选项。PPD 文件通过缓存读取，
+ *                缓存有效时不需要再解析 PPD。
+ */
+ppdcache_t                  /* 输出 - 用于打印机的 PPD 缓存 */
 *Initialize(
     int         argc,
     char        *argv[],
     job_data_t  *job        /* 输入 - 任务数据 */
 ) {
-    ppd_file_t  *ppd;       /* 用于打印机的 PPD 文件 */
+    ppdcache_t  *ppd;       /* 用于打印机的 PPD 缓存 */
     int i;
 
+    clock_gettime(CLOCK_MONOTONIC, &StartTime);
+
     /* 检查命令行参数个数。
      * if ( argc < 6 || argc > 7 )
      */
@@ -214,13 +248,10 @@ ppd_file_t                  /* 输出 - 用于打印机的 PPD 文件 */
     job->title = argv[3];
     job->num_options = cupsParseOptions(argv[5], 0, &( job->options ));
 
-    /* 打开 PPD 文件。 */
-    if ( ( ppd = ppdOpenFile(getenv("PPD")) ) != NULL ) {
-        /*
-         * Mark the options for the job...
-         */
-        ppdMarkDefaults(ppd);
-        cupsMarkOptions(ppd, job->num_options, job->options);
+    /* 打开 PPD 缓存。 */
+    if ( ( ppd = ppdcache_open(getenv("PPD")) ) != NULL ) {
+        fprintf(stderr, "DEBUG: Startup took %.1f ms (PPD cache %s)\n",
+            ElapsedTime(), ppd->rebuilt? "rebuilt": "hit");
     } else {
         LogMessage("WARNING", "Unable to open PPD file");
     }
@@ -228,6 +259,102 @@ ppd_file_t                  /* 输出 - 用于打印机的 PPD 文件 */
     return ppd;
 }
 
+/*
+ * StatusMain() - 状态线程：每隔一段时间报告一次进度、向打印机查询墨水量，并处理
+ *                back-channel 数据。写标准输出时锁住 stdout，不会插进一行 raster
+ *                数据的中间。
+ */
+static void *
+StatusMain(
+    void        *data   /* 输入 - 未使用 */
+) {
+    struct timespec     deadline;
+    double              whole;
+    int                 page;
+    unsigned            row, height;
+
+    pthread_mutex_lock(&StatusLock);
+
+    while ( ! StatusStop ) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long) ( modf(StatusInterval, &whole) * 1e9 );
+        deadline.tv_sec += (time_t) whole + deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        while ( ! StatusStop ) {
+            if ( pthread_cond_timedwait(&StatusWake, &StatusLock, &deadline) == ETIMEDOUT ) {
+                break;
+            }
+        }
+        if ( StatusStop ) {
+            break;
+        }
+        pthread_mutex_unlock(&StatusLock);
+
+        /* 显示进度。 */
+        page = __atomic_load_n(&(StatusProgress->page), __ATOMIC_RELAXED);
+        row = __atomic_load_n(&(StatusProgress->row), __ATOMIC_RELAXED);
+        height = __atomic_load_n(&(StatusProgress->height), __ATOMIC_RELAXED);
+        if ( page > 0 && height > 0 ) {
+            flockfile(stdout);
+            fprintf(stdout, "++ Printing page %d, %.0f%% completed\n", page, (100.0 * row / height));
+            puts("LEVELS");
+            fflush(stdout);
+            funlockfile(stdout);
+        }
+
+        /* 根据设备检查状态信息。 */
+        GetStatus(StatusPPD, 0.0);
+
+        pthread_mutex_lock(&StatusLock);
+    }
+
+    pthread_mutex_unlock(&StatusLock);
+
+    return NULL;
+}
+
+/*
+ * StartStatusThread() - 启动状态线程。
+ */
+int                                 /* 输出 - 1 成功，0 失败 */
+StartStatusThread(
+    ppdcache_t          *ppd,       /* 输入 - 打印机用 PPD 文件 */
+    double              interval,   /* 输入 - 轮询间隔（秒） */
+    const progress_t    *progress   /* 输入 - 打印进度 */
+) {
+    StatusPPD = ppd;
+    StatusInterval = ( interval > 0.0 )? interval: STATUS_DEFAULT_INTERVAL;
+    StatusProgress = progress;
+    StatusStop = 0;
+
+    if ( pthread_create(&StatusThread, NULL, StatusMain, NULL) != 0 ) {
+        LogMessage("WARNING", "Unable to start status thread");
+        return 0;
+    }
+    StatusRunning = 1;
+
+    return 1;
+}
+
+/*
+ * StopStatusThread() - 叫醒并等待状态线程结束。
+ */
+void
+StopStatusThread(void) {
+    if ( ! StatusRunning ) {
+        return;
+    }
+
+    pthread_mutex_lock(&StatusLock);
+    StatusStop = 1;
+    pthread_cond_signal(&StatusWake);
+    pthread_mutex_unlock(&StatusLock);
+
+    pthread_join(StatusThread, NULL);
+    StatusRunning = 0;
+}
+
 void LogMessage(char *prefix, char *content) {
     fprintf(stderr, "-------- %s -------- : %s\n", prefix, content);
 }
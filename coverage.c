@@ -0,0 +1,284 @@
+/*
+ * coverage.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 墨水覆盖率统计。转换线程在每一小段行转换完后马上统计这几行（数据还在缓存
+ * 中），先记在自己的直方图里，再合并到这一页的统计中，不需要再扫描一遍像素。
+ * 文档页面的大部分是大片的同一种颜色，SSE2 下一次检查 16 个像素，全部相同时
+ * 一次加进直方图。
+ */
+
+#include "coverage.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const char CoverageJsonStart[] = "{\"pages\":[";
+static const char *const CoverageInks[COVERAGE_CHANNELS] = { "cyan", "magenta", "yellow", "black" };
+static const char *const CoverageChannels[COVERAGE_CHANNELS] = { "red", "green", "blue", "gray" };
+
+/*
+ * coverage_reset() - 开始新的统计。
+ */
+void
+coverage_reset(
+    coverage_t          *coverage,      /* 输出 - 统计 */
+    unsigned            channels        /* 输入 - 要统计的像素的通道数（1 或 3） */
+) {
+    memset(coverage, 0, sizeof(coverage_t));
+    coverage->channels = channels;
+}
+
+/*
+ * coverage_add() - 统计一行像素。彩色像素按 bitmap 的 B、G、R 顺序排列。
+ */
+void
+coverage_add(
+    coverage_t          *coverage,      /* 输入/输出 - 统计 */
+    const uint8_t       *pixels,        /* 输入 - 像素 */
+    size_t              count           /* 输入 - 像素数 */
+) {
+    size_t              index = 0;
+    const uint8_t       *p;
+
+    coverage->pixels += count;
+    if ( coverage->channels == 1 ) {
+#ifdef __SSE2__
+        /* 16 个像素都等于第一个时一次计入。 */
+        for ( ; index + 16 <= count; index += 16) {
+            p = pixels + index;
+            if ( _mm_movemask_epi8(_mm_cmpeq_epi8(
+                    _mm_loadu_si128((const __m128i *) p),
+                    _mm_set1_epi8((char) p[0])
+            )) == 0xffff ) {
+                coverage->histogram[3][p[0]] += 16;
+                continue;
+            }
+            for ( ; p < pixels + index + 16; p ++) {
+                coverage->histogram[3][*p] ++;
+            }
+        }
+#endif
+        for ( ; index < count; index ++) {
+            coverage->histogram[3][pixels[index]] ++;
+        }
+        return;
+    }
+
+#ifdef __SSE2__
+    /* 16 个像素（48 个字节）的每个字节都相同时（白色、黑色和灰色）一次计入。 */
+    for ( ; index + 16 <= count; index += 16) {
+        __m128i         value;
+
+        p = pixels + index * 3;
+        value = _mm_set1_epi8((char) p[0]);
+        if ( _mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) p), value),
+                _mm_and_si128(
+                    _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) ( p + 16 )), value),
+                    _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) ( p + 32 )), value)
+                )
+        )) == 0xffff ) {
+            coverage->histogram[0][p[0]] += 16;
+            coverage->histogram[1][p[0]] += 16;
+            coverage->histogram[2][p[0]] += 16;
+            continue;
+        }
+        for (p = pixels + index * 3; p < pixels + ( index + 16 ) * 3; p += 3) {
+            coverage->histogram[0][p[2]] ++;
+            coverage->histogram[1][p[1]] ++;
+            coverage->histogram[2][p[0]] ++;
+        }
+    }
+#endif
+    for (p = pixels + index * 3; index < count; index ++, p += 3) {
+        coverage->histogram[0][p[2]] ++;
+        coverage->histogram[1][p[1]] ++;
+        coverage->histogram[2][p[0]] ++;
+    }
+}
+
+/*
+ * coverage_merge() - 把一个统计合并到另一个中，可以由几个线程同时调用。
+ */
+void
+coverage_merge(
+    coverage_t          *dest,          /* 输入/输出 - 合并到这个统计 */
+    const coverage_t    *src            /* 输入 - 要合并的统计 */
+) {
+    unsigned            channel,
+                        value;
+
+    __atomic_fetch_add(&dest->pixels, src->pixels, __ATOMIC_RELAXED);
+    for (channel = 0; channel < COVERAGE_CHANNELS; channel ++) {
+        for (value = 0; value < 256; value ++) {
+            if ( src->histogram[channel][value] != 0 ) {
+                __atomic_fetch_add(&dest->histogram[channel][value], src->histogram[channel][value], __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+/*
+ * coverage_ink() - 按青、品红、黄、黑的顺序算出覆盖率（百分比）。
+ */
+void
+coverage_ink(
+    const coverage_t    *coverage,      /* 输入 - 统计 */
+    double              ink[4]          /* 输出 - 覆盖率 */
+) {
+    unsigned            channel,
+                        value;
+    uint64_t            sum;
+
+    ink[0] = ink[1] = ink[2] = ink[3] = 0.0;
+    if ( coverage->pixels == 0 ) {
+        return;
+    }
+    for (channel = 0; channel < COVERAGE_CHANNELS; channel ++) {
+        sum = 0;
+        for (value = 0; value < 255; value ++) {
+            sum += coverage->histogram[channel][value] * ( 255 - value );
+        }
+        ink[channel] = 100.0 * sum / ( 255.0 * coverage->pixels );
+    }
+}
+
+/*
+ * coverage_report() - 以 ATTR: 消息报告覆盖率，顺序与 marker-colors 相同。
+ */
+void
+coverage_report(
+    const char          *name,          /* 输入 - 属性名 */
+    const coverage_t    *coverage       /* 输入 - 统计 */
+) {
+    double              ink[4];
+
+    coverage_ink(coverage, ink);
+    fprintf(stderr, "ATTR: %s=%.2f,%.2f,%.2f,%.2f\n", name, ink[0], ink[1], ink[2], ink[3]);
+}
+
+/*
+ * coverage_json_write() - 写出一个统计的 JSON 对象。
+ */
+static void
+coverage_json_write(
+    FILE                *file,          /* 输入 - JSON 文件 */
+    const coverage_t    *coverage       /* 输入 - 统计 */
+) {
+    double              ink[4];
+    unsigned            channel,
+                        value;
+    int                 first;
+
+    coverage_ink(coverage, ink);
+    fprintf(file, "\"pixels\":%llu,\"coverage\":{", (unsigned long long) coverage->pixels);
+    for (channel = 0; channel < COVERAGE_CHANNELS; channel ++) {
+        fprintf(file, "%s\"%s\":%.4f", channel? ",": "", CoverageInks[channel], ink[channel]);
+    }
+    fprintf(file, "},\"histogram\":{");
+    for (channel = 0, first = 1; channel < COVERAGE_CHANNELS; channel ++) {
+        /* 只写出统计到像素的通道。 */
+        for (value = 0; value < 256 && coverage->histogram[channel][value] == 0; value ++);
+        if ( value == 256 ) {
+            continue;
+        }
+        fprintf(file, "%s\"%s\":[", first? "": ",", CoverageChannels[channel]);
+        first = 0;
+        for (value = 0; value < 256; value ++) {
+            fprintf(file, "%s%llu", value? ",": "", (unsigned long long) coverage->histogram[channel][value]);
+        }
+        fputc(']', file);
+    }
+    fputc('}', file);
+}
+
+/*
+ * coverage_json_open() - 创建覆盖率 JSON 文件，path 为 NULL 时不写。默认路径在
+ *                        /tmp 下，不跟随符号链接，以免写到别人放好的链接指向的文件。
+ */
+FILE *                                  /* 输出 - JSON 文件，失败时为 NULL */
+coverage_json_open(
+    const char          *path           /* 输入 - 文件路径 */
+) {
+    FILE                *file;
+    int                 fd;
+
+    if ( path == NULL || ! *path ) {
+        return NULL;
+    }
+    if (
+        ( fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644) ) < 0 ||
+        ( file = fdopen(fd, "w") ) == NULL
+    ) {
+        fprintf(stderr, "DEBUG: Unable to create coverage file \"%s\"\n", path);
+        if ( fd >= 0 ) {
+            close(fd);
+        }
+        return NULL;
+    }
+    fputs(CoverageJsonStart, file);
+
+    return file;
+}
+
+/*
+ * coverage_json_page() - 写出一页的统计。
+ */
+void
+coverage_json_page(
+    FILE                *file,          /* 输入 - JSON 文件 */
+    int                 page,           /* 输入 - 页号 */
+    const coverage_t    *coverage       /* 输入 - 这一页的统计 */
+) {
+    if ( file == NULL ) {
+        return;
+    }
+    fprintf(file, "%s\n{\"page\":%d,", ( ftell(file) > (long) sizeof(CoverageJsonStart) - 1 )? ",": "", page);
+    coverage_json_write(file, coverage);
+    fputc('}', file);
+}
+
+/*
+ * coverage_json_close() - 写出整个任务的统计并关闭文件。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+coverage_json_close(
+    FILE                *file,          /* 输入 - JSON 文件 */
+    const coverage_t    *job            /* 输入 - 整个任务的统计 */
+) {
+    if ( file == NULL ) {
+        return 1;
+    }
+    fprintf(file, "\n],\"job\":{");
+    coverage_json_write(file, job);
+    fprintf(file, "}}\n");
+
+    return ( fclose(file) == 0 );
+}
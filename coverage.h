@@ -0,0 +1,56 @@
+/*
+ * coverage.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_COVERAGE_H
+#define __LEISRASTERFILTER_COVERAGE_H
+
+#include <stdio.h>
+#include "bitmap.h"
+
+#define COVERAGE_ENV        "LEISRASTERFILTER_COVERAGE" /* 墨水覆盖率 JSON 文件的路径 */
+#define COVERAGE_CHANNELS   4       /* 直方图的通道数：红、绿、蓝、灰 */
+
+/*
+ * 墨水（碳粉）覆盖率统计。按转换后的像素逐通道统计 256 级的直方图，覆盖率由
+ * 直方图算出：红、绿、蓝分别对应青、品红、黄，灰度页面的灰对应黑色。彩色页面
+ * 和灰度页面的统计可以合并成整个任务的统计。
+ */
+typedef struct {
+    unsigned            channels;       /* 统计的像素的通道数，彩色为 3，灰度为 1 */
+    uint64_t            pixels;         /* 像素数 */
+    uint64_t            histogram[COVERAGE_CHANNELS][256];  /* 红、绿、蓝、灰每个值的像素数 */
+} coverage_t;
+
+extern void coverage_reset(coverage_t *coverage, unsigned channels);
+extern void coverage_add(coverage_t *coverage, const uint8_t *pixels, size_t count);
+extern void coverage_merge(coverage_t *dest, const coverage_t *src);
+extern void coverage_ink(const coverage_t *coverage, double ink[4]);
+extern void coverage_report(const char *name, const coverage_t *coverage);
+extern FILE *coverage_json_open(const char *path);
+extern void coverage_json_page(FILE *file, int page, const coverage_t *coverage);
+extern int coverage_json_close(FILE *file, const coverage_t *job);
+
+#endif
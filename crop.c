@@ -0,0 +1,283 @@
+/*
+ * crop.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 自动裁剪。页面往往有大片白色的边距，整页输出时文件大、写得慢。转换时逐行
+ * 更新内容的边界：找到内容之后，每行只需扫描当前边界以外的部分（SSE2 下一次
+ * 比较 16 个字节）看边界是否要扩大，边界以内遇到第一个不是白色的字节就停止。
+ * 页面转换完后把边界内的行原地移到缓冲的开头，只输出这个矩形，并把它在页面
+ * 中的位置记进 JSON 文件。
+ */
+
+#include "crop.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const char CropJsonStart[] = "{\"pages\":[";
+
+/*
+ * crop_first_ink() - 第一个不是白色（0xff）的字节的位置。
+ */
+static size_t                           /* 输出 - 位置，全为白色时为 size */
+crop_first_ink(
+    const uint8_t       *p,             /* 输入 - 数据 */
+    size_t              size            /* 输入 - 字节数 */
+) {
+    size_t              index = 0;
+#ifdef __SSE2__
+    const __m128i       white = _mm_set1_epi8((char) 0xff);
+    unsigned            mask;
+
+    for ( ; index + 16 <= size; index += 16) {
+        mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) ( p + index )), white));
+        if ( mask != 0xffff ) {
+            return index + __builtin_ctz(~mask & 0xffff);
+        }
+    }
+#endif
+    for ( ; index < size; index ++) {
+        if ( p[index] != 0xff ) {
+            return index;
+        }
+    }
+
+    return size;
+}
+
+/*
+ * crop_last_ink() - 最后一个不是白色的字节之后的位置。
+ */
+static size_t                           /* 输出 - 位置，全为白色时为 0 */
+crop_last_ink(
+    const uint8_t       *p,             /* 输入 - 数据 */
+    size_t              size            /* 输入 - 字节数 */
+) {
+    size_t              index = size;
+#ifdef __SSE2__
+    const __m128i       white = _mm_set1_epi8((char) 0xff);
+    unsigned            mask;
+
+    for ( ; index >= 16; index -= 16) {
+        mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) ( p + index - 16 )), white));
+        if ( mask != 0xffff ) {
+            return index - 16 + ( 32 - __builtin_clz(~mask & 0xffff) );
+        }
+    }
+#endif
+    for ( ; index > 0; index --) {
+        if ( p[index - 1] != 0xff ) {
+            return index;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * crop_reset() - 开始新的一页。
+ */
+void
+crop_reset(
+    crop_t              *crop,          /* 输出 - 边界 */
+    unsigned            width,          /* 输入 - 页面宽度 */
+    unsigned            height,         /* 输入 - 页面高度 */
+    unsigned            pixel_size      /* 输入 - 每个像素的字节数 */
+) {
+    memset(crop, 0, sizeof(crop_t));
+    crop->width = width;
+    crop->height = height;
+    crop->pixel_size = pixel_size;
+}
+
+/*
+ * crop_rows() - 用接下来的几行像素更新内容的边界。
+ */
+void
+crop_rows(
+    crop_t              *crop,          /* 输入/输出 - 边界 */
+    const uint8_t       *rows,          /* 输入 - 像素行 */
+    unsigned            count           /* 输入 - 行数 */
+) {
+    const size_t        ps = crop->pixel_size,
+                        stride = (size_t) crop->width * ps;
+    const uint8_t       *row;
+    size_t              first,
+                        last,
+                        inside;
+    unsigned            index;
+    int                 ink;
+
+    for (index = 0; index < count; index ++, crop->next_row ++) {
+        row = rows + index * stride;
+        if ( ! crop->found ) {
+            /* 还没有内容：扫描整行。 */
+            if ( ( first = crop_first_ink(row, stride) ) == stride ) {
+                continue;
+            }
+            last = crop_last_ink(row + first, stride - first) + first;
+            crop->found = 1;
+            crop->left = first / ps;
+            crop->right = ( last - 1 ) / ps;
+            crop->top = crop->bottom = crop->next_row;
+            continue;
+        }
+
+        /* 只扫描边界左右两边，看边界是否要扩大。 */
+        ink = 0;
+        if ( ( first = crop_first_ink(row, crop->left * ps) ) < crop->left * ps ) {
+            crop->left = first / ps;
+            ink = 1;
+        }
+        inside = ( crop->right + 1 ) * ps;
+        if ( ( last = crop_last_ink(row + inside, stride - inside) ) > 0 ) {
+            crop->right = ( inside + last - 1 ) / ps;
+            ink = 1;
+        }
+        if ( ! ink ) {
+            /* 边界以内找到一个不是白色的字节就够了。 */
+            inside = ( crop->right + 1 - crop->left ) * ps;
+            ink = ( crop_first_ink(row + crop->left * ps, inside) < inside );
+        }
+        if ( ink ) {
+            crop->bottom = crop->next_row;
+        }
+    }
+}
+
+/*
+ * crop_page() - 把边界内的像素原地移到缓冲的开头。全为白色的页面裁成左上角
+ *               的一个像素。
+ */
+int                                     /* 输出 - 1 裁剪了，0 内容占满整页 */
+crop_page(
+    crop_t              *crop,          /* 输入 - 边界 */
+    void                *pixels,        /* 输入/输出 - 像素阵 */
+    unsigned            *x,             /* 输出 - 矩形左上角的列 */
+    unsigned            *y,             /* 输出 - 矩形左上角的行 */
+    unsigned            *width,         /* 输出 - 矩形的宽度 */
+    unsigned            *height         /* 输出 - 矩形的高度 */
+) {
+    const size_t        ps = crop->pixel_size,
+                        stride = (size_t) crop->width * ps;
+    size_t              length;
+    unsigned            row;
+
+    if ( ! crop->found ) {
+        crop->left = crop->right = crop->top = crop->bottom = 0;
+    }
+    *x = crop->left;
+    *y = crop->top;
+    *width = crop->right + 1 - crop->left;
+    *height = crop->bottom + 1 - crop->top;
+    if ( *width == crop->width && *height == crop->height ) {
+        return 0;
+    }
+
+    length = (size_t) *width * ps;
+    for (row = 0; row < *height; row ++) {
+        memmove(
+            (uint8_t *) pixels + row * length,
+            (uint8_t *) pixels + ( crop->top + row ) * stride + crop->left * ps,
+            length
+        );
+    }
+
+    return 1;
+}
+
+/*
+ * crop_json_open() - 创建裁剪位置 JSON 文件，path 为 NULL 时不写。和覆盖率 JSON
+ *                    一样不跟随符号链接。
+ */
+FILE *                                  /* 输出 - JSON 文件，失败时为 NULL */
+crop_json_open(
+    const char          *path           /* 输入 - 文件路径 */
+) {
+    FILE                *file;
+    int                 fd;
+
+    if ( path == NULL || ! *path ) {
+        return NULL;
+    }
+    if (
+        ( fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644) ) < 0 ||
+        ( file = fdopen(fd, "w") ) == NULL
+    ) {
+        fprintf(stderr, "DEBUG: Unable to create crop file \"%s\"\n", path);
+        if ( fd >= 0 ) {
+            close(fd);
+        }
+        return NULL;
+    }
+    fputs(CropJsonStart, file);
+
+    return file;
+}
+
+/*
+ * crop_json_page() - 记下一页输出的矩形在页面中的位置（从左上角算起）。
+ */
+void
+crop_json_page(
+    FILE                *file,          /* 输入 - JSON 文件 */
+    int                 page,           /* 输入 - 页号 */
+    const char          *name,          /* 输入 - 输出文件名，可以为 NULL */
+    unsigned            x,              /* 输入 - 矩形左上角的列 */
+    unsigned            y,              /* 输入 - 矩形左上角的行 */
+    unsigned            width,          /* 输入 - 矩形的宽度 */
+    unsigned            height,         /* 输入 - 矩形的高度 */
+    unsigned            page_width,     /* 输入 - 页面宽度 */
+    unsigned            page_height     /* 输入 - 页面高度 */
+) {
+    if ( file == NULL ) {
+        return;
+    }
+    fprintf(file, "%s\n  {\"page\": %d, ", ( ftell(file) > (long) sizeof(CropJsonStart) - 1 )? ",": "", page);
+    if ( name != NULL ) {
+        fprintf(file, "\"file\": \"%s\", ", name);
+    }
+    fprintf(file, "\"x\": %u, \"y\": %u, \"width\": %u, \"height\": %u, \"page_width\": %u, \"page_height\": %u}",
+        x, y, width, height, page_width, page_height);
+}
+
+/*
+ * crop_json_close() - 写完并关闭文件。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+crop_json_close(
+    FILE                *file           /* 输入 - JSON 文件 */
+) {
+    if ( file == NULL ) {
+        return 1;
+    }
+    fputs("\n]}\n", file);
+
+    return ( fclose(file) == 0 );
+}
@@ -0,0 +1,58 @@
+/*
+ * crop.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_CROP_H
+#define __LEISRASTERFILTER_CROP_H
+
+#include <stdio.h>
+#include "bitmap.h"
+
+#define CROP_ENV        "LEISRASTERFILTER_CROP"     /* 裁剪位置 JSON 文件的路径 */
+
+/*
+ * 页面内容的边界。转换时逐行找出不是白色的第一列和最后一列，以及第一行和
+ * 最后一行，页面转换完就能只输出这个矩形。
+ */
+typedef struct {
+    unsigned            width,          /* 页面宽度 */
+                        height,         /* 页面高度 */
+                        pixel_size;     /* 每个像素的字节数 */
+    unsigned            next_row;       /* 下一行的行号 */
+    int                 found;          /* 找到不是白色的像素后为 1 */
+    unsigned            left,           /* 内容的第一列 */
+                        right,          /* 内容的最后一列 */
+                        top,            /* 内容的第一行 */
+                        bottom;         /* 内容的最后一行 */
+} crop_t;
+
+extern void crop_reset(crop_t *crop, unsigned width, unsigned height, unsigned pixel_size);
+extern void crop_rows(crop_t *crop, const uint8_t *rows, unsigned count);
+extern int crop_page(crop_t *crop, void *pixels, unsigned *x, unsigned *y, unsigned *width, unsigned *height);
+extern FILE *crop_json_open(const char *path);
+extern void crop_json_page(FILE *file, int page, const char *name, unsigned x, unsigned y, unsigned width, unsigned height, unsigned page_width, unsigned page_height);
+extern int crop_json_close(FILE *file);
+
+#endif
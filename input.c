@@ -0,0 +1,413 @@
+/*
+ * input.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * raster 输入层。CUPS 的过滤器之间用管道相连，默认 64 KB 的管道容量让上游和本过滤器
+ * 频繁地互相切换。这里先把输入管道调大，再用一个线程把原始字节预读进环形缓冲；
+ * 解码一侧的读回调只要缓冲里有数据就马上返回，只有缓冲为空时才等待。
+ */
+
+#define _GNU_SOURCE
+
+#include "input.h"
+#include "bitmap.h"
+#include "trace.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+/*
+ * input_thread() - 预读线程：有空间就 read()，直到输入结束、出错或被要求停止。
+ */
+static void *
+input_thread(
+    void                *ctx            /* 输入 - 输入流 */
+) {
+    input_stream_t      *in = (input_stream_t *) ctx;
+    struct pollfd       fds[2];
+    size_t              offset, space;
+    ssize_t             bytes;
+
+    fds[0].fd = in->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = in->wake_fd;
+    fds[1].events = POLLIN;
+
+    for ( ; ; ) {
+        /* 等待空间，只取环形缓冲中连续的一段。 */
+        pthread_mutex_lock(&(in->lock));
+        while ( ! in->stop && in->tail - in->head == in->size ) {
+            in->writer_waiting = 1;
+            pthread_cond_wait(&(in->not_full), &(in->lock));
+        }
+        in->writer_waiting = 0;
+        if ( in->stop ) {
+            pthread_mutex_unlock(&(in->lock));
+            break;
+        }
+        offset = in->tail % in->size;
+        space = in->size - ( in->tail - in->head );
+        if ( in->skip > 0 && in->seekable && lseek(in->fd, (off_t) in->skip, SEEK_CUR) >= 0 ) {
+            /* 缓冲中的数据已经丢完，剩下要跳过的部分直接 lseek()。 */
+            in->skipped += in->skip;
+            in->skip = 0;
+        }
+        pthread_mutex_unlock(&(in->lock));
+
+        if ( space > in->size - offset ) {
+            space = in->size - offset;
+        }
+        if ( space > INPUT_CHUNK_SIZE ) {
+            space = INPUT_CHUNK_SIZE;
+        }
+
+        /* 阻塞在管道上时也要能被 input_close() 叫醒。 */
+        if ( poll(fds, 2, -1) < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            bytes = -1;
+        } else if ( fds[1].revents & POLLIN ) {
+            break;
+        } else {
+            TRACE_BEGIN("read input", space);
+            bytes = read(in->fd, in->ring + offset, space);
+            TRACE_END("read input");
+            if ( bytes < 0 && ( errno == EINTR || errno == EAGAIN ) ) {
+                continue;
+            }
+        }
+
+        pthread_mutex_lock(&(in->lock));
+        in->reads ++;
+        if ( bytes > 0 ) {
+            in->tail += bytes;
+            if ( in->skip > 0 ) {
+                /* 不能 lseek() 时读进来再丢掉。 */
+                space = ( in->skip < (unsigned long long) bytes )? (size_t) in->skip: (size_t) bytes;
+                in->skip -= space;
+                in->skipped += space;
+                in->head += space;
+            }
+        } else {
+            in->eof = 1;
+            in->error = ( bytes < 0 )? errno: 0;
+        }
+        if ( in->reader_waiting ) {
+            pthread_cond_signal(&(in->not_empty));
+        }
+        pthread_mutex_unlock(&(in->lock));
+
+        if ( bytes <= 0 ) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * input_note_sync() - 记下流开头的同步字，用来判断流是否压缩。
+ */
+static void
+input_note_sync(
+    input_stream_t      *in,            /* 输入 - 输入流 */
+    const unsigned char *buffer,        /* 输入 - 刚取出的数据 */
+    size_t              length          /* 输入 - 数据的长度 */
+) {
+    while ( in->sync_bytes < sizeof(in->sync) && length > 0 ) {
+        in->sync[in->sync_bytes ++] = *buffer ++;
+        length --;
+    }
+}
+
+/*
+ * input_open() - 打开输入流。输入是管道时先调大管道容量；readahead 为 1 时启动
+ *                预读线程，否则 input_read() 直接 read()。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+input_open(
+    input_stream_t      *in,            /* 输入 - 输入流 */
+    int                 fd,             /* 输入 - raster 数据的文件描述符 */
+    int                 readahead       /* 输入 - 是否启用预读线程 */
+) {
+    struct stat         st;
+    sigset_t            all_signals,
+                        old_signals;
+    int                 pipe_size = 0,
+                        result;
+
+    memset(in, 0, sizeof(input_stream_t));
+    in->fd = fd;
+    in->wake_fd = -1;
+    if ( fstat(fd, &st) != 0 ) {
+        st.st_mode = 0;
+    }
+    in->seekable = ( S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_CUR) >= 0 );
+
+#ifdef F_SETPIPE_SZ
+    if ( S_ISFIFO(st.st_mode) ) {
+        /* 调大管道容量，失败时沿用原来的大小。 */
+        fcntl(fd, F_SETPIPE_SZ, INPUT_PIPE_SIZE);
+        pipe_size = fcntl(fd, F_GETPIPE_SZ);
+    }
+#endif
+
+    if ( ! readahead ) {
+        return FUNCTION_SUCCESS;
+    }
+
+    in->size = INPUT_RING_SIZE;
+    if ( ( in->ring = (uint8_t *) malloc(in->size) ) == NULL ) {
+        log_error("Error", "Unable to allocate input ring buffer!");
+        return FUNCTION_FAILURE;
+    }
+    if ( ( in->wake_fd = eventfd(0, EFD_CLOEXEC) ) < 0 ) {
+        free(in->ring);
+        in->ring = NULL;
+        log_debug("Info", "eventfd() failed, reading input without readahead.");
+        return FUNCTION_SUCCESS;
+    }
+
+    pthread_mutex_init(&(in->lock), NULL);
+    pthread_cond_init(&(in->not_empty), NULL);
+    pthread_cond_init(&(in->not_full), NULL);
+
+    /* 信号（如 SIGTERM）只交给主线程处理。 */
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+    result = pthread_create(&(in->thread), NULL, input_thread, in);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if ( result != 0 ) {
+        log_debug("Info", "Unable to start readahead thread, reading input directly.");
+        pthread_mutex_destroy(&(in->lock));
+        pthread_cond_destroy(&(in->not_empty));
+        pthread_cond_destroy(&(in->not_full));
+        close(in->wake_fd);
+        in->wake_fd = -1;
+        free(in->ring);
+        in->ring = NULL;
+        return FUNCTION_SUCCESS;
+    }
+    in->threaded = 1;
+
+    fprintf(stderr, "DEBUG: Raster input readahead of %zu bytes, pipe size %d\n", in->size, pipe_size);
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * input_read() - cupsRasterOpenIO() 的读回调。缓冲中有数据时立即返回已有的部分，
+ *                不会为了凑满 length 而等待。
+ */
+ssize_t                                 /* 输出 - 读到的字节数，0 为结束，-1 为出错 */
+input_read(
+    void                *ctx,           /* 输入 - 输入流 */
+    unsigned char       *buffer,        /* 输入 - 目标缓冲 */
+    size_t              length          /* 输入 - 最多读入的字节数 */
+) {
+    input_stream_t      *in = (input_stream_t *) ctx;
+    size_t              available, offset, first;
+    ssize_t             bytes;
+
+    if ( ! in->threaded ) {
+        do {
+            bytes = read(in->fd, buffer, length);
+        } while ( bytes < 0 && ( errno == EINTR || errno == EAGAIN ) );
+        if ( bytes > 0 ) {
+            input_note_sync(in, buffer, (size_t) bytes);
+        }
+        return bytes;
+    }
+
+    pthread_mutex_lock(&(in->lock));
+    while ( in->tail == in->head && ! in->eof ) {
+        in->stalls ++;
+        in->reader_waiting = 1;
+        TRACE_BEGIN("wait input", length);
+        pthread_cond_wait(&(in->not_empty), &(in->lock));
+        TRACE_END("wait input");
+    }
+    in->reader_waiting = 0;
+
+    available = (size_t) ( in->tail - in->head );
+    if ( available == 0 ) {
+        /* 已经结束且缓冲已空。 */
+        pthread_mutex_unlock(&(in->lock));
+        if ( in->error != 0 ) {
+            errno = in->error;
+            return -1;
+        }
+        return 0;
+    }
+    offset = in->head % in->size;
+    pthread_mutex_unlock(&(in->lock));
+
+    /* 预读线程只会往 tail 之后写，这一段可以不持锁拷贝。 */
+    if ( length > available ) {
+        length = available;
+    }
+    first = in->size - offset;
+    if ( first > length ) {
+        first = length;
+    }
+    memcpy(buffer, in->ring + offset, first);
+    memcpy(buffer + first, in->ring, length - first);
+    input_note_sync(in, buffer, length);
+
+    pthread_mutex_lock(&(in->lock));
+    in->head += length;
+    /* 腾出一整块空间再叫醒预读线程，减少来回切换。 */
+    if ( in->writer_waiting && in->size - ( in->tail - in->head ) >= INPUT_CHUNK_SIZE ) {
+        pthread_cond_signal(&(in->not_full));
+    }
+    pthread_mutex_unlock(&(in->lock));
+
+    return (ssize_t) length;
+}
+
+/*
+ * input_raster_open() - 在输入流上打开 raster 流。
+ */
+cups_raster_t *                         /* 输出 - raster 流 */
+input_raster_open(
+    input_stream_t      *in             /* 输入 - 输入流 */
+) {
+    return cupsRasterOpenIO(input_read, in, CUPS_RASTER_READ);
+}
+
+/*
+ * input_uncompressed() - raster 流是否为不压缩的 v1/v3 流（任一字节序）。libcups 读
+ *                        不压缩的流时不做缓冲，页面的像素数据可以在输入层直接跳过。
+ */
+int                                     /* 输出 - 1 不压缩，0 压缩或未知 */
+input_uncompressed(
+    const input_stream_t    *in         /* 输入 - 输入流 */
+) {
+    uint32_t            sync;
+
+    if ( in->sync_bytes < sizeof(in->sync) ) {
+        return 0;
+    }
+    memcpy(&sync, in->sync, sizeof(sync));
+
+    return sync == CUPS_RASTER_SYNC || sync == CUPS_RASTER_REVSYNC
+        || sync == CUPS_RASTER_SYNCv1 || sync == CUPS_RASTER_REVSYNCv1;
+}
+
+/*
+ * input_skip() - 跳过 length 个字节。先丢弃缓冲中已有的数据，输入可以 lseek()
+ *                时其余部分直接 lseek()，否则读进来丢掉。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+input_skip(
+    input_stream_t      *in,            /* 输入 - 输入流 */
+    unsigned long long  length          /* 输入 - 要跳过的字节数 */
+) {
+    unsigned char       scratch[16384];
+    unsigned long long  available;
+    ssize_t             bytes;
+
+    if ( in->threaded ) {
+        /* 由预读线程丢弃或 lseek()，这里不等待。 */
+        pthread_mutex_lock(&(in->lock));
+        available = in->tail - in->head;
+        if ( length <= available ) {
+            in->head += length;
+            in->skipped += length;
+        } else {
+            in->head = in->tail;
+            in->skipped += available;
+            in->skip += length - available;
+        }
+        if ( in->writer_waiting ) {
+            pthread_cond_signal(&(in->not_full));
+        }
+        pthread_mutex_unlock(&(in->lock));
+        return FUNCTION_SUCCESS;
+    }
+
+    if ( in->seekable && lseek(in->fd, (off_t) length, SEEK_CUR) >= 0 ) {
+        in->skipped += length;
+        return FUNCTION_SUCCESS;
+    }
+    while ( length > 0 ) {
+        bytes = read(in->fd, scratch, ( length < sizeof(scratch) )? (size_t) length: sizeof(scratch));
+        if ( bytes < 0 && ( errno == EINTR || errno == EAGAIN ) ) {
+            continue;
+        }
+        if ( bytes <= 0 ) {
+            return FUNCTION_FAILURE;
+        }
+        length -= (unsigned long long) bytes;
+        in->skipped += (unsigned long long) bytes;
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * input_close() - 停止预读线程并释放环形缓冲。不关闭 raster 的文件描述符。
+ */
+void
+input_close(
+    input_stream_t      *in             /* 输入 - 输入流 */
+) {
+    uint64_t            one = 1;
+
+    if ( in->threaded ) {
+        pthread_mutex_lock(&(in->lock));
+        in->stop = 1;
+        pthread_cond_signal(&(in->not_full));
+        pthread_mutex_unlock(&(in->lock));
+        if ( write(in->wake_fd, &one, sizeof(one)) != sizeof(one) ) {
+            log_debug("Info", "Unable to wake readahead thread.");
+        }
+        pthread_join(in->thread, NULL);
+
+        fprintf(stderr, "DEBUG: Raster input %llu bytes in %llu reads, decoder waited %llu times\n",
+            in->tail, in->reads, in->stalls);
+
+        pthread_mutex_destroy(&(in->lock));
+        pthread_cond_destroy(&(in->not_empty));
+        pthread_cond_destroy(&(in->not_full));
+        in->threaded = 0;
+    }
+    if ( in->skipped > 0 ) {
+        fprintf(stderr, "DEBUG: Skipped %llu bytes of raster input\n", in->skipped);
+    }
+
+    if ( in->wake_fd >= 0 ) {
+        close(in->wake_fd);
+        in->wake_fd = -1;
+    }
+    free(in->ring);
+    in->ring = NULL;
+}
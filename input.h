@@ -0,0 +1,77 @@
+/*
+ * input.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_INPUT_H
+#define __LEISRASTERFILTER_INPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <cups/raster.h>
+
+#define INPUT_RING_SIZE         ( 4 * 1024 * 1024 ) /* 预读环形缓冲的大小 */
+#define INPUT_CHUNK_SIZE        ( 256 * 1024 )      /* 预读线程每次 read() 的最大长度 */
+#define INPUT_PIPE_SIZE         ( 1024 * 1024 )     /* 希望把输入管道容量调到的大小 */
+
+/*
+ * 输入流。输入线程把 raster 原始字节预读进环形缓冲，libcups 通过
+ * cupsRasterOpenIO() 的回调从环形缓冲中取数据。
+ */
+typedef struct {
+    int                 fd;             /* raster 数据的文件描述符 */
+    int                 seekable;       /* 输入是普通文件，可以 lseek() */
+    int                 wake_fd;        /* 用于让预读线程提前结束的 eventfd */
+    int                 threaded;       /* 是否启用了预读线程 */
+    uint8_t             *ring;          /* 环形缓冲 */
+    size_t              size;           /* 环形缓冲的大小 */
+    unsigned long long  head,           /* 累计取出的字节数 */
+                        tail,           /* 累计读入的字节数 */
+                        skip,           /* 还要丢弃的字节数（预读线程负责） */
+                        skipped;        /* 累计跳过的字节数 */
+    uint8_t             sync[4];        /* raster 流开头的同步字 */
+    unsigned            sync_bytes;     /* 已经取到的同步字字节数 */
+    int                 eof,            /* 输入已经结束 */
+                        error,          /* 读入出错时的 errno */
+                        stop,           /* 要求预读线程结束 */
+                        reader_waiting, /* 解码一侧在等数据 */
+                        writer_waiting; /* 预读线程在等空间 */
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      not_empty,
+                        not_full;
+    unsigned long long  reads,          /* 预读线程的 read() 次数 */
+                        stalls;         /* 解码一侧因为缓冲为空而等待的次数 */
+} input_stream_t;
+
+extern int input_open(input_stream_t *in, int fd, int readahead);
+extern ssize_t input_read(void *ctx, unsigned char *buffer, size_t length);
+extern cups_raster_t *input_raster_open(input_stream_t *in);
+extern int input_uncompressed(const input_stream_t *in);
+extern int input_skip(input_stream_t *in, unsigned long long length);
+extern void input_close(input_stream_t *in);
+
+#endif
@@ -0,0 +1,485 @@
+/*
+ * linecodec.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * rastertosample 设备流的行压缩：PackBits（PCL 方式 2）与相对上一行的
+ * delta row（PCL 方式 3）。每行取两种编码和原始数据中最短的一种。
+ *
+ * delta row 的命令字节：高 3 位为替换字节数减 1（1 到 8 个），低 5 位为相对当前
+ * 位置的偏移；偏移为 31 时后面还有偏移字节，逐个累加，直到某个字节小于 255。
+ * 命令字节后面紧跟替换字节，当前位置移到替换字节之后。解码端以上一行为种子，
+ * 没有被替换的字节保持不变。每页开始时种子行清零。
+ */
+
+#include "linecodec.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * linecodec_init() - 为每行 width 个字节的数据准备编码器。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+linecodec_init(
+    linecodec_t         *codec,         /* 输入 - 编码器 */
+    size_t              width           /* 输入 - 每行字节数 */
+) {
+    memset(codec, 0, sizeof(linecodec_t));
+    codec->width = width;
+    codec->seed = (uint8_t *) calloc(1, width + 1);
+    codec->packbits = (uint8_t *) malloc(LINECODEC_BOUND(width));
+    codec->delta = (uint8_t *) malloc(LINECODEC_BOUND(width));
+
+    if ( codec->seed == NULL || codec->packbits == NULL || codec->delta == NULL ) {
+        linecodec_free(codec);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * linecodec_reset() - 新的一页开始，种子行清零。
+ */
+void
+linecodec_reset(
+    linecodec_t         *codec          /* 输入 - 编码器 */
+) {
+    memset(codec->seed, 0, codec->width);
+}
+
+/*
+ * linecodec_diff() - 找出两段数据中第一个不同的字节，每次比较 16 个字节。
+ */
+size_t                                  /* 输出 - 第一个不同字节的位置，全部相同时为 n */
+linecodec_diff(
+    const uint8_t       *a,             /* 输入 - 数据 1 */
+    const uint8_t       *b,             /* 输入 - 数据 2 */
+    size_t              n               /* 输入 - 字节数 */
+) {
+    size_t              index = 0;
+#ifdef __SSE2__
+    unsigned            mask;
+
+    for ( ; index + 16 <= n; index += 16 ) {
+        mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *) ( a + index )),
+            _mm_loadu_si128((const __m128i *) ( b + index ))
+        )) ^ 0xffff;
+        if ( mask != 0 ) {
+            return index + __builtin_ctz(mask);
+        }
+    }
+#else
+    uint64_t            wa, wb;
+
+    for ( ; index + 8 <= n; index += 8 ) {
+        memcpy(&wa, a + index, 8);
+        memcpy(&wb, b + index, 8);
+        if ( wa != wb ) {
+            break;
+        }
+    }
+#endif
+
+    for ( ; index < n && a[index] == b[index]; index ++ );
+
+    return index;
+}
+
+/*
+ * linecodec_is_uniform() - 判断一行是否全部为同一个值（如空白行），每次比较 16 个字节。
+ */
+int                                     /* 输出 - 1 是，0 否 */
+linecodec_is_uniform(
+    const uint8_t       *row,           /* 输入 - 数据 */
+    size_t              n,              /* 输入 - 字节数 */
+    uint8_t             value           /* 输入 - 值 */
+) {
+    size_t              index = 0;
+#ifdef __SSE2__
+    const __m128i       fill = _mm_set1_epi8((char) value);
+
+    for ( ; index + 16 <= n; index += 16 ) {
+        if ( _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) ( row + index )), fill)) != 0xffff ) {
+            return 0;
+        }
+    }
+#else
+    const uint64_t      fill = 0x0101010101010101ULL * value;
+    uint64_t            word;
+
+    for ( ; index + 8 <= n; index += 8 ) {
+        memcpy(&word, row + index, 8);
+        if ( word != fill ) {
+            return 0;
+        }
+    }
+#endif
+
+    for ( ; index < n; index ++ ) {
+        if ( row[index] != value ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * linecodec_packbits() - PackBits 编码。3 个及以上相同的字节编为重复段，其余编为
+ *                        字面段，每段最多 128 个字节。
+ */
+size_t                                  /* 输出 - 编码后的字节数 */
+linecodec_packbits(
+    const uint8_t       *src,           /* 输入 - 原始数据 */
+    size_t              n,              /* 输入 - 原始字节数 */
+    uint8_t             *dst            /* 输入 - 输出缓冲，至少 LINECODEC_BOUND(n) 个字节 */
+) {
+    uint8_t             *out = dst;
+    size_t              index = 0,
+                        literal = 0,    /* 字面段的起点 */
+                        run;
+
+    while ( index < n ) {
+        /* 量出从 index 开始的重复长度。 */
+        for ( run = 1; index + run < n && run < 128 && src[index + run] == src[index]; run ++ );
+
+        if ( run >= 3 ) {
+            /* 先把之前的字面段写出。 */
+            while ( literal < index ) {
+                size_t count = index - literal;
+                if ( count > 128 ) {
+                    count = 128;
+                }
+                *out ++ = (uint8_t) ( count - 1 );
+                memcpy(out, src + literal, count);
+                out += count;
+                literal += count;
+            }
+
+            *out ++ = (uint8_t) ( 257 - run );
+            *out ++ = src[index];
+            index += run;
+            literal = index;
+        } else {
+            index += run;
+        }
+    }
+
+    while ( literal < n ) {
+        size_t count = n - literal;
+        if ( count > 128 ) {
+            count = 128;
+        }
+        *out ++ = (uint8_t) ( count - 1 );
+        memcpy(out, src + literal, count);
+        out += count;
+        literal += count;
+    }
+
+    return (size_t) ( out - dst );
+}
+
+/*
+ * linecodec_delta() - 相对种子行做 delta row 编码。
+ */
+size_t                                  /* 输出 - 编码后的字节数 */
+linecodec_delta(
+    const uint8_t       *row,           /* 输入 - 当前行 */
+    const uint8_t       *seed,          /* 输入 - 种子行 */
+    size_t              n,              /* 输入 - 每行字节数 */
+    uint8_t             *dst            /* 输入 - 输出缓冲，至少 LINECODEC_BOUND(n) 个字节 */
+) {
+    uint8_t             *out = dst;
+    size_t              position = 0,   /* 解码端的当前位置 */
+                        start, end, offset;
+
+    for ( ; ; ) {
+        start = position + linecodec_diff(row + position, seed + position, n - position);
+        if ( start >= n ) {
+            break;
+        }
+
+        /* 最多 8 个连续不同的字节。 */
+        for ( end = start + 1; end < n && end - start < 8 && row[end] != seed[end]; end ++ );
+
+        offset = start - position;
+        if ( offset < 31 ) {
+            *out ++ = (uint8_t) ( ( ( end - start - 1 ) << 5 ) | offset );
+        } else {
+            *out ++ = (uint8_t) ( ( ( end - start - 1 ) << 5 ) | 31 );
+            for ( offset -= 31; offset >= 255; offset -= 255 ) {
+                *out ++ = 255;
+            }
+            *out ++ = (uint8_t) offset;
+        }
+
+        memcpy(out, row + start, end - start);
+        out += end - start;
+        position = end;
+    }
+
+    return (size_t) ( out - dst );
+}
+
+/*
+ * linecodec_encode() - 编码一行，取原始数据、PackBits、delta row 中最短的一种，
+ *                      并把这一行作为下一行的种子。
+ */
+linecodec_method_t                      /* 输出 - 选用的压缩方式 */
+linecodec_encode(
+    linecodec_t         *codec,         /* 输入 - 编码器 */
+    const uint8_t       *row,           /* 输入 - 当前行 */
+    const uint8_t       **data,         /* 输出 - 编码后的数据 */
+    size_t              *length         /* 输出 - 编码后的字节数 */
+) {
+    const size_t        width = codec->width;
+    size_t              delta_length,
+                        packbits_length;
+    linecodec_method_t  method = LINECODEC_RAW;
+
+    *data = row;
+    *length = width;
+
+    delta_length = linecodec_delta(row, codec->seed, width, codec->delta);
+    if ( delta_length < *length ) {
+        method = LINECODEC_DELTA;
+        *data = codec->delta;
+        *length = delta_length;
+    }
+
+    /* 和上一行几乎相同时 delta row 一定更短，不必再试 PackBits。 */
+    if ( *length > 2 ) {
+        packbits_length = linecodec_packbits(row, width, codec->packbits);
+        if ( packbits_length < *length ) {
+            method = LINECODEC_PACKBITS;
+            *data = codec->packbits;
+            *length = packbits_length;
+        }
+    }
+
+    memcpy(codec->seed, row, width);
+
+    codec->bytes_in += width;
+    codec->bytes_out += *length;
+    codec->rows[method] ++;
+
+    return method;
+}
+
+/*
+ * linecodec_set_seed() - 直接设置种子行，用于解码端的上一行不是由
+ *                        linecodec_encode() 发出的情况（如跳过的空白行）。
+ */
+void
+linecodec_set_seed(
+    linecodec_t         *codec,         /* 输入 - 编码器 */
+    const uint8_t       *row            /* 输入 - 新的种子行 */
+) {
+    memcpy(codec->seed, row, codec->width);
+}
+
+/*
+ * linecodec_decode() - 解码一行。row 中原有的内容为种子行（上一行）。
+ */
+int                                     /* 输出 - 1 成功，0 数据有误 */
+linecodec_decode(
+    linecodec_method_t  method,         /* 输入 - 压缩方式 */
+    const uint8_t       *data,          /* 输入 - 编码后的数据 */
+    size_t              length,         /* 输入 - 编码后的字节数 */
+    uint8_t             *row,           /* 输入/输出 - 种子行 / 解码后的行 */
+    size_t              width           /* 输入 - 每行字节数 */
+) {
+    size_t              in = 0,
+                        out = 0,
+                        count,
+                        offset;
+    uint8_t             header;
+
+    switch ( method ) {
+        case LINECODEC_RAW :
+            if ( length != width ) {
+                return 0;
+            }
+            memcpy(row, data, width);
+            return 1;
+
+        case LINECODEC_PACKBITS :
+            while ( in < length ) {
+                header = data[in ++];
+                if ( header < 128 ) {
+                    count = header + 1;
+                    if ( in + count > length || out + count > width ) {
+                        return 0;
+                    }
+                    memcpy(row + out, data + in, count);
+                    in += count;
+                } else if ( header > 128 ) {
+                    count = 257 - header;
+                    if ( in >= length || out + count > width ) {
+                        return 0;
+                    }
+                    memset(row + out, data[in ++], count);
+                } else {
+                    continue;
+                }
+                out += count;
+            }
+            return ( out == width );
+
+        case LINECODEC_DELTA :
+            while ( in < length ) {
+                count = ( data[in] >> 5 ) + 1;
+                offset = data[in ++] & 31;
+                if ( offset == 31 ) {
+                    do {
+                        if ( in >= length ) {
+                            return 0;
+                        }
+                        header = data[in ++];
+                        offset += header;
+                    } while ( header == 255 );
+                }
+                out += offset;
+                if ( in + count > length || out + count > width ) {
+                    return 0;
+                }
+                memcpy(row + out, data + in, count);
+                in += count;
+                out += count;
+            }
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * linecodec_free() - 释放编码器。
+ */
+void
+linecodec_free(
+    linecodec_t         *codec          /* 输入 - 编码器 */
+) {
+    free(codec->seed);
+    free(codec->packbits);
+    free(codec->delta);
+    codec->seed = codec->packbits = codec->delta = NULL;
+}
+
+/*
+ * linecodec_rows_init() - 为每行 width 个字节的页面准备空白行与重复行的合并。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+linecodec_rows_init(
+    linecodec_rows_t    *rows,          /* 输出 - 合并状态 */
+    size_t              width,          /* 输入 - 每行字节数 */
+    uint8_t             blank           /* 输入 - 空白行的字节值 */
+) {
+    memset(rows, 0, sizeof(linecodec_rows_t));
+    rows->width = width;
+    rows->previous = (uint8_t *) malloc(width + 1);
+    rows->blank_row = (uint8_t *) malloc(width + 1);
+
+    if ( rows->previous == NULL || rows->blank_row == NULL ) {
+        linecodec_rows_free(rows);
+        return 0;
+    }
+    memset(rows->blank_row, blank, width);
+
+    return 1;
+}
+
+/*
+ * linecodec_rows_push() - 加入一行。skip 和 repeat 返回在这一行之前要发出的
+ *                         SKIP/REPEAT 行数（先 SKIP 后 REPEAT，为 0 时不发）。
+ *                         skip 不为 0 时设备端的上一行先变成空白行，delta row
+ *                         的种子行也要换成 blank_row。
+ */
+int                                     /* 输出 - 1 这一行要发出，0 已经计入 SKIP/REPEAT */
+linecodec_rows_push(
+    linecodec_rows_t    *rows,          /* 输入 - 合并状态 */
+    const uint8_t       *row,           /* 输入 - 这一行 */
+    unsigned            *skip,          /* 输出 - 之前要发出的空白行数 */
+    unsigned            *repeat         /* 输出 - 之前要发出的重复行数 */
+) {
+    *skip = *repeat = 0;
+
+    if ( linecodec_is_uniform(row, rows->width, rows->blank_row[0]) ) {
+        /* 空白行：先发出之前的重复行，它们重复的是 SKIP 之前的那一行。 */
+        *repeat = rows->pending_repeat;
+        rows->pending_repeat = 0;
+        rows->pending_skip ++;
+        return 0;
+    }
+    if (
+        rows->pending_skip == 0
+        && rows->have_previous
+        && linecodec_diff(row, rows->previous, rows->width) == rows->width
+    ) {
+        rows->pending_repeat ++;
+        return 0;
+    }
+
+    linecodec_rows_flush(rows, skip, repeat);
+    memcpy(rows->previous, row, rows->width);
+    rows->have_previous = 1;
+
+    return 1;
+}
+
+/*
+ * linecodec_rows_flush() - 取出尚未发出的 SKIP/REPEAT 行数，页面结束时调用。
+ */
+void
+linecodec_rows_flush(
+    linecodec_rows_t    *rows,          /* 输入 - 合并状态 */
+    unsigned            *skip,          /* 输出 - 要发出的空白行数 */
+    unsigned            *repeat         /* 输出 - 要发出的重复行数 */
+) {
+    *skip = rows->pending_skip;
+    *repeat = rows->pending_repeat;
+    if ( *skip > 0 ) {
+        memcpy(rows->previous, rows->blank_row, rows->width);
+        rows->have_previous = 1;
+    }
+    rows->pending_skip = rows->pending_repeat = 0;
+}
+
+/*
+ * linecodec_rows_free() - 释放合并状态。
+ */
+void
+linecodec_rows_free(
+    linecodec_rows_t    *rows           /* 输入 - 合并状态 */
+) {
+    free(rows->previous);
+    free(rows->blank_row);
+    rows->previous = rows->blank_row = NULL;
+}
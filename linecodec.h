@@ -0,0 +1,87 @@
+/*
+ * linecodec.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_LINECODEC_H
+#define __LEISRASTERFILTER_LINECODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * 行压缩方式。编号与 PCL 的压缩方式一致。
+ */
+typedef enum {
+    LINECODEC_RAW = 0,          /* 不压缩 */
+    LINECODEC_PACKBITS = 2,     /* PackBits（PCL 方式 2） */
+    LINECODEC_DELTA = 3         /* 相对上一行的 delta row（PCL 方式 3） */
+} linecodec_method_t;
+
+/*
+ * 行编码器。保存上一行（种子行）和两种编码的输出缓冲。
+ */
+typedef struct {
+    size_t              width;          /* 每行字节数 */
+    uint8_t             *seed,          /* 种子行，即解码端当前的上一行 */
+                        *packbits,      /* PackBits 编码结果 */
+                        *delta;         /* delta row 编码结果 */
+    unsigned long long  bytes_in,       /* 累计输入字节数 */
+                        bytes_out,      /* 累计输出字节数（不含命令行） */
+                        rows[4];        /* 各压缩方式被选中的行数 */
+} linecodec_t;
+
+/*
+ * 空白行与重复行的合并。空白行和与设备端上一行相同的行先只计数，遇到其他行或
+ * 页面结束时再换成 SKIP/REPEAT 命令。SKIP 之后设备端的上一行为空白行，所以
+ * 还有待发的 SKIP 时不再把行算作重复。
+ */
+typedef struct {
+    size_t              width;          /* 每行字节数 */
+    uint8_t             *previous,      /* 设备端的上一行 */
+                        *blank_row;     /* 空白行 */
+    int                 have_previous;  /* 本页是否已经有上一行 */
+    unsigned            pending_skip,   /* 尚未发出的空白行数 */
+                        pending_repeat; /* 尚未发出的重复行数 */
+} linecodec_rows_t;
+
+/* 编码结果的最大长度。 */
+#define LINECODEC_BOUND(n)      ( (n) + (n) / 8 + 16 )
+
+extern int linecodec_init(linecodec_t *codec, size_t width);
+extern void linecodec_reset(linecodec_t *codec);
+extern size_t linecodec_diff(const uint8_t *a, const uint8_t *b, size_t n);
+extern int linecodec_is_uniform(const uint8_t *row, size_t n, uint8_t value);
+extern size_t linecodec_packbits(const uint8_t *src, size_t n, uint8_t *dst);
+extern size_t linecodec_delta(const uint8_t *row, const uint8_t *seed, size_t n, uint8_t *dst);
+extern linecodec_method_t linecodec_encode(linecodec_t *codec, const uint8_t *row, const uint8_t **data, size_t *length);
+extern void linecodec_set_seed(linecodec_t *codec, const uint8_t *row);
+extern int linecodec_decode(linecodec_method_t method, const uint8_t *data, size_t length, uint8_t *row, size_t width);
+extern void linecodec_free(linecodec_t *codec);
+extern int linecodec_rows_init(linecodec_rows_t *rows, size_t width, uint8_t blank);
+extern int linecodec_rows_push(linecodec_rows_t *rows, const uint8_t *row, unsigned *skip, unsigned *repeat);
+extern void linecodec_rows_flush(linecodec_rows_t *rows, unsigned *skip, unsigned *repeat);
+extern void linecodec_rows_free(linecodec_rows_t *rows);
+
+#endif
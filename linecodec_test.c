@@ -0,0 +1,380 @@
+/*
+ * linecodec_test.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 这是一个用于测试 linecodec.c 行压缩的小程序。它用一个独立实现的参考解码器
+ * 逐行解码 linecodec_encode() 的输出，检查是否与原始行一致（linecodec_decode()
+ * 的结果也要一致），并显示压缩率和耗时。空白行和重复行合并成 SKIP/REPEAT 后，
+ * 按设备的方式执行这些命令，也要还原出原来的每一行。
+ */
+
+#include "linecodec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * now() - 单调时钟的当前时间（秒）。
+ */
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * decode_packbits() - 参考 PackBits 解码器。
+ */
+static int                          /* 输出 - 1 成功，0 失败 */
+decode_packbits(
+    const uint8_t   *src,
+    size_t          length,
+    uint8_t         *row,
+    size_t          width
+) {
+    size_t          in = 0, out = 0, count;
+    int             n;
+
+    while ( in < length ) {
+        n = (int8_t) src[in ++];
+        if ( n >= 0 ) {
+            count = n + 1;
+            if ( in + count > length || out + count > width ) {
+                return 0;
+            }
+            memcpy(row + out, src + in, count);
+            in += count;
+        } else if ( n != -128 ) {
+            count = 1 - n;
+            if ( in >= length || out + count > width ) {
+                return 0;
+            }
+            memset(row + out, src[in ++], count);
+        } else {
+            continue;
+        }
+        out += count;
+    }
+
+    return out == width;
+}
+
+/*
+ * decode_delta() - 参考 delta row（PCL 方式 3）解码器，row 中原有内容为种子行。
+ */
+static int                          /* 输出 - 1 成功，0 失败 */
+decode_delta(
+    const uint8_t   *src,
+    size_t          length,
+    uint8_t         *row,
+    size_t          width
+) {
+    size_t          in = 0, position = 0, count, offset;
+    uint8_t         extra;
+
+    while ( in < length ) {
+        count = ( src[in] >> 5 ) + 1;
+        offset = src[in ++] & 31;
+        if ( offset == 31 ) {
+            do {
+                if ( in >= length ) {
+                    return 0;
+                }
+                extra = src[in ++];
+                offset += extra;
+            } while ( extra == 255 );
+        }
+        position += offset;
+        if ( in + count > length || position + count > width ) {
+            return 0;
+        }
+        memcpy(row + position, src + in, count);
+        in += count;
+        position += count;
+    }
+
+    return 1;
+}
+
+/*
+ * make_row() - 按类型生成一行测试数据，prev 为上一行。
+ */
+static void
+make_row(
+    uint8_t         *row,
+    const uint8_t   *prev,
+    size_t          width,
+    unsigned        kind
+) {
+    size_t          index;
+
+    switch ( kind % 6 ) {
+        case 0 :    /* 空白行 */
+            memset(row, 0xff, width);
+            break;
+        case 1 :    /* 随机数据 */
+            for ( index = 0; index < width; index ++ ) {
+                row[index] = (uint8_t) rand();
+            }
+            break;
+        case 2 :    /* 像文字的行：大片空白中夹着短的深色段 */
+            memset(row, 0xff, width);
+            for ( index = rand() % 40; index < width; index += 20 + rand() % 300 ) {
+                memset(row + index, rand() % 64, ( width - index < 12 )? width - index: 12);
+            }
+            break;
+        case 3 :    /* 与上一行只有少数字节不同，间隔有长有短 */
+            memcpy(row, prev, width);
+            for ( index = rand() % 5; index < width; index += 1 + rand() % 700 ) {
+                row[index] ^= (uint8_t) ( 1 + rand() % 255 );
+            }
+            break;
+        case 4 :    /* 与上一行相同 */
+            memcpy(row, prev, width);
+            break;
+        default :   /* 渐变 */
+            for ( index = 0; index < width; index ++ ) {
+                row[index] = (uint8_t) ( index / 3 );
+            }
+            break;
+    }
+}
+
+/*
+ * run_width() - 以给定行宽编码、解码一批行。
+ */
+static int                          /* 输出 - 1 成功，0 失败 */
+run_width(
+    size_t          width,
+    unsigned        rows
+) {
+    linecodec_t     codec;
+    uint8_t         *row = (uint8_t *) malloc(width),
+                    *prev = (uint8_t *) calloc(1, width),
+                    *decoded = (uint8_t *) calloc(1, width),
+                    *check = (uint8_t *) malloc(width);
+    const uint8_t   *data;
+    size_t          length;
+    linecodec_method_t  method;
+    unsigned        y;
+    int             ok = 1;
+    double          start, elapsed = 0.0;
+
+    if ( ! linecodec_init(&codec, width) ) {
+        return 0;
+    }
+
+    for ( y = 0; y < rows && ok; y ++ ) {
+        make_row(row, prev, width, ( y * 7 + y / 5 ) % 6);
+
+        /* linecodec_is_uniform() 与逐字节比较的结果要一致。 */
+        for ( length = 0; length < width && row[length] == 0xff; length ++ );
+        if ( linecodec_is_uniform(row, width, 0xff) != ( length == width ) ) {
+            printf("width %zu row %u: linecodec_is_uniform() mismatch\n", width, y);
+            ok = 0;
+        }
+
+        start = now();
+        method = linecodec_encode(&codec, row, &data, &length);
+        elapsed += now() - start;
+
+        /* decoded 中保存着上一行，正好作为 delta row 的种子。 */
+        switch ( method ) {
+            case LINECODEC_RAW :
+                ok = ( length == width );
+                memcpy(decoded, data, length);
+                break;
+            case LINECODEC_PACKBITS :
+                ok = decode_packbits(data, length, decoded, width);
+                break;
+            case LINECODEC_DELTA :
+                ok = decode_delta(data, length, decoded, width);
+                break;
+        }
+
+        if ( ! ok || memcmp(decoded, row, width) != 0 ) {
+            printf("width %zu row %u method %d: round-trip mismatch\n", width, y, method);
+            ok = 0;
+        }
+
+        /* linecodec_decode() 也要得到同样的结果。 */
+        memcpy(check, prev, width);
+        if ( ok && ( ! linecodec_decode(method, data, length, check, width) || memcmp(check, row, width) != 0 ) ) {
+            printf("width %zu row %u method %d: linecodec_decode() mismatch\n", width, y, method);
+            ok = 0;
+        }
+        memcpy(prev, row, width);
+    }
+
+    if ( ok ) {
+        printf("width %6zu: %5.1f%% of raw (raw %llu, packbits %llu, delta %llu rows), %.1f MB/s\n",
+            width, 100.0 * codec.bytes_out / codec.bytes_in,
+            codec.rows[LINECODEC_RAW], codec.rows[LINECODEC_PACKBITS], codec.rows[LINECODEC_DELTA],
+            codec.bytes_in / ( elapsed > 0.0? elapsed: 1e-9 ) / 1e6);
+    }
+
+    linecodec_free(&codec);
+    free(row);
+    free(prev);
+    free(decoded);
+    free(check);
+
+    return ok;
+}
+
+/*
+ * run_rows() - 按 rastertosample 的方式合并空白行和重复行并编码，再像设备一样
+ *              执行 LINE/SKIP/REPEAT，检查还原出的每一行。pattern 中 '.' 为空白行，
+ *              字母为固定内容的行；为 NULL 时随机生成 rows 行。
+ */
+static int                          /* 输出 - 1 成功，0 失败 */
+run_rows(
+    size_t          width,
+    uint8_t         blank,
+    const char      *pattern,
+    unsigned        rows
+) {
+    linecodec_t     codec;
+    linecodec_rows_t    merge;
+    uint8_t         *row = (uint8_t *) malloc(width),
+                    *device = (uint8_t *) calloc(1, width),
+                    *printed,
+                    *expected;
+    const uint8_t   *data;
+    size_t          length,
+                    index;
+    unsigned        y,
+                    out = 0,
+                    skip,
+                    repeat;
+    int             ok = 1,
+                    send,
+                    kind;
+
+    if ( pattern != NULL ) {
+        rows = strlen(pattern);
+    }
+    printed = (uint8_t *) malloc(width * rows);
+    expected = (uint8_t *) malloc(width * rows);
+    if ( ! linecodec_init(&codec, width) || ! linecodec_rows_init(&merge, width, blank) ) {
+        return 0;
+    }
+
+    /* 多走一轮 y == rows，取出页尾的 SKIP/REPEAT。 */
+    for ( y = 0; y <= rows && ok; y ++ ) {
+        send = 0;
+        if ( y == rows ) {
+            linecodec_rows_flush(&merge, &skip, &repeat);
+        } else {
+            /* 相同的字母得到相同的行。 */
+            kind = ( pattern != NULL )? pattern[y]: ".AAB"[rand() % 4];
+            for ( index = 0; index < width; index ++ ) {
+                row[index] = ( kind == '.' )? blank: (uint8_t) ( kind * 31 + index % 7 );
+            }
+            memcpy(expected + (size_t) y * width, row, width);
+            send = linecodec_rows_push(&merge, row, &skip, &repeat);
+        }
+
+        /* 设备端：SKIP 输出空白行并把上一行清为空白，REPEAT 重复上一行。 */
+        if ( skip > 0 ) {
+            linecodec_set_seed(&codec, merge.blank_row);
+            memset(device, blank, width);
+        }
+        if ( out + skip + repeat + send > rows ) {
+            printf("width %zu row %u: too many rows printed\n", width, y);
+            ok = 0;
+            break;
+        }
+        for ( skip += repeat; skip > 0; skip --, out ++ ) {
+            memcpy(printed + (size_t) out * width, device, width);
+        }
+
+        if ( send ) {
+            linecodec_method_t  method = linecodec_encode(&codec, row, &data, &length);
+
+            if ( ! linecodec_decode(method, data, length, device, width) ) {
+                printf("width %zu row %u: LINE decode failed\n", width, y);
+                ok = 0;
+                break;
+            }
+            memcpy(printed + (size_t) out * width, device, width);
+            out ++;
+        }
+    }
+
+    if ( ok && out != rows ) {
+        printf("width %zu: %u of %u rows printed\n", width, out, rows);
+        ok = 0;
+    }
+    for ( y = 0; ok && y < rows; y ++ ) {
+        if ( memcmp(printed + (size_t) y * width, expected + (size_t) y * width, width) != 0 ) {
+            printf("width %zu pattern %s row %u: SKIP/REPEAT mismatch\n", width, pattern? pattern: "(random)", y);
+            ok = 0;
+        }
+    }
+
+    linecodec_rows_free(&merge);
+    linecodec_free(&codec);
+    free(row);
+    free(device);
+    free(printed);
+    free(expected);
+
+    return ok;
+}
+
+/*
+ * main() - 程序主入口。
+ */
+int                                 /* 输出 - 0 成功，1 失败 */
+main(
+    int argc,                       /* 输入 - 命令行参数个数。 */
+    char *argv[]                    /* 输入 - 命令行参数内容。 */
+) {
+    const size_t    widths[] = { 1, 7, 16, 17, 31, 128, 129, 300, 1000, 7440 };
+    const char      *patterns[] = { "A.A", "AA.A", "A..AA", ".A.A.", "AAB.BB.", "A.AAA.A" };
+    unsigned        index,
+                    pattern;
+    int             ok = 1;
+
+    srand(20231);
+
+    for ( index = 0; index < sizeof(widths) / sizeof(widths[0]); index ++ ) {
+        ok = run_width(widths[index], ( widths[index] < 1000 )? 2000: 600) && ok;
+        for ( pattern = 0; pattern < sizeof(patterns) / sizeof(patterns[0]); pattern ++ ) {
+            ok = run_rows(widths[index], 0xff, patterns[pattern], 0) && ok;
+            ok = run_rows(widths[index], 0x00, patterns[pattern], 0) && ok;
+        }
+        ok = run_rows(widths[index], 0xff, NULL, 2000) && ok;
+    }
+
+    puts(ok? "All round-trips passed.": "Round-trip FAILED.");
+
+    return ok? EXIT_SUCCESS: EXIT_FAILURE;
+}
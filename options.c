@@ -0,0 +1,58 @@
+/*
+ * options.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 几个过滤器共用的选项解析。
+ */
+
+#include "options.h"
+#include <strings.h>
+
+/*
+ * job_option_bool() - 取一个开关选项的值。true/yes/on 为 1，false/no/off 为 0，
+ *                     没有这个选项或者是其他值时为 default_value。
+ */
+int                                 /* 输出 - 1 打开，0 关闭 */
+job_option_bool(
+    const char          *name,          /* 输入 - 选项名 */
+    int                 num_options,    /* 输入 - 选项个数 */
+    cups_option_t       *options,       /* 输入 - 选项 */
+    int                 default_value   /* 输入 - 默认值 */
+) {
+    const char          *value = cupsGetOption(name, num_options, options);
+
+    if ( value == NULL ) {
+        return default_value;
+    }
+    if ( ! strcasecmp(value, "true") || ! strcasecmp(value, "yes") || ! strcasecmp(value, "on") ) {
+        return 1;
+    }
+    if ( ! strcasecmp(value, "false") || ! strcasecmp(value, "no") || ! strcasecmp(value, "off") ) {
+        return 0;
+    }
+
+    return default_value;
+}
@@ -0,0 +1,744 @@
+/*
+ * output.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 输出层。CUPS 把过滤器的标准输出接到通往后端的管道上，经过 stdio 时每个字节
+ * 要先拷进 stdio 的缓冲，再被内核拷进管道。这里改为：
+ *
+ * 1. 数据写进页对齐的缓冲段（mmap 得到），写满一段整段用 write() 交出。
+ * 2. 要求零拷贝且输出是管道时，先用 F_SETPIPE_SZ 调大管道容量，再用 vmsplice()
+ *    把缓冲页直接挂到管道上；vmsplice() 不可用时退回 write()。
+ *
+ * vmsplice() 交出的是缓冲页的引用，之后改写这些页，读端读到的内容也会变。数据
+ * 被读出管道也不能说明页已经没人引用（读端可能 splice()/tee() 到别处），所以每段
+ * 交出后都 munmap 掉再映射一块新的，旧页由内核持有的引用保留到用完为止。每段
+ * 重新映射和缺页的开销比 write() 省下的那次拷贝还大，所以默认不用 vmsplice()。
+ *
+ * 写文件（rastertobitmapfile）时用 output_open_files()：缓冲段注册为 io_uring 的固定
+ * 缓冲区，写满一段就提交一个 IORING_OP_WRITE_FIXED 请求并马上回去转换下一段，只有
+ * 要重用的缓冲段仍在途时才等待。写请求可以跨页在途，一页写完后文件描述符要等它的
+ * 所有请求完成才关闭。io_uring 不可用时退回同步的 pwrite()。
+ *
+ * 多份拷贝不重新转换：写文件时用 FICLONE 让拷贝与原文件共享数据块（文件系统不
+ * 支持时用 copy_file_range() 在内核中拷贝）；写标准输出时用 output_spool_begin()
+ * 把交出的数据同时记进一个 memfd，之后用 sendfile() 从 memfd 重放。
+ */
+
+#define _GNU_SOURCE
+
+#include "output.h"
+#include "trace.h"
+#include "bitmap.h"
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+
+/*
+ * output_cpu_time() - 进程已用的 CPU 时间（用户态 + 内核态）。
+ */
+static double
+output_cpu_time(void) {
+    struct rusage   usage;
+
+    if ( getrusage(RUSAGE_SELF, &usage) != 0 ) {
+        return 0.0;
+    }
+
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+         + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/*
+ * output_map_band() - 为一个缓冲段映射新的内存页。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+output_map_band(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    unsigned            index           /* 输入 - 缓冲段 */
+) {
+    void                *band;
+
+    if ( sink->bands[index] != NULL ) {
+        munmap(sink->bands[index], sink->band_size);
+        sink->bands[index] = NULL;
+    }
+
+    band = mmap(NULL, sink->band_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( band == MAP_FAILED ) {
+        log_error("Error", "Unable to map output band!");
+        return FUNCTION_FAILURE;
+    }
+
+    sink->bands[index] = (uint8_t *) band;
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * output_open() - 打开一个输出流。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+output_open(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    int                 fd,             /* 输入 - 文件描述符 */
+    int                 zero_copy       /* 输入 - 为 1 时，输出是管道则使用 vmsplice() */
+) {
+    struct stat         st;
+    long                page_size = sysconf(_SC_PAGESIZE);
+    int                 pipe_size;
+
+    memset(sink, 0, sizeof(output_sink_t));
+    sink->fd = fd;
+    sink->mode = OUTPUT_MODE_WRITE;
+    sink->page_size = ( page_size > 0 )? (size_t) page_size: 4096;
+    sink->band_size = ( OUTPUT_BAND_SIZE + sink->page_size - 1 ) / sink->page_size * sink->page_size;
+    sink->num_bands = 1;
+    sink->cpu_start = output_cpu_time();
+    sink->ring.fd = -1;
+    sink->spool_fd = -1;
+
+#ifdef F_SETPIPE_SZ
+    if ( zero_copy && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode) ) {
+        /* 调大管道容量，失败（比如超过 pipe-max-size）时沿用原来的大小。 */
+        fcntl(fd, F_SETPIPE_SZ, OUTPUT_PIPE_SIZE);
+        if ( ( pipe_size = fcntl(fd, F_GETPIPE_SZ) ) > 0 ) {
+            sink->mode = OUTPUT_MODE_VMSPLICE;
+            sink->pipe_size = pipe_size;
+            fprintf(stderr, "DEBUG: Output is a pipe of %d bytes, using vmsplice\n", pipe_size);
+        }
+    }
+#endif
+
+    return output_map_band(sink, 0);
+}
+
+/*
+ * output_hand_off() - 把一段数据交给内核。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+output_hand_off(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    const uint8_t       *data,          /* 输入 - 数据 */
+    size_t              size            /* 输入 - 字节数 */
+) {
+    struct iovec        iov;
+    ssize_t             bytes;
+
+    iov.iov_base = (void *) data;
+    iov.iov_len = size;
+
+    TRACE_BEGIN("write", size);
+    while ( iov.iov_len > 0 ) {
+        if ( sink->mode == OUTPUT_MODE_VMSPLICE ) {
+            bytes = vmsplice(sink->fd, &iov, 1, 0);
+            if ( bytes < 0 && ( errno == EINVAL || errno == ENOSYS || errno == EBADF ) ) {
+                log_debug("Info", "vmsplice() is not available, falling back to write().");
+                sink->mode = OUTPUT_MODE_WRITE;
+                continue;
+            }
+            if ( bytes > 0 ) {
+                sink->spliced_bytes += bytes;
+            }
+        } else if ( sink->mode == OUTPUT_MODE_PWRITE ) {
+            bytes = pwrite(sink->fd, iov.iov_base, iov.iov_len, sink->offset);
+            if ( bytes > 0 ) {
+                sink->offset += bytes;
+            }
+        } else {
+            bytes = write(sink->fd, iov.iov_base, iov.iov_len);
+        }
+
+        if ( bytes < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            sink->failed = 1;
+            TRACE_END("write");
+            return FUNCTION_FAILURE;
+        }
+
+        iov.iov_base = (uint8_t *) iov.iov_base + bytes;
+        iov.iov_len -= bytes;
+        sink->total_bytes += bytes;
+    }
+    TRACE_END("write");
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * output_uring_submit_band() - 为缓冲段中还没有写完的部分提交一个写请求。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+output_uring_submit_band(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    unsigned            index           /* 输入 - 缓冲段 */
+) {
+    const size_t        done = sink->band_done[index];
+    struct io_uring_sqe *sqe = uring_get_sqe(&(sink->ring));
+
+    if ( sqe == NULL ) {
+        return FUNCTION_FAILURE;
+    }
+
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = sink->band_fd[index];
+    sqe->addr = (uint64_t) (uintptr_t) ( sink->bands[index] + done );
+    sqe->len = (uint32_t) ( sink->band_length[index] - done );
+    sqe->off = (uint64_t) ( sink->band_offset[index] + done );
+    sqe->buf_index = (uint16_t) index;
+    sqe->user_data = index;
+
+    return uring_submit(&(sink->ring), 0);
+}
+
+/*
+ * output_close_finished() - 关闭已经没有在途写请求的文件。
+ */
+static void
+output_close_finished(
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    unsigned            index, band;
+
+    for ( index = 0; index < sink->num_closing; ) {
+        for ( band = 0; band < sink->num_bands; band ++ ) {
+            if ( sink->band_fd[band] == sink->closing_fds[index] ) {
+                break;
+            }
+        }
+
+        if ( band < sink->num_bands ) {
+            index ++;
+            continue;
+        }
+
+        close(sink->closing_fds[index]);
+        sink->closing_fds[index] = sink->closing_fds[-- sink->num_closing];
+    }
+}
+
+/*
+ * output_uring_reap() - 处理完成事件。wait_nr 不为 0 时先等待这么多个事件。
+ *                       短写会按剩余部分重新提交，出错时标记输出流失败。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+output_uring_reap(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    unsigned            wait_nr         /* 输入 - 要等待的完成事件数 */
+) {
+    struct io_uring_cqe *cqe;
+    unsigned            index;
+    int                 result;
+
+    if ( wait_nr > 0 ) {
+        TRACE_BEGIN("wait write", wait_nr);
+        result = uring_submit(&(sink->ring), wait_nr);
+        TRACE_END("wait write");
+        if ( ! result ) {
+            log_error("Error", "Unable to wait for asynchronous writes!");
+            sink->failed = 1;
+            return FUNCTION_FAILURE;
+        }
+    }
+
+    while ( ( cqe = uring_peek_cqe(&(sink->ring)) ) != NULL ) {
+        index = (unsigned) cqe->user_data;
+        result = cqe->res;
+        uring_cqe_seen(&(sink->ring));
+
+        if ( result > 0 ) {
+            sink->band_done[index] += result;
+            sink->total_bytes += result;
+            if ( sink->band_done[index] < sink->band_length[index] && output_uring_submit_band(sink, index) ) {
+                continue;
+            }
+        }
+
+        if ( sink->band_done[index] < sink->band_length[index] ) {
+            fprintf(stderr, "DEBUG: Asynchronous write failed: %s\n", strerror(( result < 0 )? -result: EIO));
+            log_error("Error", "Asynchronous write failed!");
+            sink->failed = 1;
+        }
+
+        sink->band_fd[index] = -1;
+        sink->in_flight --;
+    }
+
+    output_close_finished(sink);
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * output_spool_record() - 把要交出的数据记进 memfd，供之后重放。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+output_spool_record(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    const uint8_t       *data,          /* 输入 - 数据 */
+    size_t              size            /* 输入 - 字节数 */
+) {
+    ssize_t             bytes;
+
+    while ( size > 0 ) {
+        if ( ( bytes = pwrite(sink->spool_fd, data, size, (off_t) sink->spool_size) ) < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            log_error("Error", "Unable to record output for replay!");
+            sink->failed = 1;
+            return FUNCTION_FAILURE;
+        }
+        data += bytes;
+        size -= bytes;
+        sink->spool_size += bytes;
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * output_flush() - 把当前缓冲段中的数据交给内核，并换到下一个可以写入的缓冲段。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+output_flush(
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    const output_mode_t mode = sink->mode;
+
+    if ( sink->failed ) {
+        return FUNCTION_FAILURE;
+    }
+    if ( sink->fill == 0 ) {
+        return FUNCTION_SUCCESS;
+    }
+
+    if ( mode == OUTPUT_MODE_URING ) {
+        sink->band_fd[sink->current] = sink->fd;
+        sink->band_offset[sink->current] = sink->offset;
+        sink->band_length[sink->current] = sink->fill;
+        sink->band_done[sink->current] = 0;
+        sink->in_flight ++;
+        sink->offset += sink->fill;
+        sink->fill = 0;
+
+        if ( ! output_uring_submit_band(sink, sink->current) ) {
+            log_error("Error", "Unable to submit asynchronous write!");
+            sink->band_fd[sink->current] = -1;
+            sink->in_flight --;
+            sink->failed = 1;
+            return FUNCTION_FAILURE;
+        }
+
+        /* 下一段仍在写时才等待，否则只顺手收割已经完成的请求。 */
+        sink->current = ( sink->current + 1 ) % sink->num_bands;
+        while ( sink->band_fd[sink->current] != -1 ) {
+            if ( ! output_uring_reap(sink, 1) ) {
+                return FUNCTION_FAILURE;
+            }
+        }
+        output_uring_reap(sink, 0);
+
+        return ( sink->failed )? FUNCTION_FAILURE: FUNCTION_SUCCESS;
+    }
+
+    if ( sink->spool_fd >= 0 && ! output_spool_record(sink, sink->bands[sink->current], sink->fill) ) {
+        return FUNCTION_FAILURE;
+    }
+    if ( ! output_hand_off(sink, sink->bands[sink->current], sink->fill) ) {
+        return FUNCTION_FAILURE;
+    }
+    sink->fill = 0;
+
+    /*
+     * 用 write() 交出的数据已经拷进内核，缓冲段可以马上重用；用 vmsplice() 交出的
+     * 页不再改写，换一块新的映射。
+     */
+    if ( mode == OUTPUT_MODE_VMSPLICE ) {
+        sink->remapped_bands ++;
+        return output_map_band(sink, sink->current);
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * output_write() - 向输出流写入数据。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+output_write(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    const void          *data,          /* 输入 - 数据 */
+    size_t              size            /* 输入 - 字节数 */
+) {
+    const uint8_t       *p = (const uint8_t *) data;
+    size_t              chunk;
+
+    while ( size > 0 ) {
+        if ( sink->failed ) {
+            return FUNCTION_FAILURE;
+        }
+
+        chunk = sink->band_size - sink->fill;
+        if ( chunk > size ) {
+            chunk = size;
+        }
+        memcpy(sink->bands[sink->current] + sink->fill, p, chunk);
+        sink->fill += chunk;
+        p += chunk;
+        size -= chunk;
+
+        if ( sink->fill == sink->band_size && ! output_flush(sink) ) {
+            return FUNCTION_FAILURE;
+        }
+    }
+
+    return ( sink->failed )? FUNCTION_FAILURE: FUNCTION_SUCCESS;
+}
+
+/*
+ * output_reserve() - 在当前缓冲段中预留 size 个字节，调用者直接把数据转换到
+ *                    这里，再用 output_commit() 提交。
+ */
+uint8_t *                               /* 输出 - 可写入的位置，size 超过段大小或出错时为 NULL */
+output_reserve(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    size_t              size            /* 输入 - 字节数 */
+) {
+    if ( sink->failed || size > sink->band_size ) {
+        return NULL;
+    }
+    if ( sink->fill + size > sink->band_size && ! output_flush(sink) ) {
+        return NULL;
+    }
+
+    return sink->bands[sink->current] + sink->fill;
+}
+
+/*
+ * output_commit() - 提交 output_reserve() 预留的数据。
+ */
+void
+output_commit(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    size_t              size            /* 输入 - 实际写入的字节数 */
+) {
+    sink->fill += size;
+    if ( sink->fill == sink->band_size ) {
+        output_flush(sink);
+    }
+}
+
+/*
+ * output_close() - 交出剩余的数据，等待所有在途的写请求完成，并释放缓冲段。
+ *                  不关闭 output_open() 传入的文件描述符。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+output_close(
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    int                 result;
+    double              cpu;
+    unsigned            index;
+
+    if ( sink->mode == OUTPUT_MODE_URING || sink->mode == OUTPUT_MODE_PWRITE ) {
+        /* 任务取消时可能还有一个文件没有结束。 */
+        if ( sink->fd >= 0 ) {
+            output_end_file(sink);
+        }
+        while ( sink->in_flight > 0 ) {
+            if ( ! output_uring_reap(sink, 1) ) {
+                break;
+            }
+        }
+        for ( index = 0; index < sink->num_closing; index ++ ) {
+            close(sink->closing_fds[index]);
+        }
+        sink->num_closing = 0;
+        result = ! sink->failed;
+    } else {
+        result = output_flush(sink);
+    }
+
+    if ( sink->ring.fd >= 0 ) {
+        uring_exit(&(sink->ring));
+    }
+    if ( sink->spool_fd >= 0 ) {
+        close(sink->spool_fd);
+        sink->spool_fd = -1;
+    }
+
+    cpu = output_cpu_time() - sink->cpu_start;
+    for ( index = 0; index < OUTPUT_MAX_BANDS; index ++ ) {
+        if ( sink->bands[index] != NULL ) {
+            munmap(sink->bands[index], sink->band_size);
+            sink->bands[index] = NULL;
+        }
+    }
+
+    if ( sink->total_bytes > 0 ) {
+        fprintf(stderr, "DEBUG: Output %llu bytes (%llu via vmsplice, %llu replayed, %llu bands remapped), %.3f CPU seconds per GB\n",
+            sink->total_bytes, sink->spliced_bytes, sink->replayed_bytes, sink->remapped_bands,
+            cpu * 1073741824.0 / sink->total_bytes);
+    }
+
+    return result;
+}
+
+/*
+ * output_open_files() - 打开一个用来依次写多个文件的输出流。async 为 1 时使用
+ *                       io_uring，不可用时退回 pwrite()。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+output_open_files(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    int                 async           /* 输入 - 是否使用 io_uring */
+) {
+    struct iovec        iovecs[OUTPUT_FILE_BANDS];
+    unsigned            index;
+
+    if ( ! output_open(sink, -1, 0) ) {
+        return FUNCTION_FAILURE;
+    }
+
+    sink->mode = OUTPUT_MODE_PWRITE;
+    sink->num_bands = OUTPUT_FILE_BANDS;
+    for ( index = 0; index < OUTPUT_MAX_BANDS; index ++ ) {
+        sink->band_fd[index] = -1;
+    }
+    for ( index = 0; index < sink->num_bands; index ++ ) {
+        if ( ( sink->bands[index] == NULL && ! output_map_band(sink, index) ) ) {
+            output_close(sink);
+            return FUNCTION_FAILURE;
+        }
+        iovecs[index].iov_base = sink->bands[index];
+        iovecs[index].iov_len = sink->band_size;
+    }
+
+    if ( async ) {
+        if ( ! uring_init(&(sink->ring), sink->num_bands * 2) ) {
+            log_debug("Info", "io_uring is not available, falling back to pwrite().");
+        } else if ( ! uring_register_buffers(&(sink->ring), iovecs, sink->num_bands) ) {
+            log_debug("Info", "Unable to register io_uring buffers, falling back to pwrite().");
+            uring_exit(&(sink->ring));
+        } else {
+            sink->mode = OUTPUT_MODE_URING;
+            fprintf(stderr, "DEBUG: Writing files with io_uring, up to %u writes in flight\n", sink->num_bands);
+        }
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * output_begin_file() - 开始写一个新文件。输出流接管文件描述符，在
+ *                       output_end_file() 之后负责关闭它。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+output_begin_file(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    int                 fd              /* 输入 - 已打开的文件 */
+) {
+    sink->fd = fd;
+    sink->offset = 0;
+
+    return ( sink->failed )? FUNCTION_FAILURE: FUNCTION_SUCCESS;
+}
+
+/*
+ * output_end_file() - 结束当前文件：交出剩余数据，没有在途写请求时马上关闭文件，
+ *                     否则等请求完成后再关闭，不阻塞下一页的转换。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+output_end_file(
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    const int           result = output_flush(sink);
+
+    if ( sink->fd < 0 ) {
+        return result;
+    }
+
+    if ( sink->mode == OUTPUT_MODE_URING ) {
+        /* 每个等待关闭的文件至少占着一个缓冲段，closing_fds 不会溢出。 */
+        sink->closing_fds[sink->num_closing ++] = sink->fd;
+        output_close_finished(sink);
+    } else {
+        close(sink->fd);
+    }
+    sink->fd = -1;
+
+    return result && ! sink->failed;
+}
+
+/*
+ * output_sync() - 等待所有在途的写请求完成，并关闭已经结束的文件。之后可以从
+ *                 文件系统读到已写出的所有数据。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+output_sync(
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    while ( sink->mode == OUTPUT_MODE_URING && sink->in_flight > 0 ) {
+        if ( ! output_uring_reap(sink, 1) ) {
+            return FUNCTION_FAILURE;
+        }
+    }
+    output_close_finished(sink);
+
+    return ( sink->failed )? FUNCTION_FAILURE: FUNCTION_SUCCESS;
+}
+
+/*
+ * output_copy_file() - 把 src_fd 的全部内容拷贝到 dst_fd。先试 FICLONE，让两个
+ *                      文件共享数据块；不支持时用 copy_file_range()，数据不经过
+ *                      用户态。
+ */
+int                                     /* 输出 - OUTPUT_COPY_* */
+output_copy_file(
+    int                 src_fd,         /* 输入 - 源文件 */
+    int                 dst_fd          /* 输入 - 目标文件，应为空文件 */
+) {
+    struct stat         st;
+    loff_t              in_offset = 0,
+                        out_offset = 0;
+    ssize_t             bytes;
+
+#ifdef FICLONE
+    if ( ioctl(dst_fd, FICLONE, src_fd) == 0 ) {
+        return OUTPUT_COPY_REFLINK;
+    }
+#endif
+
+    if ( fstat(src_fd, &st) != 0 ) {
+        return OUTPUT_COPY_FAILED;
+    }
+
+    while ( in_offset < st.st_size ) {
+        bytes = copy_file_range(src_fd, &in_offset, dst_fd, &out_offset, (size_t) ( st.st_size - in_offset ), 0);
+        if ( bytes < 0 && errno == EINTR ) {
+            continue;
+        }
+        if ( bytes <= 0 ) {
+            return OUTPUT_COPY_FAILED;
+        }
+    }
+
+    return OUTPUT_COPY_RANGE;
+}
+
+/*
+ * output_spool_begin() - 开始把交出的数据记进一个 memfd，之后可以用
+ *                        output_spool_replay() 重放其中的任意一段。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+output_spool_begin(
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    if ( sink->spool_fd >= 0 ) {
+        return FUNCTION_SUCCESS;
+    }
+
+    if ( ( sink->spool_fd = memfd_create("leisrasterfilter-spool", MFD_CLOEXEC) ) < 0 ) {
+        log_error("Error", "Unable to create output spool!");
+        return FUNCTION_FAILURE;
+    }
+    sink->spool_size = 0;
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * output_spool_mark() - 下一个写入的字节在记录中的位置。
+ */
+unsigned long long                      /* 输出 - 记录中的位置 */
+output_spool_mark(
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    return sink->spool_size + sink->fill;
+}
+
+/*
+ * output_spool_replay() - 交出当前缓冲段，再用 sendfile() 把记录中的一段重新
+ *                         输出。重放的数据不再记录。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+output_spool_replay(
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    unsigned long long  offset,         /* 输入 - 记录中的起始位置 */
+    unsigned long long  length          /* 输入 - 字节数 */
+) {
+    off_t               position = (off_t) offset;
+    ssize_t             bytes;
+
+    if ( sink->spool_fd < 0 || ! output_flush(sink) ) {
+        return FUNCTION_FAILURE;
+    }
+    if ( offset + length > sink->spool_size ) {
+        return FUNCTION_FAILURE;
+    }
+
+    while ( length > 0 ) {
+        bytes = sendfile(sink->fd, sink->spool_fd, &position, ( length > 0x7ffff000ULL )? 0x7ffff000: (size_t) length);
+        if ( bytes < 0 && errno == EINTR ) {
+            continue;
+        }
+        if ( bytes <= 0 ) {
+            log_error("Error", "Unable to replay output!");
+            sink->failed = 1;
+            return FUNCTION_FAILURE;
+        }
+        length -= bytes;
+        sink->total_bytes += bytes;
+        sink->replayed_bytes += bytes;
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * output_spool_reset() - 清空记录，之前记录的数据不再需要重放时调用。
+ */
+void
+output_spool_reset(
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    if ( sink->spool_fd < 0 || output_spool_mark(sink) != sink->spool_size ) {
+        /* 当前缓冲段里还有没交出的数据，它们交出时仍要记录在后面。 */
+        return;
+    }
+
+    if ( ftruncate(sink->spool_fd, 0) == 0 ) {
+        sink->spool_size = 0;
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ * output.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_OUTPUT_H
+#define __LEISRASTERFILTER_OUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "uring.h"
+
+#define OUTPUT_BAND_SIZE        ( 256 * 1024 )  /* 每段输出缓冲的大小，页对齐 */
+#define OUTPUT_PIPE_SIZE        ( 1024 * 1024 ) /* 希望把管道容量调到的大小 */
+#define OUTPUT_MAX_BANDS        16              /* 输出缓冲段数的上限 */
+#define OUTPUT_FILE_BANDS       8               /* 写文件时的缓冲段数，即最多同时在途的写请求数 */
+
+/*
+ * 输出方式。
+ */
+typedef enum {
+    OUTPUT_MODE_WRITE = 0,      /* 普通的 write() */
+    OUTPUT_MODE_VMSPLICE,       /* 输出是管道，用 vmsplice() 把缓冲页直接交给内核 */
+    OUTPUT_MODE_PWRITE,         /* 写文件，同步的 pwrite() */
+    OUTPUT_MODE_URING           /* 写文件，io_uring 异步写入，可以跨页保持多个写请求在途 */
+} output_mode_t;
+
+/*
+ * 输出流。数据先写入页对齐的缓冲段，写满一段后整段交给内核。
+ */
+typedef struct {
+    int                 fd;                         /* 输出的文件描述符 */
+    output_mode_t       mode;                       /* 输出方式 */
+    size_t              page_size,                  /* 内存页大小 */
+                        band_size,                  /* 每段缓冲的大小 */
+                        pipe_size;                  /* 管道容量 */
+    unsigned            num_bands,                  /* 缓冲段数 */
+                        current;                    /* 正在填写的缓冲段 */
+    uint8_t             *bands[OUTPUT_MAX_BANDS];   /* 缓冲段 */
+    size_t              fill;                       /* 当前缓冲段已写入的字节数 */
+    unsigned long long  total_bytes,                /* 累计输出的字节数 */
+                        spliced_bytes,              /* 其中用 vmsplice() 交出的字节数 */
+                        remapped_bands;             /* vmsplice() 交出后重新映射的缓冲段数 */
+    double              cpu_start;                  /* 打开时进程已用的 CPU 时间（秒） */
+
+    /* 以下只用于写文件（output_open_files()）。 */
+    uring_t             ring;                       /* io_uring */
+    off_t               offset;                     /* 当前文件的写入位置 */
+    int                 band_fd[OUTPUT_MAX_BANDS];  /* 缓冲段在途写请求的文件，-1 为空闲 */
+    off_t               band_offset[OUTPUT_MAX_BANDS];  /* 在途写请求的文件位置 */
+    size_t              band_length[OUTPUT_MAX_BANDS],  /* 在途写请求的长度 */
+                        band_done[OUTPUT_MAX_BANDS];    /* 其中已经写完的字节数 */
+    int                 closing_fds[OUTPUT_MAX_BANDS];  /* 已经写完、等在途请求结束后再关闭的文件 */
+    unsigned            num_closing,                /* closing_fds 中的文件个数 */
+                        in_flight;                  /* 在途写请求数 */
+    int                 failed;                     /* 出错后为 1 */
+
+    /* 以下只用于重放（output_spool_begin()）。 */
+    int                 spool_fd;                   /* 记录交出数据的 memfd，-1 为不记录 */
+    unsigned long long  spool_size,                 /* 已记录的字节数 */
+                        replayed_bytes;             /* 重放输出的字节数 */
+} output_sink_t;
+
+/*
+ * output_copy_file() 的结果。
+ */
+#define OUTPUT_COPY_FAILED      0   /* 失败 */
+#define OUTPUT_COPY_REFLINK     1   /* FICLONE 共享数据块，没有拷贝 */
+#define OUTPUT_COPY_RANGE       2   /* copy_file_range() 在内核中拷贝 */
+
+extern int output_open(output_sink_t *sink, int fd, int zero_copy);
+extern int output_write(output_sink_t *sink, const void *data, size_t size);
+extern uint8_t *output_reserve(output_sink_t *sink, size_t size);
+extern void output_commit(output_sink_t *sink, size_t size);
+extern int output_flush(output_sink_t *sink);
+extern int output_close(output_sink_t *sink);
+extern int output_open_files(output_sink_t *sink, int async);
+extern int output_begin_file(output_sink_t *sink, int fd);
+extern int output_end_file(output_sink_t *sink);
+extern int output_sync(output_sink_t *sink);
+extern int output_copy_file(int src_fd, int dst_fd);
+extern int output_spool_begin(output_sink_t *sink);
+extern unsigned long long output_spool_mark(output_sink_t *sink);
+extern int output_spool_replay(output_sink_t *sink, unsigned long long offset, unsigned long long length);
+extern void output_spool_reset(output_sink_t *sink);
+
+#endif
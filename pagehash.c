@@ -0,0 +1,211 @@
+/*
+ * pagehash.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 页面去重用的散列。表单、标签类的任务常有大量字节相同的页面，解码每一行时顺手
+ * 累加散列，一页读完就知道它是否与之前的某一页相同，相同时直接重用已经编码好的
+ * 输出。
+ *
+ * 散列每次读 16 个字节，分两条链各做一次乘法和循环移位；每行结束时两条链互相
+ * 混合一次，所以行的边界和顺序都会影响结果。这不是密码学散列，只用来在同一个
+ * 任务的页面之间比较；128 位下偶然碰撞的概率可以忽略。
+ */
+
+#include "pagehash.h"
+#include "bitmap.h"
+
+#define PAGEHASH_PRIME1     0x9e3779b185ebca87ULL
+#define PAGEHASH_PRIME2     0xc2b2ae3d27d4eb4fULL
+#define PAGEHASH_PRIME3     0x165667b19e3779f9ULL
+
+/*
+ * pagehash_rotl() - 64 位循环左移。
+ */
+static inline uint64_t
+pagehash_rotl(uint64_t value, int bits) {
+    return ( value << bits ) | ( value >> ( 64 - bits ) );
+}
+
+/*
+ * pagehash_mix() - 把一个 64 位值的所有位充分混合（MurmurHash3 的 fmix64）。
+ */
+static inline uint64_t
+pagehash_mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+
+    return value;
+}
+
+/*
+ * pagehash_init() - 开始一页的散列，seed 通常是页头，页头不同的页面不会相同。
+ */
+void
+pagehash_init(
+    pagehash_t          *hash,          /* 输出 - 散列 */
+    const void          *seed,          /* 输入 - 种子数据 */
+    size_t              size            /* 输入 - 种子的字节数 */
+) {
+    hash->h[0] = PAGEHASH_PRIME1;
+    hash->h[1] = PAGEHASH_PRIME2;
+    hash->rows = 0;
+    pagehash_row(hash, seed, size);
+}
+
+/*
+ * pagehash_row() - 累加一行数据。
+ */
+void
+pagehash_row(
+    pagehash_t          *hash,          /* 输入 - 散列 */
+    const void          *row,           /* 输入 - 行数据 */
+    size_t              size            /* 输入 - 字节数 */
+) {
+    const uint8_t       *p = (const uint8_t *) row;
+    uint64_t            a = hash->h[0],
+                        b = hash->h[1],
+                        x, y;
+    size_t              index;
+
+    for ( index = 0; index + 16 <= size; index += 16 ) {
+        memcpy(&x, p + index, 8);
+        memcpy(&y, p + index + 8, 8);
+        a = pagehash_rotl(( a ^ x ) * PAGEHASH_PRIME1, 31);
+        b = pagehash_rotl(( b ^ y ) * PAGEHASH_PRIME2, 29);
+    }
+    if ( index < size ) {
+        /* 不足 16 个字节的尾部补零。 */
+        x = y = 0;
+        memcpy(&x, p + index, ( size - index > 8 )? 8: size - index);
+        if ( size - index > 8 ) {
+            memcpy(&y, p + index + 8, size - index - 8);
+        }
+        a = pagehash_rotl(( a ^ x ) * PAGEHASH_PRIME1, 31);
+        b = pagehash_rotl(( b ^ y ) * PAGEHASH_PRIME2, 29);
+    }
+
+    /* 行尾：混入行长并让两条链互相影响。 */
+    a ^= size * PAGEHASH_PRIME3;
+    hash->h[0] = pagehash_mix(a + b);
+    hash->h[1] = pagehash_mix(b ^ hash->h[0]) + a;
+    hash->rows ++;
+}
+
+/*
+ * pagehash_final() - 得到 128 位的散列值。
+ */
+void
+pagehash_final(
+    const pagehash_t    *hash,          /* 输入 - 散列 */
+    uint64_t            out[2]          /* 输出 - 散列值 */
+) {
+    out[0] = pagehash_mix(hash->h[0] ^ hash->rows);
+    out[1] = pagehash_mix(hash->h[1] + out[0]);
+}
+
+/*
+ * pagehash_table_init() - 初始化页面记录表。
+ */
+void
+pagehash_table_init(
+    pagehash_table_t    *table          /* 输出 - 页面记录表 */
+) {
+    memset(table, 0, sizeof(pagehash_table_t));
+}
+
+/*
+ * pagehash_table_find() - 查找散列相同的第一个页面。
+ */
+const pagehash_entry_t *                /* 输出 - 找到的页面，没有时为 NULL */
+pagehash_table_find(
+    pagehash_table_t    *table,         /* 输入 - 页面记录表 */
+    const uint64_t      hash[2]         /* 输入 - 散列值 */
+) {
+    unsigned            index;
+
+    for ( index = 0; index < table->count; index ++ ) {
+        if ( table->entries[index].hash[0] == hash[0] && table->entries[index].hash[1] == hash[1] ) {
+            table->hits ++;
+            return &(table->entries[index]);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * pagehash_table_add() - 记录一个已输出的页面。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+pagehash_table_add(
+    pagehash_table_t    *table,         /* 输入 - 页面记录表 */
+    const uint64_t      hash[2],        /* 输入 - 散列值 */
+    unsigned long long  offset,         /* 输入 - 在输出记录中的位置 */
+    unsigned long long  length,         /* 输入 - 在输出记录中的长度 */
+    const char          *path           /* 输入 - 输出文件名，可为 NULL */
+) {
+    pagehash_entry_t    *entries;
+
+    if ( table->count == table->alloc ) {
+        if ( ( entries = (pagehash_entry_t *) realloc(
+                table->entries,
+                ( table->alloc + 64 ) * sizeof(pagehash_entry_t)
+        ) ) == NULL ) {
+            return FUNCTION_FAILURE;
+        }
+        table->entries = entries;
+        table->alloc += 64;
+    }
+
+    entries = &(table->entries[table->count]);
+    entries->hash[0] = hash[0];
+    entries->hash[1] = hash[1];
+    entries->offset = offset;
+    entries->length = length;
+    entries->path = ( path != NULL )? strdup(path): NULL;
+    table->count ++;
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * pagehash_table_free() - 释放页面记录表。
+ */
+void
+pagehash_table_free(
+    pagehash_table_t    *table          /* 输入 - 页面记录表 */
+) {
+    unsigned            index;
+
+    for ( index = 0; index < table->count; index ++ ) {
+        free(table->entries[index].path);
+    }
+    free(table->entries);
+    memset(table, 0, sizeof(pagehash_table_t));
+}
@@ -0,0 +1,66 @@
+/*
+ * pagehash.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_PAGEHASH_H
+#define __LEISRASTERFILTER_PAGEHASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * 一页 raster 数据的 128 位散列，在解码时逐行累加。
+ */
+typedef struct {
+    uint64_t    h[2];               /* 两条散列链 */
+    uint64_t    rows;               /* 已累加的行数 */
+} pagehash_t;
+
+/*
+ * 已输出页面的记录，用于查找与之前某一页相同的页面。
+ */
+typedef struct {
+    uint64_t            hash[2];    /* 页面的散列 */
+    unsigned long long  offset,     /* 在输出记录中的位置（写标准输出时） */
+                        length;     /* 在输出记录中的长度 */
+    char                *path;      /* 输出文件名（写文件时），否则为 NULL */
+} pagehash_entry_t;
+
+typedef struct {
+    pagehash_entry_t    *entries;
+    unsigned            count,
+                        alloc;
+    unsigned            hits;       /* 找到相同页面的次数 */
+} pagehash_table_t;
+
+extern void pagehash_init(pagehash_t *hash, const void *seed, size_t size);
+extern void pagehash_row(pagehash_t *hash, const void *row, size_t size);
+extern void pagehash_final(const pagehash_t *hash, uint64_t out[2]);
+extern void pagehash_table_init(pagehash_table_t *table);
+extern const pagehash_entry_t *pagehash_table_find(pagehash_table_t *table, const uint64_t hash[2]);
+extern int pagehash_table_add(pagehash_table_t *table, const uint64_t hash[2], unsigned long long offset, unsigned long long length, const char *path);
+extern void pagehash_table_free(pagehash_table_t *table);
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * pagerange.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * page-ranges 与 page-set 选项。CUPS 只把文件名交给过滤链中的第一个过滤器，
+ * 之后的过滤器读到的是已经选好页面的流，所以只有从文件读入 raster 数据时才用
+ * 这两个选项挑选页面，否则所有页面都输出。
+ */
+
+#include "pagerange.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/*
+ * pagerange_parse_number() - 读一个页号。
+ */
+static int                              /* 输出 - 1 成功，0 不是页号 */
+pagerange_parse_number(
+    const char          **text,         /* 输入 - 当前位置，输出 - 页号之后 */
+    unsigned            *number         /* 输出 - 页号 */
+) {
+    char                *end;
+    unsigned long       value;
+
+    if ( ! isdigit((unsigned char) **text) ) {
+        return 0;
+    }
+    value = strtoul(*text, &end, 10);
+    if ( value == 0 || value > 0x7fffffffUL ) {
+        return 0;
+    }
+    *text = end;
+    *number = (unsigned) value;
+
+    return 1;
+}
+
+/*
+ * pagerange_init() - 按 page-ranges（如 "1-4,7,9-"）和 page-set（odd/even）选项
+ *                    确定要输出的页面。格式不对的选项被忽略。
+ */
+int                                     /* 输出 - 1 只输出部分页面，0 输出所有页面 */
+pagerange_init(
+    pagerange_t         *range,         /* 输出 - 要输出的页面 */
+    int                 num_options,    /* 输入 - 任务选项个数 */
+    cups_option_t       *options        /* 输入 - 任务选项 */
+) {
+    const char          *value, *p;
+    pagerange_span_t    *span;
+
+    memset(range, 0, sizeof(pagerange_t));
+
+    if ( ( value = cupsGetOption("page-set", num_options, options) ) != NULL ) {
+        if ( ! strcasecmp(value, "odd") ) {
+            range->set = PAGERANGE_SET_ODD;
+        } else if ( ! strcasecmp(value, "even") ) {
+            range->set = PAGERANGE_SET_EVEN;
+        } else if ( strcasecmp(value, "all") ) {
+            fprintf(stderr, "DEBUG: Ignoring unknown page-set \"%s\"\n", value);
+        }
+    }
+
+    if ( ( value = cupsGetOption("page-ranges", num_options, options) ) != NULL ) {
+        for ( p = value; *p; ) {
+            if ( range->num_spans == PAGERANGE_MAX_SPANS ) {
+                break;
+            }
+            span = range->spans + range->num_spans;
+
+            /* "n"、"n-m"、"-m"（从第 1 页起）或 "n-"（到最后一页）。 */
+            span->first = 1;
+            span->last = 0;
+            if ( *p != '-' && ! pagerange_parse_number(&p, &(span->first)) ) {
+                break;
+            }
+            if ( *p == '-' ) {
+                p ++;
+                if ( isdigit((unsigned char) *p) && ( ! pagerange_parse_number(&p, &(span->last)) || span->last < span->first ) ) {
+                    break;
+                }
+            } else {
+                span->last = span->first;
+            }
+            range->num_spans ++;
+
+            if ( *p == ',' ) {
+                p ++;
+            } else if ( *p ) {
+                break;
+            }
+        }
+        if ( *p || range->num_spans == 0 ) {
+            fprintf(stderr, "DEBUG: Ignoring malformed page-ranges \"%s\"\n", value);
+            range->num_spans = 0;
+        }
+    }
+
+    return range->num_spans > 0 || range->set != PAGERANGE_SET_ALL;
+}
+
+/*
+ * pagerange_wanted() - 第 page 页（从 1 开始）是否要输出。
+ */
+int                                     /* 输出 - 1 输出，0 跳过 */
+pagerange_wanted(
+    const pagerange_t   *range,         /* 输入 - 要输出的页面 */
+    unsigned            page            /* 输入 - 页号 */
+) {
+    unsigned            index;
+
+    if ( ( range->set == PAGERANGE_SET_ODD && ! ( page & 1 ) ) || ( range->set == PAGERANGE_SET_EVEN && ( page & 1 ) ) ) {
+        return 0;
+    }
+    if ( range->num_spans == 0 ) {
+        return 1;
+    }
+    for ( index = 0; index < range->num_spans; index ++ ) {
+        if ( page >= range->spans[index].first && ( range->spans[index].last == 0 || page <= range->spans[index].last ) ) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * pagerange_done() - 第 page 页之后是否还有要输出的页面，没有时可以不再读入。
+ */
+int                                     /* 输出 - 1 之后没有要输出的页面，0 还有 */
+pagerange_done(
+    const pagerange_t   *range,         /* 输入 - 要输出的页面 */
+    unsigned            page            /* 输入 - 页号 */
+) {
+    unsigned            index;
+
+    if ( range->num_spans == 0 ) {
+        return 0;
+    }
+    for ( index = 0; index < range->num_spans; index ++ ) {
+        if ( range->spans[index].last == 0 || range->spans[index].last > page ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
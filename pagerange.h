@@ -0,0 +1,64 @@
+/*
+ * pagerange.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_PAGERANGE_H
+#define __LEISRASTERFILTER_PAGERANGE_H
+
+#include <cups/cups.h>
+
+#define PAGERANGE_MAX_SPANS     64          /* page-ranges 中最多的范围个数 */
+
+/*
+ * page-set 选项。
+ */
+typedef enum {
+    PAGERANGE_SET_ALL = 0,
+    PAGERANGE_SET_ODD,
+    PAGERANGE_SET_EVEN
+} pagerange_set_t;
+
+/*
+ * page-ranges 中的一个范围，last 为 0 时到最后一页。
+ */
+typedef struct {
+    unsigned    first,
+                last;
+} pagerange_span_t;
+
+/*
+ * 要输出的页面。没有 page-ranges 时 num_spans 为 0，表示所有页面。
+ */
+typedef struct {
+    pagerange_span_t    spans[PAGERANGE_MAX_SPANS];
+    unsigned            num_spans;
+    pagerange_set_t     set;
+} pagerange_t;
+
+extern int pagerange_init(pagerange_t *range, int num_options, cups_option_t *options);
+extern int pagerange_wanted(const pagerange_t *range, unsigned page);
+extern int pagerange_done(const pagerange_t *range, unsigned page);
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * palette.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 调色板优化。商务图表一类的页面往往只用了几种颜色，却按 24 位输出。转换时把
+ * 每行的颜色放进一个开放寻址的散列表（线性探测，最多 256 种颜色，槽数 512），
+ * 一页转换完如果颜色不超过 256 种，就把像素换成调色板下标，输出 8 位 bitmap，
+ * 大小约为原来的 1/3，而且是无损的；超过时马上停止统计，按 24 位输出。
+ */
+
+#include "palette.h"
+
+#define PALETTE_USED    0x01000000U /* 标记槽已被占用，黑色 (0x000000) 也能放进表中 */
+
+/*
+ * palette_key() - 像素的颜色。
+ */
+static inline uint32_t
+palette_key(
+    const bitmap_24bit_pixel    *pixel
+) {
+    const uint8_t       *p = (const uint8_t *) pixel;
+
+    return ( (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 ) | PALETTE_USED;
+}
+
+/*
+ * palette_slot() - 查找颜色所在的槽，不在表中时返回应该放入的空槽。
+ */
+static inline unsigned
+palette_slot(
+    const palette_t     *palette,
+    uint32_t            key
+) {
+    unsigned            slot = ( key * 0x9e3779b1U ) >> ( 32 - 9 );
+
+    while ( palette->keys[slot] != 0 && palette->keys[slot] != key ) {
+        slot = ( slot + 1 ) & ( PALETTE_SLOTS - 1 );
+    }
+
+    return slot;
+}
+
+/*
+ * palette_reset() - 开始统计新的一页。
+ */
+void
+palette_reset(
+    palette_t           *palette        /* 输出 - 颜色统计 */
+) {
+    memset(palette, 0, sizeof(palette_t));
+}
+
+/*
+ * palette_add() - 统计一段像素的颜色。
+ */
+int                                     /* 输出 - 1 仍不超过 256 种颜色，0 已超过 */
+palette_add(
+    palette_t                   *palette,   /* 输入 - 颜色统计 */
+    const bitmap_24bit_pixel    *pixels,    /* 输入 - 像素 */
+    size_t                      count       /* 输入 - 像素个数 */
+) {
+    const uint8_t       *p;
+    bitmap_palette      *entry;
+    uint32_t            key;
+    unsigned            slot;
+    size_t              index;
+
+    if ( palette->overflow ) {
+        return 0;
+    }
+
+    for ( index = 0; index < count; index ++ ) {
+        key = palette_key(&(pixels[index]));
+        if ( key == palette->last_key ) {
+            continue;
+        }
+        palette->last_key = key;
+
+        slot = palette_slot(palette, key);
+        if ( palette->keys[slot] == key ) {
+            continue;
+        }
+
+        if ( palette->count == 0x100 ) {
+            palette->overflow = 1;
+            return 0;
+        }
+
+        p = (const uint8_t *) &(pixels[index]);
+        entry = &(palette->palette.indexes[palette->count]);
+        entry->bp_blue = p[0];
+        entry->bp_green = p[1];
+        entry->bp_red = p[2];
+        entry->bp_reserved = 0;
+
+        palette->keys[slot] = key;
+        palette->slots[slot] = (uint8_t) palette->count;
+        palette->count ++;
+    }
+
+    return 1;
+}
+
+/*
+ * palette_index_page() - 把像素阵原地换成调色板下标。像素阵中的颜色必须都已经
+ *                        用 palette_add() 统计过，且不超过 256 种。
+ */
+bitmap_8bit_pixel *                     /* 输出 - 8 位像素阵（与输入同一块内存） */
+palette_index_page(
+    palette_t           *palette,       /* 输入 - 颜色统计 */
+    bitmap_24bit_pixel  *pixels,        /* 输入 - 像素阵 */
+    size_t              count           /* 输入 - 像素个数 */
+) {
+    uint8_t             *dst = (uint8_t *) pixels;
+    uint32_t            key,
+                        last_key = 0;
+    uint8_t             last_index = 0;
+    size_t              index;
+
+    for ( index = 0; index < count; index ++ ) {
+        /* dst[index] 只会覆盖已经读过的像素。 */
+        key = palette_key(&(pixels[index]));
+        if ( key != last_key ) {
+            last_key = key;
+            last_index = palette->slots[palette_slot(palette, key)];
+        }
+        dst[index] = last_index;
+    }
+
+    return (bitmap_8bit_pixel *) pixels;
+}
@@ -0,0 +1,51 @@
+/*
+ * palette.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_PALETTE_H
+#define __LEISRASTERFILTER_PALETTE_H
+
+#include "bitmap.h"
+
+#define PALETTE_SLOTS   512         /* 散列表的槽数，至少是最大颜色数的 2 倍 */
+
+/*
+ * 一页彩色像素的颜色统计。不超过 256 种颜色时，页面可以无损地输出为带调色板的
+ * 8 位 bitmap。
+ */
+typedef struct {
+    uint32_t            keys[PALETTE_SLOTS];    /* 颜色（0xRRGGBB | PALETTE_USED），0 为空槽 */
+    uint8_t             slots[PALETTE_SLOTS];   /* 颜色在调色板中的下标 */
+    bitmap_8bit_palette palette;                /* 按颜色出现顺序排列的调色板 */
+    unsigned            count;                  /* 颜色数 */
+    int                 overflow;               /* 超过 256 种颜色后为 1 */
+    uint32_t            last_key;               /* 上一个像素的颜色，连续相同的像素不查表 */
+} palette_t;
+
+extern void palette_reset(palette_t *palette);
+extern int palette_add(palette_t *palette, const bitmap_24bit_pixel *pixels, size_t count);
+extern bitmap_8bit_pixel *palette_index_page(palette_t *palette, bitmap_24bit_pixel *pixels, size_t count);
+
+#endif
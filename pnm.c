@@ -0,0 +1,201 @@
+/*
+ * pnm.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * PGM/PPM/PAM 直通输出。这几种格式的像素行从上到下排列，16 位样本按大端序
+ * 存储，所以 raster 解码出的行不需要上下翻转，也不需要降到 8 位：
+ *
+ * 1. 8 位的行原样写出。
+ * 2. 16 位的行只做一次字节序交换（libcups 解码后为本机字节序），用 GCC 向量
+ *    扩展一次交换 8 个样本。
+ */
+
+#include "pnm.h"
+
+/* 一次处理 8 个 16 位样本的向量类型（GCC 向量扩展）。 */
+typedef uint16_t pnm_v8hu __attribute__ ((vector_size (16)));
+
+/*
+ * output_format_from_job() - 由 bitmap-format 选项得到输出格式。
+ */
+output_format_t                         /* 输出 - 输出格式 */
+output_format_from_job(
+    bitmap_job_data_t   *job            /* 输入 - 任务数据 */
+) {
+    const char          *value = cupsGetOption("bitmap-format", job->num_options, job->options);
+
+    if ( value == NULL ) {
+        return OUTPUT_FORMAT_BMP;
+    } else if ( !strcasecmp(value, "pnm") || !strcasecmp(value, "pgm") || !strcasecmp(value, "ppm") ) {
+        return OUTPUT_FORMAT_PNM;
+    } else if ( !strcasecmp(value, "pam") ) {
+        return OUTPUT_FORMAT_PAM;
+    } else if ( !strcasecmp(value, "raster") || !strcasecmp(value, "cups-raster") ) {
+        return OUTPUT_FORMAT_RASTER;
+    } else if ( !strcasecmp(value, "pwg") || !strcasecmp(value, "pwg-raster") ) {
+        return OUTPUT_FORMAT_PWG;
+    }
+
+    return OUTPUT_FORMAT_BMP;
+}
+
+/*
+ * pnm_extension() - 输出文件的扩展名。
+ */
+const char *                            /* 输出 - 扩展名（不含 "."） */
+pnm_extension(
+    output_format_t     format,         /* 输入 - 输出格式 */
+    cups_page_header2_t *header         /* 输入 - 页头 */
+) {
+    switch ( format ) {
+        case OUTPUT_FORMAT_PNM:
+            return ( header->cupsColorSpace == CUPS_CSPACE_W )? "pgm": "ppm";
+        case OUTPUT_FORMAT_PAM:
+            return "pam";
+        case OUTPUT_FORMAT_RASTER:
+            return "ras";
+        case OUTPUT_FORMAT_PWG:
+            return "pwg";
+        default:
+            return "bmp";
+    }
+}
+
+/*
+ * pnm_write_header() - 写出一页的 PNM/PAM 头部。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+pnm_write_header(
+    output_format_t     format,         /* 输入 - 输出格式 */
+    cups_page_header2_t *header,        /* 输入 - 页头 */
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    const int           gray = ( header->cupsColorSpace == CUPS_CSPACE_W );
+    const unsigned      maxval = ( header->cupsBitsPerColor == 16 )? 65535: 255;
+    char                text[160];
+    int                 length;
+
+    if ( format == OUTPUT_FORMAT_PAM ) {
+        length = snprintf(text, sizeof(text), "P7\nWIDTH %u\nHEIGHT %u\nDEPTH %u\nMAXVAL %u\nTUPLTYPE %s\nENDHDR\n",
+            header->cupsWidth, header->cupsHeight, gray? 1: 3, maxval,
+            gray? "GRAYSCALE": "RGB");
+    } else {
+        length = snprintf(text, sizeof(text), "P%c\n%u %u\n%u\n", gray? '5': '6',
+            header->cupsWidth, header->cupsHeight, maxval);
+    }
+
+    return length > 0 && output_write(sink, text, (size_t) length);
+}
+
+/*
+ * pnm_write_row() - 写出一行像素，直接写进输出缓冲段。scratch 在一行比缓冲段
+ *                   还长时作为中转，至少要有 cupsBytesPerLine 个字节。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+pnm_write_row(
+    cups_page_header2_t *header,        /* 输入 - 页头 */
+    const unsigned char *line,          /* 输入 - 解码后的 raster 行 */
+    uint8_t             *scratch,       /* 输入 - 临时行 */
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    const size_t        row_bytes = (size_t) header->cupsWidth
+                                  * ( ( header->cupsColorSpace == CUPS_CSPACE_W )? 1: 3 )
+                                  * ( header->cupsBitsPerColor / 8 );
+    uint8_t             *out = output_reserve(sink, row_bytes);
+    uint8_t             *dst = ( out != NULL )? out: scratch;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    size_t              index;
+    pnm_v8hu            v;
+
+    if ( header->cupsBitsPerColor == 16 ) {
+        for ( index = 0; index + sizeof(v) <= row_bytes; index += sizeof(v) ) {
+            memcpy(&v, line + index, sizeof(v));
+            v = ( v << 8 ) | ( v >> 8 );
+            memcpy(dst + index, &v, sizeof(v));
+        }
+        for ( ; index + 1 < row_bytes; index += 2 ) {
+            dst[index] = line[index + 1];
+            dst[index + 1] = line[index];
+        }
+    } else
+#endif
+    memcpy(dst, line, row_bytes);
+
+    if ( out == NULL ) {
+        return output_write(sink, scratch, row_bytes);
+    }
+    output_commit(sink, row_bytes);
+
+    return ( ! sink->failed );
+}
+
+/*
+ * pnm_write_page() - 逐行读出一页 raster 数据并直接写出，不需要页缓冲。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+pnm_write_page(
+    cups_raster_t       *ras,           /* 输入 - raster 流 */
+    cups_page_header2_t *header,        /* 输入 - 页头 */
+    output_format_t     format,         /* 输入 - 输出格式 */
+    output_sink_t       *sink,          /* 输入 - 输出流 */
+    const int           *cancel         /* 输入 - 任务取消标志 */
+) {
+    unsigned char       *line;
+    uint8_t             *scratch;
+    unsigned            y;
+    int                 failure = FUNCTION_SUCCESS;
+
+    if ( ! pnm_write_header(format, header, sink) ) {
+        return FUNCTION_FAILURE;
+    }
+
+    line = (unsigned char *) malloc(header->cupsBytesPerLine);
+    scratch = (uint8_t *) malloc(header->cupsBytesPerLine);
+    if ( line == NULL || scratch == NULL ) {
+        log_error("Error", "Unable to allocate line memory!");
+        free(line);
+        free(scratch);
+        return FUNCTION_FAILURE;
+    }
+
+    for ( y = 0; y < header->cupsHeight; y ++ ) {
+        if ( *cancel ) {
+            break;
+        }
+        if (
+            cupsRasterReadPixels(ras, line, header->cupsBytesPerLine) == 0 ||
+            ! pnm_write_row(header, line, scratch, sink)
+        ) {
+            failure = FUNCTION_FAILURE;
+            break;
+        }
+    }
+
+    free(line);
+    free(scratch);
+
+    return failure;
+}
@@ -0,0 +1,53 @@
+/*
+ * pnm.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_PNM_H
+#define __LEISRASTERFILTER_PNM_H
+
+#include "bitmap.h"
+#include <cups/raster.h>
+
+/*
+ * 输出格式。
+ */
+typedef enum {
+    OUTPUT_FORMAT_BMP = 0,      /* bitmap，8 位灰度或 24 位彩色 */
+    OUTPUT_FORMAT_PNM,          /* PGM (P5) 或 PPM (P6) */
+    OUTPUT_FORMAT_PAM,          /* PAM (P7) */
+    OUTPUT_FORMAT_RASTER,       /* CUPS raster v2（压缩） */
+    OUTPUT_FORMAT_PWG           /* PWG raster */
+} output_format_t;
+
+/* 是否经过页缓冲转换（bitmap 和 raster），否则为逐行直通输出。 */
+#define OUTPUT_FORMAT_CONVERTS(format)  ( (format) == OUTPUT_FORMAT_BMP || (format) >= OUTPUT_FORMAT_RASTER )
+
+extern output_format_t output_format_from_job(bitmap_job_data_t *job);
+extern const char *pnm_extension(output_format_t format, cups_page_header2_t *header);
+extern int pnm_write_header(output_format_t format, cups_page_header2_t *header, output_sink_t *sink);
+extern int pnm_write_row(cups_page_header2_t *header, const unsigned char *line, uint8_t *scratch, output_sink_t *sink);
+extern int pnm_write_page(cups_raster_t *ras, cups_page_header2_t *header, output_format_t format, output_sink_t *sink, const int *cancel);
+
+#endif
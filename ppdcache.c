@@ -0,0 +1,380 @@
+/*
+ * ppdcache.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * PPD 缓存。每个任务都 ppdOpenFile() 一次，大的厂商 PPD 要在读第一个 raster 字节
+ * 之前解析几十毫秒。这里把过滤器用到的部分（属性）存成紧凑的二进制文件，以 PPD
+ * 的路径、大小和修改时间为键；之后的任务直接 mmap() 这个文件，键不一致时自动
+ * 重新生成。过滤器不读取选中的选项，所以也不再标记任务选项。
+ *
+ * 缓存文件放在 $LEISRASTERFILTER_PPD_CACHE、$TMPDIR 或 /tmp 中，文件名取 PPD 路径
+ * 的散列值，由 cachefile.c 读写：只接受自己所有、其他用户不可写的缓存文件，先写
+ * 临时文件再 rename()。映射之后再检查文件中的每个偏移都落在字符串区内。
+ */
+
+#define _GNU_SOURCE
+
+#include "ppdcache.h"
+#include "cachefile.h"
+#include <cups/ppd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * 生成缓存时用到的临时数据。
+ */
+typedef struct {
+    const char  *name,
+                *spec,
+                *value;
+    int         order;              /* 在 PPD 中的顺序，同名同规格的属性保持原来的先后 */
+} ppdcache_build_attr_t;
+
+typedef struct {
+    char        *data;
+    size_t      size,
+                alloc;
+} ppdcache_pool_t;
+
+/*
+ * ppdcache_pool_add() - 向字符串区追加一个字符串。
+ */
+static int                              /* 输出 - 1 成功，0 内存不足 */
+ppdcache_pool_add(
+    ppdcache_pool_t     *pool,          /* 输入 - 字符串区 */
+    const char          *text,          /* 输入 - 字符串，可为 NULL */
+    uint32_t            *offset         /* 输出 - 字符串的偏移 */
+) {
+    const size_t        length = ( text != NULL )? strlen(text) + 1: 1;
+    size_t              alloc;
+    char                *data;
+
+    if ( pool->size + length > pool->alloc ) {
+        alloc = ( pool->alloc + length ) * 2;
+        if ( ( data = (char *) realloc(pool->data, alloc) ) == NULL ) {
+            return 0;
+        }
+        pool->data = data;
+        pool->alloc = alloc;
+    }
+
+    memcpy(pool->data + pool->size, ( text != NULL )? text: "", length);
+    *offset = (uint32_t) pool->size;
+    pool->size += length;
+
+    return 1;
+}
+
+static int
+ppdcache_compare_build_attr(const void *a, const void *b) {
+    const ppdcache_build_attr_t *x = (const ppdcache_build_attr_t *) a,
+                                *y = (const ppdcache_build_attr_t *) b;
+    int                         result;
+
+    if ( ( result = strcmp(x->name, y->name) ) != 0 || ( result = strcmp(x->spec, y->spec) ) != 0 ) {
+        return result;
+    }
+
+    return x->order - y->order;
+}
+
+/*
+ * ppdcache_path() - 缓存文件的路径：缓存目录 + PPD 路径的 FNV-1a 散列。
+ */
+static void
+ppdcache_path(
+    const char          *ppd_path,      /* 输入 - PPD 文件路径 */
+    char                *buffer,        /* 输出 - 缓存文件路径 */
+    size_t              size            /* 输入 - buffer 的大小 */
+) {
+    const char          *dir;
+    uint64_t            hash = 0xcbf29ce484222325ULL;
+    const unsigned char *p;
+
+    if ( ( dir = getenv(PPDCACHE_DIR_ENV) ) == NULL && ( dir = getenv("TMPDIR") ) == NULL ) {
+        dir = "/tmp";
+    }
+    for ( p = (const unsigned char *) ppd_path; *p; p ++ ) {
+        hash = ( hash ^ *p ) * 0x100000001b3ULL;
+    }
+
+    snprintf(buffer, size, "%s/leisrasterfilter-ppd-%016llx.cache", dir, (unsigned long long) hash);
+}
+
+/*
+ * ppdcache_build() - 解析 PPD 文件，生成缓存文件的内容。
+ */
+static void *                           /* 输出 - 缓存文件的内容（malloc），失败时为 NULL */
+ppdcache_build(
+    const char          *ppd_path,      /* 输入 - PPD 文件路径 */
+    const struct stat   *st,            /* 输入 - PPD 文件的状态 */
+    size_t              *image_size     /* 输出 - 内容的大小 */
+) {
+    ppd_file_t          *ppd;
+    ppdcache_build_attr_t   *attrs = NULL;
+    ppdcache_pool_t     pool = { NULL, 0, 0 };
+    ppdcache_header_t   header;
+    ppdcache_attr_t     *out_attrs;
+    uint8_t             *image = NULL,
+                        *resized;
+    int                 attr;
+
+    if ( ( ppd = ppdOpenFile(ppd_path) ) == NULL ) {
+        return NULL;
+    }
+
+    if ( ( attrs = (ppdcache_build_attr_t *) calloc(ppd->num_attrs + 1, sizeof(ppdcache_build_attr_t)) ) == NULL ) {
+        goto done;
+    }
+
+    for ( attr = 0; attr < ppd->num_attrs; attr ++ ) {
+        attrs[attr].name = ppd->attrs[attr]->name;
+        attrs[attr].spec = ppd->attrs[attr]->spec;
+        attrs[attr].value = ( ppd->attrs[attr]->value != NULL )? ppd->attrs[attr]->value: "";
+        attrs[attr].order = attr;
+    }
+    qsort(attrs, ppd->num_attrs, sizeof(ppdcache_build_attr_t), ppdcache_compare_build_attr);
+
+    /* 布局：头部、属性表、字符串区。 */
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PPDCACHE_MAGIC, sizeof(PPDCACHE_MAGIC));
+    header.version = PPDCACHE_VERSION;
+    header.ppd_size = (uint64_t) st->st_size;
+    header.ppd_mtime_sec = (int64_t) st->st_mtim.tv_sec;
+    header.ppd_mtime_nsec = (int64_t) st->st_mtim.tv_nsec;
+    header.num_attrs = (uint32_t) ppd->num_attrs;
+    header.attrs_offset = sizeof(ppdcache_header_t);
+    header.strings_offset = header.attrs_offset + ppd->num_attrs * sizeof(ppdcache_attr_t);
+
+    if ( ( image = (uint8_t *) calloc(1, header.strings_offset) ) == NULL ) {
+        goto done;
+    }
+    out_attrs = (ppdcache_attr_t *) ( image + header.attrs_offset );
+
+    if ( ! ppdcache_pool_add(&pool, ppd_path, &header.path) ) {
+        goto fail;
+    }
+    for ( attr = 0; attr < ppd->num_attrs; attr ++ ) {
+        if ( ! (
+            ppdcache_pool_add(&pool, attrs[attr].name, &out_attrs[attr].name)
+            && ppdcache_pool_add(&pool, attrs[attr].spec, &out_attrs[attr].spec)
+            && ppdcache_pool_add(&pool, attrs[attr].value, &out_attrs[attr].value)
+        ) ) {
+            goto fail;
+        }
+    }
+
+    header.strings_size = (uint32_t) pool.size;
+    header.file_size = header.strings_offset + header.strings_size;
+    if ( ( resized = (uint8_t *) realloc(image, header.file_size) ) == NULL ) {
+        goto fail;
+    }
+    image = resized;
+    memcpy(image, &header, sizeof(header));
+    memcpy(image + header.strings_offset, pool.data, pool.size);
+    *image_size = header.file_size;
+    goto done;
+
+fail:
+    free(image);
+    image = NULL;
+
+done:
+    free(attrs);
+    free(pool.data);
+    ppdClose(ppd);
+
+    return image;
+}
+
+/*
+ * ppdcache_valid() - 检查缓存内容是否完整，且与 PPD 文件的路径、大小和修改时间一致。
+ *                    字符串区以 '\0' 结尾，偏移都小于 strings_size 时每个字符串都
+ *                    不会读出字符串区。
+ */
+static int                              /* 输出 - 1 有效，0 无效 */
+ppdcache_valid(
+    const void          *image,         /* 输入 - 缓存内容 */
+    size_t              size,           /* 输入 - 内容的大小 */
+    const char          *ppd_path,      /* 输入 - PPD 文件路径 */
+    const struct stat   *st             /* 输入 - PPD 文件的状态 */
+) {
+    const ppdcache_header_t *header = (const ppdcache_header_t *) image;
+    const ppdcache_attr_t   *attrs;
+    uint32_t            index;
+
+    if ( size < sizeof(ppdcache_header_t) ) {
+        return 0;
+    }
+
+    if ( ! (
+        memcmp(header->magic, PPDCACHE_MAGIC, sizeof(PPDCACHE_MAGIC)) == 0
+        && header->version == PPDCACHE_VERSION
+        && header->file_size == size
+        && header->ppd_size == (uint64_t) st->st_size
+        && header->ppd_mtime_sec == (int64_t) st->st_mtim.tv_sec
+        && header->ppd_mtime_nsec == (int64_t) st->st_mtim.tv_nsec
+        && header->attrs_offset == sizeof(ppdcache_header_t)
+        && header->strings_offset == header->attrs_offset + (uint64_t) header->num_attrs * sizeof(ppdcache_attr_t)
+        && (uint64_t) header->strings_offset + header->strings_size == size
+        && header->strings_size > 0
+        && ( (const char *) image )[size - 1] == '\0'
+        && header->path < header->strings_size
+        && strcmp((const char *) image + header->strings_offset + header->path, ppd_path) == 0
+    ) ) {
+        return 0;
+    }
+
+    attrs = (const ppdcache_attr_t *) ( (const uint8_t *) image + header->attrs_offset );
+    for ( index = 0; index < header->num_attrs; index ++ ) {
+        if (
+            attrs[index].name >= header->strings_size
+            || attrs[index].spec >= header->strings_size
+            || attrs[index].value >= header->strings_size
+        ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * ppdcache_open() - 打开 PPD 文件的缓存，缓存缺失或过期时解析 PPD 并重新生成。
+ */
+ppdcache_t *                            /* 输出 - 缓存，PPD 无法读取时为 NULL */
+ppdcache_open(
+    const char          *ppd_path       /* 输入 - PPD 文件路径 */
+) {
+    ppdcache_t          *cache;
+    struct stat         st;
+    char                cache_path[1024];
+    void                *image = MAP_FAILED;
+    size_t              size = 0;
+
+    if ( ppd_path == NULL || stat(ppd_path, &st) != 0 ) {
+        return NULL;
+    }
+    if ( ( cache = (ppdcache_t *) calloc(1, sizeof(ppdcache_t)) ) == NULL ) {
+        return NULL;
+    }
+
+    /* 先试着映射已有的缓存。 */
+    ppdcache_path(ppd_path, cache_path, sizeof(cache_path));
+    image = cachefile_map(cache_path, &size);
+
+    if ( image != MAP_FAILED && ppdcache_valid(image, size, ppd_path, &st) ) {
+        cache->map = image;
+        cache->map_size = size;
+    } else {
+        /* 缺失或过期，重新生成；写不了缓存文件时直接使用内存中的内容。 */
+        if ( image != MAP_FAILED ) {
+            munmap(image, size);
+        }
+        if ( ( image = ppdcache_build(ppd_path, &st, &size) ) == NULL ) {
+            free(cache);
+            return NULL;
+        }
+        cachefile_write(cache_path, image, size);
+        cache->map = image;
+        cache->map_size = 0;
+        cache->rebuilt = 1;
+    }
+
+    cache->header = (const ppdcache_header_t *) cache->map;
+    cache->attrs = (const ppdcache_attr_t *) ( (const uint8_t *) cache->map + cache->header->attrs_offset );
+    cache->strings = (const char *) cache->map + cache->header->strings_offset;
+
+    return cache;
+}
+
+/*
+ * ppdcache_attr() - 取一个属性的值。spec 为 NULL 时取这个名称的第一个属性。
+ */
+const char *                            /* 输出 - 属性值，没有时为 NULL */
+ppdcache_attr(
+    const ppdcache_t    *cache,         /* 输入 - 缓存 */
+    const char          *name,          /* 输入 - 属性名称 */
+    const char          *spec           /* 输入 - 属性规格，可为 NULL */
+) {
+    unsigned            low = 0,
+                        high,
+                        middle;
+    int                 result;
+    const ppdcache_attr_t   *attr;
+
+    if ( cache == NULL ) {
+        return NULL;
+    }
+
+    /* 找到第一个不小于 (name, spec) 的属性。 */
+    for ( high = cache->header->num_attrs; low < high; ) {
+        middle = ( low + high ) / 2;
+        attr = &(cache->attrs[middle]);
+        if (
+            ( result = strcmp(cache->strings + attr->name, name) ) < 0 ||
+            ( result == 0 && spec != NULL && strcmp(cache->strings + attr->spec, spec) < 0 )
+        ) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if ( low >= cache->header->num_attrs ) {
+        return NULL;
+    }
+    attr = &(cache->attrs[low]);
+    if ( strcmp(cache->strings + attr->name, name) != 0 || ( spec != NULL && strcmp(cache->strings + attr->spec, spec) != 0 ) ) {
+        return NULL;
+    }
+
+    return cache->strings + attr->value;
+}
+
+/*
+ * ppdcache_close() - 关闭缓存。
+ */
+void
+ppdcache_close(
+    ppdcache_t          *cache          /* 输入 - 缓存 */
+) {
+    if ( cache == NULL ) {
+        return;
+    }
+
+    if ( cache->map_size > 0 ) {
+        munmap(cache->map, cache->map_size);
+    } else {
+        free(cache->map);
+    }
+    free(cache);
+}
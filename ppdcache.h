@@ -0,0 +1,79 @@
+/*
+ * ppdcache.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_PPDCACHE_H
+#define __LEISRASTERFILTER_PPDCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PPDCACHE_MAGIC          "LRFPPDC"   /* 缓存文件标识 */
+#define PPDCACHE_VERSION        2           /* 缓存格式版本，格式变化时加 1 */
+#define PPDCACHE_DIR_ENV        "LEISRASTERFILTER_PPD_CACHE"    /* 指定缓存目录的环境变量 */
+
+/*
+ * 缓存文件头部。文件中的字符串都以相对字符串区开头的偏移表示。
+ */
+typedef struct {
+    char        magic[8];           /* PPDCACHE_MAGIC */
+    uint32_t    version,            /* PPDCACHE_VERSION */
+                file_size;          /* 整个缓存文件的大小 */
+    uint64_t    ppd_size;           /* PPD 文件的大小 */
+    int64_t     ppd_mtime_sec,      /* PPD 文件的修改时间 */
+                ppd_mtime_nsec;
+    uint32_t    path,               /* PPD 文件的路径 */
+                num_attrs,          /* 属性个数 */
+                attrs_offset,       /* 属性表在文件中的位置，按名称、规格排序 */
+                strings_offset,     /* 字符串区在文件中的位置 */
+                strings_size;       /* 字符串区的大小 */
+} ppdcache_header_t;
+
+/*
+ * 缓存中的一个属性。
+ */
+typedef struct {
+    uint32_t    name,               /* 名称 */
+                spec,               /* 规格 */
+                value;              /* 值 */
+} ppdcache_attr_t;
+
+/*
+ * 打开的 PPD 缓存。
+ */
+typedef struct {
+    void                    *map;       /* 映射的缓存文件；map_size 为 0 时是 malloc() 得到的内容 */
+    size_t                  map_size;
+    const ppdcache_header_t *header;
+    const ppdcache_attr_t   *attrs;
+    const char              *strings;
+    int                     rebuilt;    /* 本次是否重新生成了缓存 */
+} ppdcache_t;
+
+extern ppdcache_t *ppdcache_open(const char *ppd_path);
+extern const char *ppdcache_attr(const ppdcache_t *cache, const char *name, const char *spec);
+extern void ppdcache_close(ppdcache_t *cache);
+
+#endif
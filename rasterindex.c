@@ -0,0 +1,604 @@
+/*
+ * rasterindex.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * raster 文件的页索引。输入是普通文件时，把文件整个 mmap()，扫描一遍页头，记下
+ * 每页页头和像素数据的位置；v2（压缩）流另外每隔 RASTERINDEX_MARK_ROWS 行记一个
+ * 行记录的检查点。有了索引，页头和像素行都可以直接从映射中取：
+ *
+ * 1. v3（不压缩）的行就在映射里，不用复制。
+ * 2. v2 的行从最近的检查点开始解码，不同线程可以同时解码同一页的不同段，
+ *    也可以直接跳到任意一页。
+ *
+ * 扫描 v2 流要走一遍所有行记录，索引因此存成索引文件，以 raster 文件的路径、
+ * 大小和修改时间为键，重打归档的 raster 文件时不用再扫描。索引文件放在
+ * $LEISRASTERFILTER_RASTER_INDEX、$TMPDIR 或 /tmp 中，由 cachefile.c 读写：只用自己
+ * 所有、其他用户不可写的索引文件，先写临时文件再 rename()。
+ *
+ * 只支持本机字节序的 v2/v3 流，其他流（v1、字节序相反的流、PWG raster）打开失败，
+ * 由调用者改用 libcups 顺序读入。
+ */
+
+#define _GNU_SOURCE
+
+#include "rasterindex.h"
+#include "cachefile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * 扫描时用到的可增长数组。
+ */
+typedef struct {
+    void        *data;
+    size_t      count,
+                alloc,
+                item_size;
+} rasterindex_array_t;
+
+/*
+ * rasterindex_array_add() - 向数组追加一项。
+ */
+static void *                           /* 输出 - 新的一项，内存不足时为 NULL */
+rasterindex_array_add(
+    rasterindex_array_t *array          /* 输入 - 数组 */
+) {
+    void                *data;
+    size_t              alloc;
+
+    if ( array->count == array->alloc ) {
+        alloc = ( array->alloc > 0 )? array->alloc * 2: 64;
+        if ( ( data = realloc(array->data, alloc * array->item_size) ) == NULL ) {
+            return NULL;
+        }
+        array->data = data;
+        array->alloc = alloc;
+    }
+
+    return (uint8_t *) array->data + array->item_size * array->count ++;
+}
+
+/*
+ * rasterindex_path() - 索引文件的路径：索引目录 + raster 路径的 FNV-1a 散列。
+ */
+static uint64_t                         /* 输出 - raster 路径的散列 */
+rasterindex_path(
+    const char          *raster_path,   /* 输入 - raster 文件路径 */
+    char                *buffer,        /* 输出 - 索引文件路径 */
+    size_t              size            /* 输入 - buffer 的大小 */
+) {
+    const char          *dir;
+    uint64_t            hash = 0xcbf29ce484222325ULL;
+    const unsigned char *p;
+
+    if ( ( dir = getenv(RASTERINDEX_DIR_ENV) ) == NULL && ( dir = getenv("TMPDIR") ) == NULL ) {
+        dir = "/tmp";
+    }
+    for ( p = (const unsigned char *) raster_path; *p; p ++ ) {
+        hash = ( hash ^ *p ) * 0x100000001b3ULL;
+    }
+
+    snprintf(buffer, size, "%s/leisrasterfilter-index-%016llx.index", dir, (unsigned long long) hash);
+
+    return hash;
+}
+
+/*
+ * rasterindex_header_valid() - 按 libcups 的规则检查页头，并算出行记录中像素的字节数。
+ */
+static int                              /* 输出 - 1 有效，0 无效 */
+rasterindex_header_valid(
+    const cups_page_header2_t   *header,    /* 输入 - 页头 */
+    unsigned                    *bpp        /* 输出 - 每像素（或每颜色分量）的字节数 */
+) {
+    if ( header->cupsBitsPerPixel > 240 || header->cupsBitsPerColor > 16
+            || header->cupsBytesPerLine == 0 || header->cupsHeight == 0 ) {
+        return 0;
+    }
+
+    /* 只有逐像素排列的页面可以按行直接定位，这也是过滤器唯一支持的排列。 */
+    if ( header->cupsColorOrder != CUPS_ORDER_CHUNKED ) {
+        return 0;
+    }
+    *bpp = ( header->cupsBitsPerPixel + 7 ) / 8;
+
+    return *bpp > 0
+        && header->cupsBytesPerLine % *bpp == 0
+        && header->cupsBytesPerLine == ( (uint64_t) header->cupsWidth * header->cupsBitsPerPixel + 7 ) / 8;
+}
+
+/*
+ * rasterindex_parse_line() - 走过一条 v2 行记录，line 不为 NULL 时顺便解码。
+ */
+static int                              /* 输出 - 1 成功，0 记录不完整 */
+rasterindex_parse_line(
+    const uint8_t       *p,             /* 输入 - 行记录 */
+    const uint8_t       *end,           /* 输入 - 可用数据的末尾 */
+    unsigned            bytes,          /* 输入 - 每行的字节数 */
+    unsigned            bpp,            /* 输入 - 每像素的字节数 */
+    unsigned char       *line,          /* 输出 - 解码后的行，可为 NULL */
+    unsigned            *repeat,        /* 输出 - 这一行用几次 */
+    const uint8_t       **next          /* 输出 - 下一条行记录 */
+) {
+    unsigned            offset = 0,
+                        count,
+                        index;
+
+    if ( p >= end ) {
+        return 0;
+    }
+    *repeat = (unsigned) *p ++ + 1;
+
+    while ( offset < bytes ) {
+        if ( p >= end ) {
+            return 0;
+        }
+        if ( *p & 128 ) {
+            /* 257 - n 个不同的像素。 */
+            count = ( 257 - (unsigned) *p ++ ) * bpp;
+            if ( count > bytes - offset ) {
+                count = bytes - offset;
+            }
+            if ( (size_t) ( end - p ) < count ) {
+                return 0;
+            }
+            if ( line != NULL ) {
+                memcpy(line + offset, p, count);
+            }
+            p += count;
+        } else {
+            /* 一个像素重复 n + 1 次。 */
+            count = ( (unsigned) *p ++ + 1 ) * bpp;
+            if ( count > bytes - offset ) {
+                count = bytes - offset;
+            }
+            if ( (size_t) ( end - p ) < bpp ) {
+                return 0;
+            }
+            if ( line != NULL ) {
+                memcpy(line + offset, p, bpp);
+                for ( index = bpp; index < count; index ++ ) {
+                    line[offset + index] = line[offset + index - bpp];
+                }
+            }
+            p += bpp;
+        }
+        offset += count;
+    }
+
+    *next = p;
+    return 1;
+}
+
+/*
+ * rasterindex_scan() - 扫描映射的 raster 文件，生成索引内容。
+ */
+static void *                           /* 输出 - 索引内容（malloc），不支持的流为 NULL */
+rasterindex_scan(
+    const uint8_t       *map,           /* 输入 - 映射的 raster 文件 */
+    size_t              map_size,       /* 输入 - 文件大小 */
+    size_t              *size           /* 输出 - 索引内容的大小 */
+) {
+    rasterindex_array_t pages = { NULL, 0, 0, sizeof(rasterindex_page_t) },
+                        marks = { NULL, 0, 0, sizeof(rasterindex_mark_t) };
+    rasterindex_header_t    header;
+    rasterindex_page_t  *page;
+    rasterindex_mark_t  *mark;
+    cups_page_header2_t page_header;
+    const uint8_t       *p, *next,
+                        *end = map + map_size;
+    unsigned            version,
+                        bpp,
+                        row,
+                        repeat,
+                        used;
+    uint64_t            rows;
+    void                *image = NULL;
+    int                 truncated = 0;
+
+    /* 只接受本机字节序的 v2/v3 流。 */
+    if ( map_size < 4 ) {
+        return NULL;
+    }
+    if ( *(const uint32_t *) map == CUPS_RASTER_SYNC ) {
+        version = 3;
+    } else if ( *(const uint32_t *) map == CUPS_RASTER_SYNCv2 ) {
+        version = 2;
+    } else {
+        return NULL;
+    }
+
+    p = map + 4;
+    while ( ! truncated && (size_t) ( end - p ) >= RASTERINDEX_HEADER_SIZE ) {
+        memcpy(&page_header, p, sizeof(page_header));
+        if ( ! rasterindex_header_valid(&page_header, &bpp) ) {
+            break;
+        }
+        if ( ( page = (rasterindex_page_t *) rasterindex_array_add(&pages) ) == NULL ) {
+            goto failed;
+        }
+        page->header_offset = (uint64_t) ( p - map );
+        page->data_offset = page->header_offset + RASTERINDEX_HEADER_SIZE;
+        page->first_mark = marks.count;
+        page->num_marks = 0;
+        p += RASTERINDEX_HEADER_SIZE;
+
+        if ( version == 3 ) {
+            /* 不压缩的行定长，不完整的最后一页只算完整的行。 */
+            rows = (uint64_t) ( end - p ) / page_header.cupsBytesPerLine;
+            if ( rows < page_header.cupsHeight ) {
+                truncated = 1;
+            } else {
+                rows = page_header.cupsHeight;
+            }
+            page->rows = (uint32_t) rows;
+            page->data_size = rows * page_header.cupsBytesPerLine;
+            p += page->data_size;
+            continue;
+        }
+
+        /* 压缩的行逐条走过，每 RASTERINDEX_MARK_ROWS 行记下所在的行记录。 */
+        for ( row = 0; row < page_header.cupsHeight; row += used ) {
+            if ( ! rasterindex_parse_line(p, end, page_header.cupsBytesPerLine, bpp, NULL, &repeat, &next) ) {
+                truncated = 1;
+                break;
+            }
+            used = ( repeat < page_header.cupsHeight - row )? repeat: page_header.cupsHeight - row;
+            while ( page->num_marks * RASTERINDEX_MARK_ROWS < row + used ) {
+                if ( ( mark = (rasterindex_mark_t *) rasterindex_array_add(&marks) ) == NULL ) {
+                    goto failed;
+                }
+                mark->offset = (uint64_t) ( p - map );
+                mark->skip = page->num_marks * RASTERINDEX_MARK_ROWS - row;
+                mark->reserved = 0;
+                page->num_marks ++;
+            }
+            p = next;
+        }
+        page->rows = row;
+        page->data_size = (uint64_t) ( p - map ) - page->data_offset;
+    }
+
+    if ( pages.count == 0 ) {
+        goto failed;
+    }
+
+    /* 索引内容：头部 + 页表 + 检查点表。文件信息由调用者填写。 */
+    *size = sizeof(header) + pages.count * sizeof(rasterindex_page_t) + marks.count * sizeof(rasterindex_mark_t);
+    if ( ( image = malloc(*size) ) == NULL ) {
+        goto failed;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RASTERINDEX_MAGIC, sizeof(RASTERINDEX_MAGIC));
+    header.version = RASTERINDEX_VERSION;
+    header.raster_version = version;
+    header.num_pages = (uint32_t) pages.count;
+    header.num_marks = marks.count;
+    header.file_size = *size;
+    memcpy(image, &header, sizeof(header));
+    memcpy((uint8_t *) image + sizeof(header), pages.data, pages.count * sizeof(rasterindex_page_t));
+    if ( marks.count > 0 ) {
+        memcpy((uint8_t *) image + sizeof(header) + pages.count * sizeof(rasterindex_page_t), marks.data, marks.count * sizeof(rasterindex_mark_t));
+    }
+
+failed:
+    free(pages.data);
+    free(marks.data);
+
+    return image;
+}
+
+/*
+ * rasterindex_valid() - 检查索引内容是否完整，与 raster 文件的大小和修改时间一致，
+ *                       且每页的位置都落在文件之内。
+ */
+static int                              /* 输出 - 1 有效，0 无效 */
+rasterindex_valid(
+    const void          *image,         /* 输入 - 索引内容 */
+    size_t              size,           /* 输入 - 内容的大小 */
+    uint64_t            path_hash,      /* 输入 - raster 路径的散列 */
+    const struct stat   *st,            /* 输入 - raster 文件的状态 */
+    const uint8_t       *map            /* 输入 - 映射的 raster 文件 */
+) {
+    const rasterindex_header_t  *header = (const rasterindex_header_t *) image;
+    const rasterindex_page_t    *pages;
+    const rasterindex_mark_t    *marks;
+    cups_page_header2_t         page_header;
+    const uint64_t              map_size = (uint64_t) st->st_size;
+    unsigned                    index,
+                                mark,
+                                bpp;
+
+    if ( size < sizeof(rasterindex_header_t) ) {
+        return 0;
+    }
+    if ( memcmp(header->magic, RASTERINDEX_MAGIC, sizeof(RASTERINDEX_MAGIC)) != 0
+            || header->version != RASTERINDEX_VERSION
+            || header->file_size != size
+            || header->path_hash != path_hash
+            || header->raster_size != map_size
+            || header->raster_mtime_sec != (int64_t) st->st_mtim.tv_sec
+            || header->raster_mtime_nsec != (int64_t) st->st_mtim.tv_nsec
+            || ( header->raster_version != 2 && header->raster_version != 3 )
+            || header->num_pages == 0
+            || header->num_marks > size
+            || size != sizeof(rasterindex_header_t)
+                        + (uint64_t) header->num_pages * sizeof(rasterindex_page_t)
+                        + header->num_marks * sizeof(rasterindex_mark_t) ) {
+        return 0;
+    }
+
+    pages = (const rasterindex_page_t *) ( header + 1 );
+    marks = (const rasterindex_mark_t *) ( pages + header->num_pages );
+    for ( index = 0; index < header->num_pages; index ++ ) {
+        if ( pages[index].header_offset > map_size
+                || pages[index].data_offset != pages[index].header_offset + RASTERINDEX_HEADER_SIZE
+                || pages[index].data_offset > map_size
+                || pages[index].data_size > map_size - pages[index].data_offset ) {
+            return 0;
+        }
+        memcpy(&page_header, map + pages[index].header_offset, sizeof(page_header));
+        if ( ! rasterindex_header_valid(&page_header, &bpp) || pages[index].rows > page_header.cupsHeight ) {
+            return 0;
+        }
+        if ( header->raster_version == 3 ) {
+            if ( pages[index].num_marks != 0
+                    || pages[index].data_size != (uint64_t) pages[index].rows * page_header.cupsBytesPerLine ) {
+                return 0;
+            }
+            continue;
+        }
+        if ( pages[index].first_mark > header->num_marks
+                || pages[index].num_marks > header->num_marks - pages[index].first_mark
+                || pages[index].num_marks != ( pages[index].rows + RASTERINDEX_MARK_ROWS - 1 ) / RASTERINDEX_MARK_ROWS ) {
+            return 0;
+        }
+        for ( mark = 0; mark < pages[index].num_marks; mark ++ ) {
+            if ( marks[pages[index].first_mark + mark].offset < pages[index].data_offset
+                    || marks[pages[index].first_mark + mark].offset >= pages[index].data_offset + pages[index].data_size
+                    || marks[pages[index].first_mark + mark].skip > 255 ) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * rasterindex_open() - 映射 raster 文件并取得页索引：已有的索引文件有效时直接使用，
+ *                      否则扫描一遍，有路径时存成索引文件。
+ */
+int                                     /* 输出 - 1 成功，0 不是可以索引的 v2/v3 普通文件 */
+rasterindex_open(
+    rasterindex_t       *index,         /* 输出 - 索引 */
+    int                 fd,             /* 输入 - raster 文件的描述符 */
+    const char          *path           /* 输入 - raster 文件路径，为 NULL 时不用索引文件 */
+) {
+    struct stat         st;
+    char                index_path[1024];
+    uint64_t            path_hash = 0;
+    void                *image = MAP_FAILED;
+    size_t              size = 0;
+    const rasterindex_header_t  *header;
+
+    memset(index, 0, sizeof(rasterindex_t));
+    if ( fstat(fd, &st) != 0 || ! S_ISREG(st.st_mode) || st.st_size < 4 ) {
+        return 0;
+    }
+    index->map_size = (size_t) st.st_size;
+    if ( ( index->map = (const uint8_t *) mmap(NULL, index->map_size, PROT_READ, MAP_PRIVATE, fd, 0) ) == MAP_FAILED ) {
+        index->map = NULL;
+        return 0;
+    }
+
+    /* 先试着映射已有的索引文件。 */
+    if ( path != NULL ) {
+        path_hash = rasterindex_path(path, index_path, sizeof(index_path));
+        image = cachefile_map(index_path, &size);
+    }
+
+    if ( image != MAP_FAILED && rasterindex_valid(image, size, path_hash, &st, index->map) ) {
+        index->image = image;
+        index->image_size = size;
+        index->loaded = 1;
+    } else {
+        /* 缺失或过期，重新扫描；写不了索引文件时直接使用内存中的内容。 */
+        if ( image != MAP_FAILED ) {
+            munmap(image, size);
+        }
+        if ( ( image = rasterindex_scan(index->map, index->map_size, &size) ) == NULL ) {
+            rasterindex_close(index);
+            return 0;
+        }
+        ( (rasterindex_header_t *) image )->raster_size = (uint64_t) st.st_size;
+        ( (rasterindex_header_t *) image )->raster_mtime_sec = (int64_t) st.st_mtim.tv_sec;
+        ( (rasterindex_header_t *) image )->raster_mtime_nsec = (int64_t) st.st_mtim.tv_nsec;
+        ( (rasterindex_header_t *) image )->path_hash = path_hash;
+        if ( path != NULL && ( (rasterindex_header_t *) image )->raster_version == 2 ) {
+            /* v3 的扫描只读页头，不值得存。 */
+            cachefile_write(index_path, image, size);
+        }
+        index->image = image;
+        index->image_size = 0;
+    }
+
+    header = (const rasterindex_header_t *) index->image;
+    index->version = header->raster_version;
+    index->num_pages = header->num_pages;
+    index->pages = (const rasterindex_page_t *) ( header + 1 );
+    index->marks = (const rasterindex_mark_t *) ( index->pages + header->num_pages );
+
+    /* 按顺序读页面，提示内核预读。 */
+    madvise((void *) index->map, index->map_size, MADV_SEQUENTIAL);
+
+    return 1;
+}
+
+/*
+ * rasterindex_read_header() - 取得第 page 页（从 0 开始）的页头。
+ */
+int                                     /* 输出 - 1 成功，0 没有这一页 */
+rasterindex_read_header(
+    const rasterindex_t *index,         /* 输入 - 索引 */
+    unsigned            page,           /* 输入 - 页号 */
+    cups_page_header2_t *header         /* 输出 - 页头 */
+) {
+    if ( page >= index->num_pages ) {
+        return 0;
+    }
+    memcpy(header, index->map + index->pages[page].header_offset, sizeof(cups_page_header2_t));
+
+    return 1;
+}
+
+/*
+ * rasterindex_rows() - v3 流中第 page 页第 row 行在映射中的位置，之后的行紧挨着。
+ */
+const unsigned char *                   /* 输出 - 行的位置，v2 流为 NULL */
+rasterindex_rows(
+    const rasterindex_t *index,         /* 输入 - 索引 */
+    unsigned            page,           /* 输入 - 页号 */
+    unsigned            row             /* 输入 - 行号 */
+) {
+    const cups_page_header2_t   *header;
+
+    if ( index->version != 3 || page >= index->num_pages || row > index->pages[page].rows ) {
+        return NULL;
+    }
+    header = (const cups_page_header2_t *) ( index->map + index->pages[page].header_offset );
+
+    return index->map + index->pages[page].data_offset + (size_t) row * header->cupsBytesPerLine;
+}
+
+/*
+ * rasterindex_read_rows() - 从第 page 页第 row 行开始读 count 行，v2 流从最近的
+ *                           检查点开始解码。可以在多个线程中同时调用。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+rasterindex_read_rows(
+    const rasterindex_t *index,         /* 输入 - 索引 */
+    unsigned            page,           /* 输入 - 页号 */
+    unsigned            row,            /* 输入 - 第一行 */
+    unsigned            count,          /* 输入 - 行数 */
+    unsigned char       *dest           /* 输出 - 行 */
+) {
+    const rasterindex_page_t    *entry;
+    const rasterindex_mark_t    *mark;
+    const cups_page_header2_t   *header;
+    const uint8_t       *p, *next, *end;
+    unsigned            bytes,
+                        bpp,
+                        current,        /* p 处的行记录从哪一行开始用 */
+                        skip,           /* 这条记录在 current 之前已经用了几次 */
+                        left,           /* 这条记录从 current 起还能用几行 */
+                        repeat,
+                        used,
+                        copy;
+
+    if ( page >= index->num_pages || row > index->pages[page].rows || count > index->pages[page].rows - row ) {
+        return 0;
+    }
+    entry = index->pages + page;
+    header = (const cups_page_header2_t *) ( index->map + entry->header_offset );
+    bytes = header->cupsBytesPerLine;
+
+    if ( index->version == 3 ) {
+        memcpy(dest, index->map + entry->data_offset + (size_t) row * bytes, (size_t) count * bytes);
+        return 1;
+    }
+    if ( count == 0 ) {
+        return 1;
+    }
+
+    bpp = ( header->cupsBitsPerPixel + 7 ) / 8;
+    end = index->map + entry->data_offset + entry->data_size;
+    mark = index->marks + entry->first_mark + row / RASTERINDEX_MARK_ROWS;
+    p = index->map + mark->offset;
+    current = row - row % RASTERINDEX_MARK_ROWS;
+    skip = mark->skip;
+
+    while ( count > 0 ) {
+        if ( p >= end || ( repeat = (unsigned) *p + 1 ) <= skip ) {
+            return 0;
+        }
+        left = repeat - skip;
+        skip = 0;
+
+        /* row 之前的行记录只走过，不解码。 */
+        if ( current + left <= row ) {
+            if ( ! rasterindex_parse_line(p, end, bytes, bpp, NULL, &repeat, &next) ) {
+                return 0;
+            }
+            current += left;
+            p = next;
+            continue;
+        }
+
+        if ( ! rasterindex_parse_line(p, end, bytes, bpp, dest, &repeat, &next) ) {
+            return 0;
+        }
+        used = current + left - row;
+        if ( used > count ) {
+            used = count;
+        }
+        for ( copy = 1; copy < used; copy ++ ) {
+            memcpy(dest + (size_t) copy * bytes, dest, bytes);
+        }
+        dest += (size_t) used * bytes;
+        row += used;
+        count -= used;
+        current = row;
+        p = next;
+    }
+
+    return 1;
+}
+
+/*
+ * rasterindex_close() - 释放索引并解除映射。
+ */
+void
+rasterindex_close(
+    rasterindex_t       *index          /* 输入 - 索引 */
+) {
+    if ( index->image != NULL ) {
+        if ( index->image_size > 0 ) {
+            munmap(index->image, index->image_size);
+        } else {
+            free(index->image);
+        }
+    }
+    if ( index->map != NULL ) {
+        munmap((void *) index->map, index->map_size);
+    }
+    memset(index, 0, sizeof(rasterindex_t));
+}
@@ -0,0 +1,100 @@
+/*
+ * rasterindex.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_RASTERINDEX_H
+#define __LEISRASTERFILTER_RASTERINDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cups/raster.h>
+
+#define RASTERINDEX_MAGIC       "LRFRIDX"   /* 索引文件标识 */
+#define RASTERINDEX_VERSION     1           /* 索引格式版本，格式变化时加 1 */
+#define RASTERINDEX_DIR_ENV     "LEISRASTERFILTER_RASTER_INDEX" /* 指定索引目录的环境变量 */
+#define RASTERINDEX_HEADER_SIZE 1796        /* v2/v3 流中页头的字节数 */
+#define RASTERINDEX_MARK_ROWS   8           /* v2 每隔多少行记一个检查点 */
+
+/*
+ * 索引文件头部，后面依次是页表和检查点表。
+ */
+typedef struct {
+    char        magic[8];           /* RASTERINDEX_MAGIC */
+    uint32_t    version,            /* RASTERINDEX_VERSION */
+                raster_version,     /* raster 流的版本，2 或 3 */
+                num_pages,          /* 页数 */
+                reserved;
+    uint64_t    num_marks,          /* 检查点个数 */
+                file_size,          /* 整个索引文件的大小 */
+                raster_size,        /* raster 文件的大小 */
+                path_hash;          /* raster 文件路径的 FNV-1a 散列 */
+    int64_t     raster_mtime_sec,   /* raster 文件的修改时间 */
+                raster_mtime_nsec;
+} rasterindex_header_t;
+
+/*
+ * 一页在 raster 文件中的位置。
+ */
+typedef struct {
+    uint64_t    header_offset,      /* 页头的位置 */
+                data_offset,        /* 像素数据的位置 */
+                data_size,          /* 完整的像素数据的字节数 */
+                first_mark;         /* 第一个检查点在检查点表中的下标 */
+    uint32_t    rows,               /* 完整的行数，文件被截断时少于页高 */
+                num_marks;          /* 检查点个数，v3 为 0 */
+} rasterindex_page_t;
+
+/*
+ * v2 压缩行的检查点：第 n * RASTERINDEX_MARK_ROWS 行所在的行记录的位置，
+ * 以及这条记录在这一行之前已经重复了几次。
+ */
+typedef struct {
+    uint64_t    offset;             /* 行记录的位置 */
+    uint32_t    skip,               /* 已经重复的次数 */
+                reserved;
+} rasterindex_mark_t;
+
+/*
+ * 打开的索引。
+ */
+typedef struct {
+    const uint8_t               *map;       /* 映射的 raster 文件 */
+    size_t                      map_size;
+    unsigned                    version;    /* raster 流的版本，2 或 3 */
+    unsigned                    num_pages;
+    const rasterindex_page_t    *pages;
+    const rasterindex_mark_t    *marks;
+    void                        *image;     /* 索引内容，image_size 为 0 时是 malloc() 得到的内容 */
+    size_t                      image_size;
+    int                         loaded;     /* 是否直接用了索引文件 */
+} rasterindex_t;
+
+extern int rasterindex_open(rasterindex_t *index, int fd, const char *path);
+extern int rasterindex_read_header(const rasterindex_t *index, unsigned page, cups_page_header2_t *header);
+extern const unsigned char *rasterindex_rows(const rasterindex_t *index, unsigned page, unsigned row);
+extern int rasterindex_read_rows(const rasterindex_t *index, unsigned page, unsigned row, unsigned count, unsigned char *dest);
+extern void rasterindex_close(rasterindex_t *index);
+
+#endif
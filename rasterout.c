@@ -0,0 +1,462 @@
+/*
+ * rasterout.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * raster 输出。只需要变换（旋转、裁剪、降到 8 位）的任务可以把转换好的页缓冲
+ * 再写成 raster 交给下一个过滤器：
+ *
+ * 1. bitmap-format=raster 写 CUPS raster v2（压缩，本机字节序），pwg 写 PWG
+ *    raster（大端序页头）。两者的行编码相同：每行以一个字节的重复次数开头
+ *    （这一行再重复几次），然后是像素的游程：0 到 127 表示下一个像素重复 n + 1
+ *    次，129 到 255 表示后面跟着 257 - n 个不重复的像素。
+ * 2. 内置编码器把一行与错开一个像素的自身逐字节比较：找相同像素的游程时找第一个
+ *    不同的字节（linecodec_diff()），找不重复的像素时在 SSE2 下一次看 16 个 8 位
+ *    或 5 个 24 位像素。相同的行只比较原来的 BGR 行，写出时才换成 RGB 顺序。
+ * 3. bitmap-raster-encoder=libcups 时改用 cupsRasterOpenIO() 和
+ *    cupsRasterWritePixels()，输出经同一个输出流交给内核。
+ */
+
+#include "rasterout.h"
+#include "linecodec.h"
+#include <arpa/inet.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* 16 字节的向量类型（GCC 向量扩展）。 */
+typedef uint8_t rasterout_v16qu __attribute__ ((vector_size (16)));
+
+/* 把前 5 个 BGR 像素换成 RGB 顺序，第 16 个字节会被下一次写入覆盖。 */
+static const rasterout_v16qu bgr_to_rgb_mask = {
+    2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15
+};
+
+/*
+ * rasterout_io() - libcups 写入流的回调，数据交给输出流。
+ */
+static ssize_t                          /* 输出 - 写入的字节数，失败时为 -1 */
+rasterout_io(
+    void                *context,       /* 输入 - raster 输出 */
+    unsigned char       *buffer,        /* 输入 - 数据 */
+    size_t              length          /* 输入 - 字节数 */
+) {
+    rasterout_t         *out = (rasterout_t *) context;
+
+    out->encoded_bytes += length;
+
+    return output_write(out->sink, buffer, length)? (ssize_t) length: -1;
+}
+
+/*
+ * rasterout_open() - 准备 raster 输出，写出流开头的同步字。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+rasterout_open(
+    rasterout_t         *out,           /* 输出 - raster 输出 */
+    output_format_t     format,         /* 输入 - OUTPUT_FORMAT_RASTER 或 OUTPUT_FORMAT_PWG */
+    int                 use_cups,       /* 输入 - 是否用 libcups 编码 */
+    output_sink_t       *sink           /* 输入 - 输出流 */
+) {
+    uint32_t            sync;
+
+    memset(out, 0, sizeof(rasterout_t));
+    out->format = format;
+    out->sink = sink;
+
+    if ( use_cups ) {
+        out->ras = cupsRasterOpenIO(
+            rasterout_io,
+            out,
+            ( format == OUTPUT_FORMAT_PWG )? CUPS_RASTER_WRITE_PWG: CUPS_RASTER_WRITE_COMPRESSED
+        );
+        return ( out->ras != NULL );
+    }
+
+    /* CUPS raster 的同步字按本机字节序写，PWG 总是大端序的 "RaS2"。 */
+    sync = ( format == OUTPUT_FORMAT_PWG )? htonl(CUPS_RASTER_SYNC_PWG): CUPS_RASTER_SYNCv2;
+
+    return rasterout_io(out, (unsigned char *) &sync, sizeof(sync)) > 0;
+}
+
+/*
+ * rasterout_header() - 由原来的页头得到输出的页头：尺寸和分辨率按转换后的页面，
+ *                      8 位 RGB 或灰度，行按像素排列。页面旋转了 90 度时纸张
+ *                      尺寸和边距也交换。
+ */
+void
+rasterout_header(
+    const rasterout_t   *out,           /* 输入 - raster 输出 */
+    const cups_page_header2_t *source,  /* 输入 - 原来的页头 */
+    unsigned            width,          /* 输入 - 宽度 */
+    unsigned            height,         /* 输入 - 高度 */
+    unsigned            pixel_size,     /* 输入 - 每个像素的字节数，1 或 3 */
+    unsigned            x_res,          /* 输入 - 横向分辨率 (dpi) */
+    unsigned            y_res,          /* 输入 - 纵向分辨率 (dpi) */
+    int                 swap_axes,      /* 输入 - 是否交换了宽和高 */
+    cups_page_header2_t *header         /* 输出 - 页头 */
+) {
+    unsigned            swap;
+    float               swap_real;
+
+    *header = *source;
+    if ( swap_axes ) {
+        swap = header->PageSize[0], header->PageSize[0] = header->PageSize[1], header->PageSize[1] = swap;
+        swap = header->Margins[0], header->Margins[0] = header->Margins[1], header->Margins[1] = swap;
+        swap = header->ImagingBoundingBox[0], header->ImagingBoundingBox[0] = header->ImagingBoundingBox[1], header->ImagingBoundingBox[1] = swap;
+        swap = header->ImagingBoundingBox[2], header->ImagingBoundingBox[2] = header->ImagingBoundingBox[3], header->ImagingBoundingBox[3] = swap;
+        swap_real = header->cupsPageSize[0], header->cupsPageSize[0] = header->cupsPageSize[1], header->cupsPageSize[1] = swap_real;
+    }
+
+    header->HWResolution[0] = x_res;
+    header->HWResolution[1] = y_res;
+    header->cupsWidth = width;
+    header->cupsHeight = height;
+    header->cupsBitsPerColor = 8;
+    header->cupsBitsPerPixel = 8 * pixel_size;
+    header->cupsBytesPerLine = width * pixel_size;
+    header->cupsColorOrder = CUPS_ORDER_CHUNKED;
+    header->cupsNumColors = pixel_size;
+    if ( out->format == OUTPUT_FORMAT_PWG ) {
+        header->cupsColorSpace = ( pixel_size == 1 )? CUPS_CSPACE_SW: CUPS_CSPACE_SRGB;
+    } else if ( pixel_size == 1 ) {
+        header->cupsColorSpace = CUPS_CSPACE_W;
+    } else if ( header->cupsColorSpace != CUPS_CSPACE_SRGB ) {
+        header->cupsColorSpace = CUPS_CSPACE_RGB;
+    }
+}
+
+/*
+ * rasterout_pwg_header() - 按 PWG 5102.4 把页头中用到的字段换成大端序，其他
+ *                          字段清零。
+ */
+static void
+rasterout_pwg_header(
+    const cups_page_header2_t *header,  /* 输入 - 页头 */
+    cups_page_header2_t *pwg            /* 输出 - PWG 页头 */
+) {
+    unsigned            index;
+
+    memset(pwg, 0, sizeof(cups_page_header2_t));
+    strcpy(pwg->MediaClass, "PwgRaster");
+    memcpy(pwg->MediaColor, header->MediaColor, sizeof(pwg->MediaColor) - 1);
+    memcpy(pwg->MediaType, header->MediaType, sizeof(pwg->MediaType) - 1);
+    memcpy(pwg->OutputType, header->OutputType, sizeof(pwg->OutputType) - 1);
+    memcpy(pwg->cupsRenderingIntent, header->cupsRenderingIntent, sizeof(pwg->cupsRenderingIntent) - 1);
+    memcpy(pwg->cupsPageSizeName, header->cupsPageSizeName, sizeof(pwg->cupsPageSizeName) - 1);
+
+    pwg->CutMedia = htonl(header->CutMedia);
+    pwg->Duplex = htonl(header->Duplex);
+    pwg->HWResolution[0] = htonl(header->HWResolution[0]);
+    pwg->HWResolution[1] = htonl(header->HWResolution[1]);
+    for ( index = 0; index < 4; index ++ ) {
+        pwg->ImagingBoundingBox[index] = htonl(header->ImagingBoundingBox[index]);
+    }
+    pwg->InsertSheet = htonl(header->InsertSheet);
+    pwg->Jog = htonl(header->Jog);
+    pwg->LeadingEdge = htonl(header->LeadingEdge);
+    pwg->ManualFeed = htonl(header->ManualFeed);
+    pwg->MediaPosition = htonl(header->MediaPosition);
+    pwg->MediaWeight = htonl(header->MediaWeight);
+    pwg->NumCopies = htonl(header->NumCopies);
+    pwg->Orientation = htonl(header->Orientation);
+    pwg->PageSize[0] = htonl(header->PageSize[0]);
+    pwg->PageSize[1] = htonl(header->PageSize[1]);
+    pwg->Tumble = htonl(header->Tumble);
+    pwg->cupsWidth = htonl(header->cupsWidth);
+    pwg->cupsHeight = htonl(header->cupsHeight);
+    pwg->cupsBitsPerColor = htonl(header->cupsBitsPerColor);
+    pwg->cupsBitsPerPixel = htonl(header->cupsBitsPerPixel);
+    pwg->cupsBytesPerLine = htonl(header->cupsBytesPerLine);
+    pwg->cupsColorOrder = htonl(header->cupsColorOrder);
+    pwg->cupsColorSpace = htonl(header->cupsColorSpace);
+    pwg->cupsNumColors = htonl(header->cupsNumColors);
+
+    /* TotalPageCount、CrossFeedTransform、FeedTransform；ImageBox 按原来的页面，不再适用。 */
+    pwg->cupsInteger[0] = htonl(header->cupsInteger[0]);
+    pwg->cupsInteger[1] = htonl(header->cupsInteger[1]? header->cupsInteger[1]: 1);
+    pwg->cupsInteger[2] = htonl(header->cupsInteger[2]? header->cupsInteger[2]: 1);
+    /* AlternatePrimary、PrintQuality。 */
+    pwg->cupsInteger[7] = htonl(header->cupsInteger[7]);
+    pwg->cupsInteger[8] = htonl(header->cupsInteger[8]);
+}
+
+/*
+ * rasterout_literal() - 从第一个像素起，数出到某个与下一个像素相同的像素为止
+ *                       （不含）的像素数。第一个像素与第二个不同。
+ */
+static size_t                           /* 输出 - 像素数，1 到 count */
+rasterout_literal(
+    const uint8_t       *pixels,        /* 输入 - 像素 */
+    size_t              count,          /* 输入 - 最多的像素数 */
+    unsigned            bpp             /* 输入 - 每像素的字节数 */
+) {
+    const size_t        n = ( count - 1 ) * bpp;
+    size_t              index = 0;
+#ifdef __SSE2__
+    unsigned            mask;
+
+    /*
+     * 与错开一个像素的自身逐字节比较：像素与下一个相同时它的每个字节都相等。
+     * 8 位像素一次看 16 个，24 位像素一次看 5 个（15 个字节）。
+     */
+    if ( bpp == 1 || bpp == 3 ) {
+        for ( ; index + 16 <= n; index += ( bpp == 1 )? 16: 15 ) {
+            mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *) ( pixels + index )),
+                _mm_loadu_si128((const __m128i *) ( pixels + index + bpp ))
+            ));
+            if ( bpp == 3 ) {
+                /* 只留下三个字节都相等的像素的第一个字节。 */
+                mask &= ( mask >> 1 ) & ( mask >> 2 ) & 0x1249;
+            }
+            if ( mask != 0 ) {
+                return ( index + __builtin_ctz(mask) ) / bpp;
+            }
+        }
+    }
+#endif
+
+    for ( index /= bpp; index + 1 < count; index ++ ) {
+        if ( ! memcmp(pixels + index * bpp, pixels + ( index + 1 ) * bpp, bpp) ) {
+            return index;
+        }
+    }
+
+    return count;
+}
+
+/*
+ * rasterout_encode_row() - 把一行编码为 CUPS/PWG raster 的行记录。
+ */
+size_t                                  /* 输出 - 编码后的字节数 */
+rasterout_encode_row(
+    const uint8_t       *row,           /* 输入 - 像素行 */
+    size_t              size,           /* 输入 - 行的字节数 */
+    unsigned            bpp,            /* 输入 - 每像素的字节数 */
+    unsigned            repeat,         /* 输入 - 这一行再重复的次数，最多 255 */
+    uint8_t             *dst            /* 输出 - 至少 RASTEROUT_BOUND(size, bpp) 个字节 */
+) {
+    const size_t        count = size / bpp;
+    const uint8_t       *pixel;
+    uint8_t             *out = dst;
+    size_t              index = 0,
+                        limit,
+                        run;
+
+    *out ++ = (uint8_t) repeat;
+    while ( index < count ) {
+        pixel = row + index * bpp;
+        limit = count - index;
+        if ( limit > RASTEROUT_MAX_RUN ) {
+            limit = RASTEROUT_MAX_RUN;
+        }
+
+        /* 与后面的像素相同：比较错开一个像素的字节，第一个不同的字节所在的像素结束游程。 */
+        run = ( limit > 1 )? linecodec_diff(pixel, pixel + bpp, ( limit - 1 ) * bpp) / bpp + 1: 1;
+        if ( run > 1 || limit == 1 ) {
+            *out ++ = (uint8_t) ( run - 1 );
+            memcpy(out, pixel, bpp);
+            out += bpp;
+        } else {
+            /* 不重复的像素，1 个时与重复 1 次的写法相同。 */
+            run = rasterout_literal(pixel, limit, bpp);
+            *out ++ = (uint8_t) ( 257 - run );
+            memcpy(out, pixel, run * bpp);
+            out += run * bpp;
+        }
+        index += run;
+    }
+
+    return (size_t) ( out - dst );
+}
+
+/*
+ * rasterout_rgb() - 需要时把一行 BGR 像素换成 RGB 顺序。
+ */
+static const uint8_t *                  /* 输出 - RGB 或灰度的行 */
+rasterout_rgb(
+    rasterout_t         *out,           /* 输入 - raster 输出 */
+    const uint8_t       *row,           /* 输入 - bitmap 像素行 */
+    size_t              size,           /* 输入 - 行的字节数 */
+    unsigned            pixel_size      /* 输入 - 每个像素的字节数 */
+) {
+    rasterout_v16qu     v;
+    size_t              index = 0;
+
+    if ( pixel_size != 3 ) {
+        return row;
+    }
+
+    /* 每次写 16 个字节，其中有效的 15 个字节是 5 个像素。 */
+    for ( ; index + 16 <= size; index += 15 ) {
+        memcpy(&v, row + index, sizeof(v));
+        v = __builtin_shuffle(v, bgr_to_rgb_mask);
+        memcpy(out->row + index, &v, sizeof(v));
+    }
+    for ( ; index + 3 <= size; index += 3 ) {
+        out->row[index] = row[index + 2];
+        out->row[index + 1] = row[index + 1];
+        out->row[index + 2] = row[index];
+    }
+
+    return out->row;
+}
+
+/*
+ * rasterout_flush() - 编码一行（连同它的重复次数）并写出，能预留缓冲时直接编码到输出缓冲段。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+rasterout_flush(
+    rasterout_t         *out,           /* 输入 - raster 输出 */
+    const uint8_t       *row,           /* 输入 - bitmap 像素行 */
+    size_t              size,           /* 输入 - 行的字节数 */
+    unsigned            pixel_size,     /* 输入 - 每个像素的字节数 */
+    unsigned            repeat          /* 输入 - 再重复的次数 */
+) {
+    uint8_t             *dst = output_reserve(out->sink, RASTEROUT_BOUND(size, pixel_size));
+    size_t              length;
+
+    row = rasterout_rgb(out, row, size, pixel_size);
+    length = rasterout_encode_row(row, size, pixel_size, repeat, ( dst != NULL )? dst: out->data);
+    out->raw_bytes += size * ( repeat + 1 );
+
+    if ( dst == NULL ) {
+        /* 一行比缓冲段还长时走这里。 */
+        return rasterout_io(out, out->data, length) > 0;
+    }
+    out->encoded_bytes += length;
+    output_commit(out->sink, length);
+
+    return ( ! out->sink->failed );
+}
+
+/*
+ * rasterout_write_page() - 写出一页：页头和从上到下的每一行。像素阵是转换好的
+ *                          bitmap 像素（BGR 或 8 位灰度），行从上到下排列，没有补齐字节。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+rasterout_write_page(
+    rasterout_t         *out,           /* 输入 - raster 输出 */
+    const cups_page_header2_t *source,  /* 输入 - 原来的页头 */
+    const void          *pixels,        /* 输入 - 像素阵 */
+    unsigned            width,          /* 输入 - 宽度 */
+    unsigned            height,         /* 输入 - 高度 */
+    unsigned            pixel_size,     /* 输入 - 每个像素的字节数，1 或 3 */
+    unsigned            x_res,          /* 输入 - 横向分辨率 (dpi) */
+    unsigned            y_res,          /* 输入 - 纵向分辨率 (dpi) */
+    int                 swap_axes       /* 输入 - 是否交换了宽和高 */
+) {
+    const size_t        row_bytes = (size_t) width * pixel_size;
+    const uint8_t       *row = (const uint8_t *) pixels,
+                        *pending = NULL;    /* 等待写出的行 */
+    cups_page_header2_t header,
+                        pwg;
+    unsigned            y,
+                        repeat = 0;         /* pending 之后与它相同的行数 */
+    size_t              size = RASTEROUT_BOUND(row_bytes, pixel_size);
+    uint8_t             *buffer;
+
+    rasterout_header(out, source, width, height, pixel_size, x_res, y_res, swap_axes, &header);
+
+    if ( size > out->row_size ) {
+        if ( ( buffer = (uint8_t *) realloc(out->row, size) ) == NULL ) {
+            return FUNCTION_FAILURE;
+        }
+        out->row = buffer;
+        if ( ( buffer = (uint8_t *) realloc(out->data, size) ) == NULL ) {
+            return FUNCTION_FAILURE;
+        }
+        out->data = buffer;
+        out->row_size = size;
+    }
+
+    if ( out->ras != NULL ) {
+        /* libcups 编码。 */
+        if ( ! cupsRasterWriteHeader2(out->ras, &header) ) {
+            return FUNCTION_FAILURE;
+        }
+        for ( y = 0; y < height; y ++, row += row_bytes ) {
+            if ( cupsRasterWritePixels(
+                    out->ras,
+                    (unsigned char *) rasterout_rgb(out, row, row_bytes, pixel_size),
+                    (unsigned) row_bytes
+            ) < row_bytes ) {
+                return FUNCTION_FAILURE;
+            }
+        }
+        out->raw_bytes += row_bytes * height;
+
+        return ( out->sink->failed )? FUNCTION_FAILURE: FUNCTION_SUCCESS;
+    }
+
+    if ( out->format == OUTPUT_FORMAT_PWG ) {
+        rasterout_pwg_header(&header, &pwg);
+        if ( rasterout_io(out, (unsigned char *) &pwg, sizeof(pwg)) < 0 ) {
+            return FUNCTION_FAILURE;
+        }
+    } else if ( rasterout_io(out, (unsigned char *) &header, sizeof(header)) < 0 ) {
+        return FUNCTION_FAILURE;
+    }
+
+    for ( y = 0; y < height; y ++, row += row_bytes ) {
+        /* 与等待写出的行相同时只计数。BGR 行相同等价于 RGB 行相同，不用先换顺序。 */
+        if ( pending != NULL && repeat < RASTEROUT_MAX_REPEAT && ! memcmp(row, pending, row_bytes) ) {
+            repeat ++;
+            continue;
+        }
+        if ( pending != NULL && ! rasterout_flush(out, pending, row_bytes, pixel_size, repeat) ) {
+            return FUNCTION_FAILURE;
+        }
+        pending = row;
+        repeat = 0;
+    }
+    if ( pending != NULL && ! rasterout_flush(out, pending, row_bytes, pixel_size, repeat) ) {
+        return FUNCTION_FAILURE;
+    }
+
+    return ( out->sink->failed )? FUNCTION_FAILURE: FUNCTION_SUCCESS;
+}
+
+/*
+ * rasterout_close() - 结束 raster 输出，报告压缩比例。不关闭输出流。
+ */
+void
+rasterout_close(
+    rasterout_t         *out            /* 输入 - raster 输出 */
+) {
+    if ( out->ras != NULL ) {
+        cupsRasterClose(out->ras);
+        out->ras = NULL;
+    }
+    if ( out->raw_bytes > 0 ) {
+        fprintf(stderr, "DEBUG: Raster output: %llu bytes of pixels written as %llu bytes\n",
+            out->raw_bytes, out->encoded_bytes);
+    }
+    free(out->row);
+    free(out->data);
+    out->row = out->data = NULL;
+    out->row_size = 0;
+}
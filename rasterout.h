@@ -0,0 +1,61 @@
+/*
+ * rasterout.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_RASTEROUT_H
+#define __LEISRASTERFILTER_RASTEROUT_H
+
+#include "bitmap.h"
+#include "pnm.h"
+#include <cups/raster.h>
+
+#define RASTEROUT_MAX_RUN       128     /* 一个游程最多的像素数 */
+#define RASTEROUT_MAX_REPEAT    255     /* 一行最多再重复的次数 */
+
+/* 一行 n 个字节、每像素 bpp 个字节时编码结果的最大长度。 */
+#define RASTEROUT_BOUND(n, bpp) ( 1 + (n) + ( (n) / (bpp) + RASTEROUT_MAX_RUN - 1 ) / RASTEROUT_MAX_RUN )
+
+/*
+ * raster 输出。转换好的页缓冲逐行写成 CUPS raster v2（压缩）或 PWG raster 流，
+ * 可以用 libcups 的 cupsRasterWritePixels() 编码，也可以用这里的编码器。
+ */
+typedef struct {
+    output_format_t     format;         /* OUTPUT_FORMAT_RASTER 或 OUTPUT_FORMAT_PWG */
+    output_sink_t       *sink;          /* 输出流 */
+    cups_raster_t       *ras;           /* libcups 的写入流，用内置编码器时为 NULL */
+    uint8_t             *row,           /* 换成 RGB 顺序的一行 */
+                        *data;          /* 一行的编码结果 */
+    size_t              row_size;       /* row 和 data 的容量 */
+    unsigned long long  raw_bytes,      /* 累计的像素字节数 */
+                        encoded_bytes;  /* 累计的编码后字节数 */
+} rasterout_t;
+
+extern int rasterout_open(rasterout_t *out, output_format_t format, int use_cups, output_sink_t *sink);
+extern void rasterout_header(const rasterout_t *out, const cups_page_header2_t *source, unsigned width, unsigned height, unsigned pixel_size, unsigned x_res, unsigned y_res, int swap_axes, cups_page_header2_t *header);
+extern size_t rasterout_encode_row(const uint8_t *row, size_t size, unsigned bpp, unsigned repeat, uint8_t *dst);
+extern int rasterout_write_page(rasterout_t *out, const cups_page_header2_t *source, const void *pixels, unsigned width, unsigned height, unsigned pixel_size, unsigned x_res, unsigned y_res, int swap_axes);
+extern void rasterout_close(rasterout_t *out);
+
+#endif
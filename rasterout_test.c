@@ -0,0 +1,284 @@
+/*
+ * rasterout_test.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 这是一个用于测试 raster 输出的小程序。它生成几张 A4 300 dpi 的 8 位灰度和
+ * 24 位 BGR 页面（白边、重复行、长游程、渐变和噪声），分别用内置编码器和
+ * libcups 写成 CUPS raster v2 与 PWG raster 临时文件，再用 libcups 的
+ * cupsRasterReadHeader2() / cupsRasterReadPixels() 读回来，检查页头和每个像素，
+ * 并比较两种编码器的耗时和输出大小。逐份多份输出时和 rastertobitmap 一样从输出
+ * 记录中重放第一份，检查文件中只有一个同步字。
+ */
+
+#include "rasterout.h"
+#include <time.h>
+#include <unistd.h>
+
+const unsigned  width = 2480;
+const unsigned  height = 3508;
+const unsigned  pages = 3;
+
+/*
+ * now() - 单调时钟的当前时间（秒）。
+ */
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * fill() - 生成一页：上下白边、相同的行、长游程、渐变和噪声的区域。
+ */
+static void
+fill(
+    uint8_t     *pixels,
+    unsigned    pixel_size,
+    unsigned    page
+) {
+    const size_t    row_bytes = (size_t) width * pixel_size;
+    unsigned        r, c, k;
+    uint8_t         *row;
+
+    memset(pixels, 0xff, row_bytes * height);
+    for ( r = 150; r < height - 150; r ++ ) {
+        row = pixels + r * row_bytes;
+        for ( c = 150; c < width - 150; c ++ ) {
+            for ( k = 0; k < pixel_size; k ++ ) {
+                if ( r < 600 ) {
+                    /* 每 40 行一种颜色，每行是长短不一的色块。 */
+                    row[c * pixel_size + k] = (uint8_t) ( ( c / ( 7 + r / 40 ) ) * ( 40 + k ) + page );
+                } else if ( r < 1800 ) {
+                    /* 渐变，相邻像素多半不同。 */
+                    row[c * pixel_size + k] = (uint8_t) ( c + r * ( k + 1 ) + page );
+                } else if ( r < 2400 ) {
+                    /* 噪声，偶尔有两个相同的像素。 */
+                    row[c * pixel_size + k] = (uint8_t) ( ( ( r * width + c ) * 2654435761u >> ( 13 + k ) ) & ( ( c % 17 )? 0xff: 0 ) );
+                } else {
+                    /* 只在少数字节上相同，检查找不重复像素时的字节比较。 */
+                    row[c * pixel_size + k] = (uint8_t) ( ( k == 1 )? 0x80: c * ( k + 3 ) + page );
+                }
+            }
+        }
+    }
+}
+
+/*
+ * check() - 用 libcups 读回一个 raster 文件，与写出的 copies 份页面比较。
+ */
+static int
+check(
+    int             fd,
+    output_format_t format,
+    uint8_t         *pixels,
+    unsigned        pixel_size,
+    unsigned        copies
+) {
+    const size_t        row_bytes = (size_t) width * pixel_size;
+    cups_raster_t       *ras;
+    cups_page_header2_t header;
+    unsigned            page, r, c;
+    uint8_t             *line = (uint8_t *) malloc(row_bytes);
+    const uint8_t       *row;
+    int                 failure = FUNCTION_SUCCESS;
+
+    lseek(fd, 0, SEEK_SET);
+    if ( line == NULL || ( ras = cupsRasterOpen(fd, CUPS_RASTER_READ) ) == NULL ) {
+        free(line);
+        return FUNCTION_FAILURE;
+    }
+
+    for ( page = 0; page < pages * copies && failure == FUNCTION_SUCCESS; page ++ ) {
+        if ( ! cupsRasterReadHeader2(ras, &header) ) {
+            log_error("ERROR", "Missing page header!");
+            failure = FUNCTION_FAILURE;
+            break;
+        }
+        if (
+            header.cupsWidth != width || header.cupsHeight != height
+            || header.cupsBitsPerColor != 8 || header.cupsBitsPerPixel != 8 * pixel_size
+            || header.cupsBytesPerLine != row_bytes || header.cupsNumColors != pixel_size
+            || header.HWResolution[0] != 300 || header.HWResolution[1] != 600
+            || header.PageSize[0] != 842 || header.PageSize[1] != 595
+            || header.cupsColorSpace != ( ( format == OUTPUT_FORMAT_PWG )?
+                ( ( pixel_size == 1 )? CUPS_CSPACE_SW: CUPS_CSPACE_SRGB ):
+                ( ( pixel_size == 1 )? CUPS_CSPACE_W: CUPS_CSPACE_RGB ) )
+        ) {
+            log_error("ERROR", "Page header mismatch!");
+            failure = FUNCTION_FAILURE;
+            break;
+        }
+        fill(pixels, pixel_size, page % pages);
+        for ( r = 0, row = pixels; r < height; r ++, row += row_bytes ) {
+            if ( cupsRasterReadPixels(ras, line, (unsigned) row_bytes) != row_bytes ) {
+                log_error("ERROR", "Short row!");
+                failure = FUNCTION_FAILURE;
+                break;
+            }
+            for ( c = 0; c < width; c ++ ) {
+                /* 写出的是 RGB 顺序。 */
+                if ( pixel_size == 3
+                    ? ( line[c * 3] != row[c * 3 + 2] || line[c * 3 + 1] != row[c * 3 + 1] || line[c * 3 + 2] != row[c * 3] )
+                    : line[c] != row[c] ) {
+                    break;
+                }
+            }
+            if ( c < width ) {
+                fprintf(stderr, "ERROR: Pixel mismatch on page %u at row %u, column %u\n", page + 1, r, c);
+                failure = FUNCTION_FAILURE;
+                break;
+            }
+        }
+    }
+    if ( failure == FUNCTION_SUCCESS && cupsRasterReadHeader2(ras, &header) ) {
+        log_error("ERROR", "Unexpected extra page!");
+        failure = FUNCTION_FAILURE;
+    }
+
+    cupsRasterClose(ras);
+    free(line);
+
+    return failure;
+}
+
+/*
+ * run() - 用一种编码器写出一种格式的 copies 份（逐份），再读回来检查。
+ */
+static int
+run(
+    output_format_t format,
+    unsigned        pixel_size,
+    int             use_cups,
+    unsigned        copies
+) {
+    const size_t        bytes = (size_t) width * height * pixel_size;
+    uint8_t             *pixels = (uint8_t *) malloc(bytes);
+    char                filename[] = "/tmp/rasterout_test_XXXXXX";
+    int                 fd = mkstemp(filename);
+    cups_page_header2_t source;
+    output_sink_t       sink;
+    rasterout_t         out;
+    unsigned            page,
+                        copy;
+    unsigned long long  job_start = 0;  /* 第一页在输出记录中的位置 */
+    double              start, elapsed = 0;
+    int                 failure = FUNCTION_SUCCESS;
+
+    if ( pixels == NULL || fd == -1 || ! output_open(&sink, fd, 0) ) {
+        log_error("ERROR", "Unable to set up the test!");
+        free(pixels);
+        return FUNCTION_FAILURE;
+    }
+    unlink(filename);
+
+    /* 原来的页头是 16 位的纵向页面，输出时转为横向。 */
+    memset(&source, 0, sizeof(source));
+    source.PageSize[0] = 595;
+    source.PageSize[1] = 842;
+    source.cupsBitsPerColor = 16;
+    source.cupsColorSpace = ( pixel_size == 1 )? CUPS_CSPACE_W: CUPS_CSPACE_RGB;
+    source.NumCopies = 1;
+
+    if ( ! rasterout_open(&out, format, use_cups, &sink) ) {
+        failure = FUNCTION_FAILURE;
+    }
+    /* 同步字写在记录开始之前，第一份从第一页的页头开始重放。 */
+    if ( copies > 1 && failure == FUNCTION_SUCCESS ) {
+        if ( ! output_spool_begin(&sink) ) {
+            failure = FUNCTION_FAILURE;
+        }
+        job_start = output_spool_mark(&sink);
+    }
+    for ( page = 0; page < pages && failure == FUNCTION_SUCCESS; page ++ ) {
+        fill(pixels, pixel_size, page);
+        start = now();
+        if ( ! rasterout_write_page(&out, &source, pixels, width, height, pixel_size, 300, 600, 1) ) {
+            log_error("ERROR", "Unable to write page!");
+            failure = FUNCTION_FAILURE;
+        }
+        elapsed += now() - start;
+    }
+    if ( copies > 1 && failure == FUNCTION_SUCCESS && output_flush(&sink) ) {
+        for ( copy = 1; copy < copies; copy ++ ) {
+            if ( ! output_spool_replay(&sink, job_start, sink.spool_size - job_start) ) {
+                failure = FUNCTION_FAILURE;
+            }
+        }
+    }
+    printf("%-6s %2u-bit  %-8s %8.2f ms/page  %5.1f%% of raw  %u %s\n",
+        ( format == OUTPUT_FORMAT_PWG )? "pwg": "raster", pixel_size * 8, use_cups? "libcups": "builtin",
+        elapsed * 1000 / pages, 100.0 * out.encoded_bytes / ( (double) bytes * pages ),
+        copies, ( copies > 1 )? "collated copies": "copy");
+    rasterout_close(&out);
+    if ( ! output_close(&sink) ) {
+        failure = FUNCTION_FAILURE;
+    }
+
+    if ( failure == FUNCTION_SUCCESS && ! check(fd, format, pixels, pixel_size, copies) ) {
+        failure = FUNCTION_FAILURE;
+    }
+
+    close(fd);
+    free(pixels);
+
+    return failure;
+}
+
+/*
+ * main() - 程序主入口。
+ */
+int                                 /* 输出 - 0 成功，1 失败 */
+main(
+    int argc,                       /* 输入 - 命令行参数个数。 */
+    char *argv[]                    /* 输入 - 命令行参数内容。 */
+) {
+    output_format_t format;
+    unsigned        pixel_size;
+    int             use_cups,
+                    failure = FUNCTION_SUCCESS;
+
+    puts("A raster output testing tool distributed under the AGPL.");
+    puts("Copyright (c) 2023 Leisquid Li.\n");
+
+    for ( format = OUTPUT_FORMAT_RASTER; format <= OUTPUT_FORMAT_PWG; format ++ ) {
+        for ( pixel_size = 1; pixel_size <= 3; pixel_size += 2 ) {
+            for ( use_cups = 0; use_cups <= 1; use_cups ++ ) {
+                if ( ! run(format, pixel_size, use_cups, 1) ) {
+                    failure = FUNCTION_FAILURE;
+                }
+            }
+        }
+        if ( ! run(format, 3, 0, 2) ) {
+            failure = FUNCTION_FAILURE;
+        }
+    }
+
+    puts(( failure == FUNCTION_SUCCESS )? "All raster round trips passed.\nBye.": "Some raster round trips failed.\nBye.");
+
+    return ( failure == FUNCTION_SUCCESS )? EXIT_SUCCESS: EXIT_FAILURE;
+}
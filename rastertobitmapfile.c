@@ -25,11 +25,61 @@
  */
 
 #include "bitmap.h"
+#include "resample.h"
+#include "transform.h"
+#include "colorlut.h"
+#include "pnm.h"
+#include "input.h"
+#include "pagehash.h"
+#include "rasterindex.h"
+#include "pagerange.h"
+#include "palette.h"
+#include "workpool.h"
+#include "trace.h"
+#include "tile.h"
+#include "coverage.h"
+#include "crop.h"
+#include "rasterout.h"
 #include <cups/raster.h>
 #include <signal.h>
+#include <unistd.h>
 
 static int  CancelJob = 0;          /* 设为 1 时取消当前任务 */
 static int  ColorMode = 0;          /* 颜色模式，设为 1 时为彩色 */
+static colorlut_t *ColorLut = NULL; /* 颜色查找表，不做颜色管理时为 NULL */
+static int  AutoGray = 1;           /* 设为 1 时把灰色的彩色页面输出为 8 位 bitmap */
+static int  UsePalette = 0;         /* 设为 1 时把不超过 256 种颜色的彩色页面输出为带调色板的 8 位 bitmap */
+static palette_t PageColors;        /* 当前页的颜色统计 */
+static int  Dedup = 0;              /* 设为 1 时重用与之前相同的页面的输出文件 */
+static workpool_t Workers;          /* 页内并行转换的线程池 */
+static int  Tiled = 0;              /* 设为 1 时分块输出 */
+static tile_writer_t Tiles;         /* 分块输出 */
+static int  StreamRows = 0;         /* 设为 1 时很宽的纯色行用 non-temporal 存储写入页缓冲 */
+static unsigned long long SolidRows = 0,    /* 只转换了第一个像素的纯色行数 */
+                          ConvertedRows = 0;/* 转换的总行数 */
+static int  Coverage = 0;           /* 设为 1 时统计墨水覆盖率 */
+static coverage_t PageCoverage;     /* 当前页的墨水覆盖率统计 */
+static int  Crop = 0;               /* 设为 1 时只输出页面内容的边界 */
+
+/*
+ * 一段待并行转换的行：raster 行按顺序读进 rows，转换结果按行号写进 output。
+ * 有 v2 流的页索引时各小段先从索引解码自己的行。
+ */
+typedef struct {
+    cups_page_header2_t *header;        /* 页头 */
+    unsigned char       *rows;          /* 读进来的 raster 行 */
+    const rasterindex_t *index;         /* 不为 NULL 时从索引解码 */
+    unsigned            page,           /* 索引中的页号 */
+                        first_row;      /* 这一段第一行的行号 */
+    uint8_t             *output;        /* 转换后的像素行 */
+    size_t              output_stride;  /* 转换后每行的字节数 */
+    unsigned            num_rows;       /* 行数 */
+    int                 failed,         /* 有行转换失败时为 1 */
+                        gray;           /* 彩色页面到目前为止全为灰色时为 1，转换线程发现彩色像素时清零 */
+} band_t;
+static unsigned ReflinkedFiles = 0, /* 用 FICLONE 得到的拷贝文件数 */
+                CopiedFiles = 0,    /* 用 copy_file_range() 得到的拷贝文件数 */
+                LinkedFiles = 0;    /* 用硬链接得到的文件数 */
 
 static int sread(void *dest, size_t size, size_t n, const void const* origin);
 static int swrite(const void const* origin, size_t size, size_t n, void *dest);
@@ -38,8 +88,12 @@ static int setup(bitmap_job_data_t *job);
 static int start_page(bitmap_job_data_t *job, cups_page_header2_t *header);
 static int output_line_color(cups_page_header2_t *header, unsigned char *line, bitmap_24bit_pixel *output_stream);
 static int output_line_bw(cups_page_header2_t *header, unsigned char *line, bitmap_8bit_pixel *output_stream);
+static void convert_rows(void *data, unsigned task);
+static int read_header(cups_raster_t *ras, const rasterindex_t *index, unsigned page, cups_page_header2_t *header);
+static int skip_page(cups_raster_t *ras, input_stream_t *input, cups_page_header2_t *header);
 static int end_page(bitmap_job_data_t *job, cups_page_header2_t *header);
 static int rtd_shutdown(bitmap_job_data_t *job);
+static int clone_file(output_sink_t *sink, const char *source, unsigned file_index, int hardlink);
 
 /*
  * main() - 程序主入口。
@@ -53,10 +107,29 @@ main(
     int                 page = 0;       /* 当前页数 */
     int                 fd;             /* raster 数据的文件描述符 */
     cups_raster_t       *ras = NULL;    /* raster 流 */
+    input_stream_t      input;          /* raster 输入流 */
+    rasterindex_t       raster_index;   /* 映射的 raster 文件的页索引 */
+    int                 indexed = 0;    /* 是否按页索引读入 */
+    pagerange_t         ranges;         /* page-ranges 与 page-set 选中的页面 */
+    int                 ranged,         /* 是否只输出选中的页面 */
+                        printed = 0,    /* 输出的页数 */
+                        skipped;        /* 跳过当前页是否成功 */
     cups_page_header2_t header;         /* 当前页头数据 */
     unsigned            y,              /* 当前行 */
                         one_line_bytes;
-    unsigned char       *line = NULL;   /* 行缓冲 */
+    unsigned char       *line = NULL;   /* 行缓冲，一次读入一段行 */
+    uint8_t             *row_buffer = NULL; /* 重采样前的像素行 */
+
+    resample_t          resampler;      /* 分辨率重采样器 */
+    unsigned            out_width,      /* 输出图像宽度 */
+                        out_height,     /* 输出图像高度 */
+                        x_res,          /* 输出横向分辨率 (dpi) */
+                        y_res;          /* 输出纵向分辨率 (dpi) */
+    transform_op_t      page_op;        /* raster 像素阵变为 bitmap 像素阵的变换 */
+    output_format_t     out_format;     /* 输出格式 */
+    int                 raster_cups;    /* raster 输出是否用 libcups 编码 */
+    rasterout_t         raster;         /* 当前页的 raster 输出 */
+    unsigned            pixel_size;     /* 输出的每个像素的字节数 */
 
     int                 line_count = 0,
                         line_cached = 0;
@@ -65,20 +138,130 @@ main(
 
     void                *buffer = NULL, /* 像素阵缓冲 */
                         *buffer_starting_ptr = NULL;
-    FILE                *fp = NULL;     /* 输出文件 */
+    int                 out_fd;         /* 输出文件 */
+    output_sink_t       sink;           /* 输出文件的输出流 */
+    const char          *raster_encoder;/* bitmap-raster-encoder 选项 */
     char                filename[256];  /* 输出文件名 */
+    unsigned            file_index = 0; /* 输出文件的编号 */
+    int                 copies = 1,     /* 份数 */
+                        collate = 0,    /* 是否逐份输出 */
+                        copy;
+    char                **written = NULL,   /* 逐份输出时，第一份的所有文件名 */
+                        **names;
+    unsigned            num_written = 0;
+    int                 page_gray;      /* 当前彩色页面是否全为灰色 */
+    int                 page_indexed;   /* 当前彩色页面是否不超过 256 种颜色 */
+    pagehash_table_t    pages;          /* 已输出的页面 */
+    pagehash_t          page_hash;      /* 当前页的散列 */
+    uint64_t            digest[2];      /* 当前页的散列值 */
+    const pagehash_entry_t  *same;      /* 与当前页相同的页面 */
+    const char          *threads;       /* bitmap-threads 选项 */
+    const char          *coverage_path; /* 覆盖率 JSON 文件的路径 */
+    FILE                *coverage_file; /* 覆盖率 JSON 文件 */
+    coverage_t          job_coverage;   /* 整个任务的墨水覆盖率统计 */
+    const char          *crop_path;     /* 裁剪位置 JSON 文件的路径 */
+    FILE                *crop_file;     /* 裁剪位置 JSON 文件 */
+    crop_t              page_crop;      /* 当前页内容的边界 */
+    unsigned            crop_x,         /* 输出的矩形在页面中的位置 */
+                        crop_y,
+                        crop_width,
+                        crop_height,
+                        page_width = 0, /* 裁剪前的页面尺寸 */
+                        page_height = 0;
+    unsigned            tile_width,     /* 块的宽度 */
+                        tile_height;    /* 块的高度 */
+    band_t              band;           /* 当前这一段行 */
+    unsigned            band_rows,      /* 每段的行数 */
+                        rows,           /* 这一段读进来的行数 */
+                        index;
+    uint8_t             *converted;     /* 这一段中转换好的一行 */
 
     bitmap_file_header  file_header;    /* bitmap 文件头部 */
     bitmap_info_header  info_header;    /* bitmap 位图头部 */
 
     // sleep(30);      /* sleep to make it attachable by GDB */
 
+    /* 按 LEISRASTERFILTER_TRACE 环境变量打开时间线记录。 */
+    trace_init();
+
     /* 初始化操作。 */
     if ( ( init_job(argc, argv, &job) ) == FUNCTION_FAILURE ) {
         log_error("Error", "Initialization failed");
         return EXIT_FAILURE;
     }
 
+    /* 按 orientation-requested 选项确定页面变换。 */
+    page_op = transform_bitmap_op(&job);
+
+    /* 按 bitmap-format 选项确定输出格式。 */
+    out_format = output_format_from_job(&job);
+
+    /*
+     * raster 输出的行从上到下排列，只需要旋转。默认用内置编码器，
+     * 可以用 bitmap-raster-encoder=libcups 改用 libcups。
+     */
+    if ( out_format == OUTPUT_FORMAT_RASTER || out_format == OUTPUT_FORMAT_PWG ) {
+        page_op = transform_raster_op(&job);
+    }
+    raster_encoder = cupsGetOption("bitmap-raster-encoder", job.num_options, job.options);
+    raster_cups = ( raster_encoder != NULL && ! strcasecmp(raster_encoder, "libcups") );
+
+    /* 按任务选项准备颜色查找表。 */
+    ColorLut = colorlut_from_job(&job);
+
+    /* 重用相同页面的输出文件，用 bitmap-dedup=true 打开。 */
+    Dedup = job_option_bool("bitmap-dedup", job.num_options, job.options, 0);
+    if ( Dedup && ! OUTPUT_FORMAT_CONVERTS(out_format) ) {
+        /* PNM/PAM 直通输出不计算页面的散列，记录输出只是白白占用 memfd。 */
+        log_debug("Info", "bitmap-dedup is ignored for PNM output.");
+        Dedup = 0;
+    }
+
+    /* 灰色的彩色页面输出为 8 位 bitmap，可以用 bitmap-auto-gray=false 关闭。 */
+    AutoGray = job_option_bool("bitmap-auto-gray", job.num_options, job.options, 1);
+
+    /* 颜色少的彩色页面输出为带调色板的 8 位 bitmap，用 bitmap-palette=true 打开。 */
+    UsePalette = job_option_bool("bitmap-palette", job.num_options, job.options, 0);
+
+    /* 页内并行转换，用 bitmap-threads=线程数 或 auto 打开。 */
+    threads = cupsGetOption("bitmap-threads", job.num_options, job.options);
+    workpool_init(&Workers, workpool_threads(threads));
+    if ( Workers.num_threads > 0 ) {
+        fprintf(stderr, "DEBUG: Converting rows with %u threads\n", Workers.num_threads + 1);
+    }
+
+    /* 很大的页面分块输出，用 bitmap-tile=边长 或 宽x高 打开。 */
+    Tiled = ( out_format == OUTPUT_FORMAT_BMP && tile_options(&job, &tile_width, &tile_height) );
+    if ( Tiled && page_op != TRANSFORM_FLIP_VERTICAL ) {
+        log_debug("Info", "Tiled output ignores orientation-requested.");
+    }
+    /*
+     * 统计墨水覆盖率，用 bitmap-coverage=true 打开，按页和按任务以 ATTR: 消息报告，
+     * 并写成 JSON 文件（路径由 LEISRASTERFILTER_COVERAGE 环境变量给出，默认为
+     * /tmp/coverage.json）。设置了环境变量时也会打开。
+     */
+    coverage_path = getenv(COVERAGE_ENV);
+    Coverage = ( job_option_bool("bitmap-coverage", job.num_options, job.options, 0)
+        || coverage_path != NULL );
+    if ( Coverage && ! OUTPUT_FORMAT_CONVERTS(out_format) ) {
+        log_debug("Info", "Ink coverage is not measured for PNM output.");
+        Coverage = 0;
+    }
+    coverage_reset(&job_coverage, 0);
+    coverage_file = coverage_json_open(Coverage? ( ( coverage_path != NULL )? coverage_path: "/tmp/coverage.json" ): NULL);
+    /*
+     * 只输出页面内容的边界，用 bitmap-crop=true 打开。输出的矩形在页面中的位置
+     * 写进 JSON 文件，路径由 LEISRASTERFILTER_CROP 环境变量给出，默认为 /tmp/crop.json。
+     */
+    Crop = job_option_bool("bitmap-crop", job.num_options, job.options, 0);
+    if ( Crop && ( ! OUTPUT_FORMAT_CONVERTS(out_format) || Tiled ) ) {
+        log_debug("Info", "bitmap-crop is ignored for tiled and PNM output.");
+        Crop = 0;
+    }
+    crop_path = getenv(CROP_ENV);
+    crop_file = crop_json_open(Crop? ( ( crop_path != NULL )? crop_path: "/tmp/crop.json" ): NULL);
+    pagehash_table_init(&pages);
+
     /* 注册一个信号处理器。 */
     signal(SIGTERM, SignalHandler);
 
@@ -87,6 +270,18 @@ main(
         return EXIT_FAILURE;
     }
 
+    /*
+     * 准备输出。默认用 io_uring 异步写文件，写请求可以跨页在途；
+     * 可以用 bitmap-async-io=false 改为同步写入。
+     */
+    if ( ! output_open_files(
+            &sink,
+            job_option_bool("bitmap-async-io", job.num_options, job.options, 1)
+    ) ) {
+        return EXIT_FAILURE;
+    }
+    tile_writer_init(&Tiles, tile_width, tile_height, "/tmp", &sink, &Workers, AutoGray);
+
     /* 打开 raster 流。 */
     if ( argc >= 7 ) {
         if ( ( fd = open(argv[6], O_RDONLY) ) == -1 ) {
@@ -96,31 +291,148 @@ main(
     } else {
         fd = 0;     /* 从标准输入读入 */
     }
-    ras = cupsRasterOpen(fd, CUPS_RASTER_READ);
+
+    /*
+     * 输入是普通文件时映射整个文件，按页索引直接取页头和像素行，
+     * 可以用 bitmap-index=false 关闭。
+     */
+    if ( OUTPUT_FORMAT_CONVERTS(out_format)
+            && job_option_bool("bitmap-index", job.num_options, job.options, 1)
+            && rasterindex_open(&raster_index, fd, ( argc >= 7 )? argv[6]: NULL) ) {
+        indexed = 1;
+        fprintf(stderr, "DEBUG: Indexed %u pages of a v%u raster stream%s\n",
+            raster_index.num_pages, raster_index.version, raster_index.loaded? " from the saved index": "");
+    } else {
+        /* 预读 raster 数据，可以用 bitmap-readahead=false 关闭。 */
+        if ( ! input_open(
+                &input,
+                fd,
+                job_option_bool("bitmap-readahead", job.num_options, job.options, 1)
+        ) ) {
+            return EXIT_FAILURE;
+        }
+        ras = input_raster_open(&input);
+    }
+
+    /* 从文件读入时按 page-ranges 和 page-set 挑选页面。 */
+    ranged = ( argc >= 7 && pagerange_init(&ranges, job.num_options, job.options) );
 
     /* 处理页面。 */
-    while ( cupsRasterReadHeader2(ras, &header) ) {
+    while ( read_header(ras, indexed? &raster_index: NULL, page, &header) ) {
         /* 检查是否有任务取消。 */
         if ( CancelJob ) {
             break;
         }
+        page ++;
+
+        /* 没有选中的页面在流的层面跳过：不转换，也不分配页缓冲。 */
+        if ( ranged && ! pagerange_wanted(&ranges, page) ) {
+            if ( pagerange_done(&ranges, page) ) {
+                break;
+            }
+            TRACE_BEGIN("skip page", page);
+            skipped = ( indexed || skip_page(ras, &input, &header) );
+            TRACE_END("skip page");
+            if ( ! skipped ) {
+                break;
+            }
+            continue;
+        }
 
         /* 开始打印了。 */
-        page ++;
+        printed ++;
+        TRACE_BEGIN("page", page);
         fprintf(stderr, "PAGE: %d of %d\n", page, header.NumCopies);
         log_debug("Info", "Starting page");
 
+        /*
+         * 多份输出只转换一次：不逐份时每页写完马上拷贝成后面的几个文件，
+         * 逐份时等第一份全部写完再整份拷贝。
+         */
+        if ( printed == 1 ) {
+            copies = ( header.NumCopies > 1 )? (int) header.NumCopies: job.copies;
+            collate = job.collate || header.Collate;
+            if ( Tiled && ( copies > 1 || Dedup ) ) {
+                log_debug("Info", "Tiled output ignores copies and bitmap-dedup.");
+                copies = 1;
+                Dedup = 0;
+            }
+            if ( copies > 1 ) {
+                fprintf(stderr, "DEBUG: Producing %d %s copies from one conversion\n",
+                    copies, collate? "collated": "uncollated");
+            }
+        }
+
         if ( !start_page(&job, &header) ) {
             break;
         }
 
-        /* 分配页缓冲内存和行内存。 */
-        if (ColorMode == 1) {
+        if ( ! OUTPUT_FORMAT_CONVERTS(out_format) ) {
+            /* PNM/PAM 直通输出：逐行写出，不分配页缓冲，也不做转换和上下翻转。 */
+            sprintf(filename, "/tmp/%05u.%s", ++ file_index, pnm_extension(out_format, &header));
+            fprintf(stderr, "[++] Opening file: %s\n", filename);
+            unlink(filename);
+            if ( ( out_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644) ) == -1 ) {
+                log_error("Error", "Unable to open output file!");
+                break;
+            }
+            output_begin_file(&sink, out_fd);
+            if ( ! pnm_write_page(ras, &header, out_format, &sink, &CancelJob) || ! output_end_file(&sink) ) {
+                log_error("ERROR", "Output failure!");
+            }
+            fprintf(stderr, "[++] Closing file: %s\n", filename);
+
+            /* 多份输出。 */
+            for ( copy = 1; copy < copies && ! collate; copy ++ ) {
+                clone_file(&sink, filename, ++ file_index, 0);
+            }
+            if ( copies > 1 && collate && ( names = (char **) realloc(written, ( num_written + 1 ) * sizeof(char *)) ) != NULL ) {
+                written = names;
+                written[num_written ++] = strdup(filename);
+            }
+
+            log_debug("Info", "Finishing page");
+            if ( ! end_page(&job, &header) ) {
+                break;
+            }
+            continue;
+        }
+
+        /* 按任务选项准备重采样，得到输出图像的尺寸。 */
+        if ( ! resample_setup_page(
+                &resampler,
+                &job,
+                &header,
+                ( ColorMode == 1 )? sizeof(bitmap_24bit_pixel): sizeof(bitmap_8bit_pixel)
+        ) ) {
+            break;
+        }
+        out_width = resampler.dst_width;
+        out_height = resampler.dst_height;
+
+        /* 分配页缓冲内存和行内存。分块输出时只分配一条的缓冲。 */
+        if ( Tiled ) {
+            if ( ! tile_page_begin(
+                    &Tiles,
+                    ++ file_index,
+                    out_width,
+                    out_height,
+                    resampler.channels,
+                    resampler.dst_x_res,
+                    resampler.dst_y_res,
+                    resample_max_rows(&resampler)
+            ) ) {
+                break;
+            }
+        } else if ( ! bitmap_size_fits(out_width, out_height, resampler.channels) ) {
+            log_error("Error", "Page is too large for one bitmap file, use bitmap-tile!");
+            break;
+        } else if (ColorMode == 1) {
             if ( (
                 buffer = (bitmap_24bit_pixel *) malloc(
                             sizeof(bitmap_24bit_pixel)
-                            * header.cupsWidth
-                            * (header.cupsHeight + 1024)
+                            * out_width
+                            * ( (size_t) out_height + 1024 )
                 ) ) == NULL
             ) {
                 log_error("Error", "Unable to allocate color page buffer!");
@@ -130,8 +442,8 @@ main(
             if ( (
                 buffer = (bitmap_8bit_pixel *) malloc(
                             sizeof(bitmap_8bit_pixel)
-                            * header.cupsWidth
-                            * (header.cupsHeight + 1024)
+                            * out_width
+                            * ( (size_t) out_height + 1024 )
                 ) ) == NULL
             ) {
                 log_error("Error", "Unable to allocate b/w page buffer!");
@@ -139,93 +451,342 @@ main(
             }
         }
         buffer_starting_ptr = buffer;
+        /* 按索引读入时一段至少 WORKPOOL_BAND_ROWS 行，小段都从检查点开始解码。 */
+        band_rows = ( Workers.num_threads > 0 || indexed )? WORKPOOL_BAND_ROWS * ( Workers.num_threads + 1 ): 1;
         if ( (
             line = (unsigned char *) malloc(
-                        header.cupsBytesPerLine
+                        (size_t) header.cupsBytesPerLine * band_rows
             ) ) == NULL ) {
             log_error("Error", "Unable to allocate line memory!");
             break;
         }
+        if ( resampler.filter != RESAMPLE_NONE || Tiled ) {
+            /* 重采样（或分块）时先把一段行转换到行缓冲，再逐行交给重采样器写入页缓冲。 */
+            if ( (
+                row_buffer = (uint8_t *) malloc(
+                            (size_t) resampler.channels * header.cupsWidth * band_rows
+                ) ) == NULL ) {
+                log_error("Error", "Unable to allocate resampling row memory!");
+                break;
+            }
+        }
+
+        /* 直接转换到页缓冲时，很宽的纯色行不经过缓存。 */
+        StreamRows = ( row_buffer == NULL );
+
+        /* 转换线程逐行检查彩色页面是否全为灰色。 */
+        page_gray = ( AutoGray && ColorMode == 1 && ! Tiled );
+
+        /* 转换线程统计这一页的墨水覆盖率。 */
+        coverage_reset(&PageCoverage, ( ColorMode == 1 )? 3: 1);
+
+        /* 逐行找出页面内容的边界。 */
+        crop_reset(&page_crop, out_width, out_height, ( ColorMode == 1 )? sizeof(bitmap_24bit_pixel): sizeof(bitmap_8bit_pixel));
+
+        /* 彩色页面逐行统计颜色数。 */
+        if ( ( page_indexed = ( UsePalette && ColorMode == 1 && ! Tiled && out_format == OUTPUT_FORMAT_BMP ) ) ) {
+            palette_reset(&PageColors);
+        }
+
+        /* 页头也计入散列，页头不同的页面不会被当作相同。 */
+        if ( Dedup ) {
+            pagehash_init(&page_hash, &header, sizeof(header));
+        }
 
         /* 打印页面上的每一行。 */
-        for (y = 0; y < header.cupsHeight; y ++) {
+        band.header = &header;
+        band.rows = line;
+        band.index = ( indexed && raster_index.version == 2 )? &raster_index: NULL;
+        band.page = page - 1;
+        if ( row_buffer != NULL ) {
+            band.output_stride = (size_t) resampler.channels * header.cupsWidth;
+        } else {
+            band.output_stride = (size_t) out_width * ( ( ColorMode == 1 )? sizeof(bitmap_24bit_pixel): sizeof(bitmap_8bit_pixel) );
+        }
+        band.failed = 0;
+        band.gray = page_gray;
+        for (y = 0; y < header.cupsHeight; y += rows) {
             /* 检查是否有任务取消。 */
             if ( CancelJob ) {
                 break;
             }
 
-            /* 显示进度。 */
-            // if ( ( y & 128 ) == 0 ) {
-            //     // fprintf(stderr, "[--] Printing page %d, %.0f%% completed\r", page, (100.0 * y / header.cupsHeight));
-            //     fflush(stderr);
-            // }
+            if ( indexed ) {
+                /* 按索引取一段行：v3 的行直接用映射中的，v2 的行由各小段并行解码。 */
+                rows = raster_index.pages[page - 1].rows - y;
+                if ( rows > band_rows ) {
+                    rows = band_rows;
+                }
+                if ( raster_index.version == 3 && rows > 0 ) {
+                    band.rows = (unsigned char *) rasterindex_rows(&raster_index, page - 1, y);
+                }
+                band.first_row = y;
+            } else {
+                /* 按顺序读入一段行。 */
+                TRACE_BEGIN("decode", y);
+                for (rows = 0; rows < band_rows && y + rows < header.cupsHeight; rows ++) {
+                    if ( cupsRasterReadPixels(
+                            ras,
+                            line + (size_t) rows * header.cupsBytesPerLine,
+                            header.cupsBytesPerLine
+                    ) == 0 ) {
+                        break;
+                    }
+                }
+                TRACE_END("decode");
+            }
+            if ( rows == 0 ) {
+                break;
+            }
 
-            /* 读写每一行。 */
-            if (
-                (cupsRasterReadPixels(ras, line, header.cupsBytesPerLine) > 0)
-                // && (line_count < header.cupsHeight)
-            ) {
+            /* 分成几小段并行转换，每行写到按行号确定的位置。 */
+            band.output = ( row_buffer != NULL )? row_buffer: (uint8_t *) buffer;
+            band.num_rows = rows;
+            TRACE_BEGIN("convert", y);
+            workpool_run(&Workers, convert_rows, &band, ( rows + WORKPOOL_TASK_ROWS - 1 ) / WORKPOOL_TASK_ROWS);
+            TRACE_END("convert");
+            if ( band.failed ) {
+                break;
+            }
+            if ( Dedup ) {
+                for (index = 0; index < rows; index ++) {
+                    pagehash_row(&page_hash, band.rows + (size_t) index * header.cupsBytesPerLine, header.cupsBytesPerLine);
+                }
+            }
+
+            /* 重采样和颜色统计按行的顺序进行。 */
+            TRACE_BEGIN("finish rows", y);
+            for (index = 0; index < rows; index ++) {
+                converted = band.output + index * band.output_stride;
+                line_cached = 1;
                 if ( ColorMode == 1 ) {
-                    if ( ( line_cached = output_line_color(&header, line, buffer) ) == 0 ) {
-                        break;
+                    if ( row_buffer != NULL ) {
+                        line_cached = resample_push_row(&resampler, converted, Tiled? tile_page_rows(&Tiles): buffer);
+                    }
+                    if ( page_indexed ) {
+                        page_indexed = palette_add(&PageColors, buffer, (size_t) line_cached * out_width);
+                    }
+                    if ( ! Tiled ) {
+                        buffer += ( line_cached * out_width  * sizeof(bitmap_24bit_pixel) );
                     }
-                    buffer += ( line_cached * header.cupsWidth  * sizeof(bitmap_24bit_pixel) );
-                    line_count += line_cached;
                 } else {
-                    if ( ( line_cached = output_line_bw(&header, line, buffer) ) == 0 ) {
-                        break;
+                    if ( row_buffer != NULL ) {
+                        line_cached = resample_push_row(&resampler, converted, Tiled? tile_page_rows(&Tiles): buffer);
+                    }
+                    if ( ! Tiled ) {
+                        buffer += ( line_cached * out_width  * sizeof(bitmap_8bit_pixel) );
                     }
-                    buffer += ( line_cached * header.cupsWidth  * sizeof(bitmap_8bit_pixel) );
-                    line_count += line_cached;
                 }
-            } else {
+                if ( Crop ) {
+                    crop_rows(
+                        &page_crop,
+                        (uint8_t *) buffer_starting_ptr + (size_t) page_crop.next_row * out_width * page_crop.pixel_size,
+                        line_cached
+                    );
+                }
+                line_count += line_cached;
+                if ( Tiled && ! tile_page_advance(&Tiles, line_cached) ) {
+                    break;
+                }
+            }
+            TRACE_END("finish rows");
+            if ( index < rows ) {
+                /* 分块写出失败。 */
+                break;
+            }
+
+            /* 没读满一段说明读取出错了。 */
+            if ( rows < band_rows && y + rows < header.cupsHeight ) {
+                y += rows;
                 break;
             }
         }
 
         buffer = buffer_starting_ptr;
+        page_gray = band.gray;
+
+        if ( Coverage ) {
+            /* 报告这一页的墨水覆盖率，计入整个任务。 */
+            coverage_report("page-ink-coverage", &PageCoverage);
+            coverage_json_page(coverage_file, page, &PageCoverage);
+            coverage_merge(&job_coverage, &PageCoverage);
+        }
+
+        if ( Tiled ) {
+            /* 分块输出：写出剩下的行和这一页的清单。 */
+            if ( ! tile_page_end(&Tiles) ) {
+                log_error("ERROR", "Output failure!");
+            }
+            free(line);
+            free(row_buffer);
+            row_buffer = NULL;
+            resample_free(&resampler);
+
+            log_debug("Info", "Finishing page");
+            if ( ! end_page(&job, &header) ) {
+                break;
+            }
+            continue;
+        }
 
         log_debug("Info", "Okay, and we got the full raster pixels now.");
 
+        if ( Crop ) {
+            /* 只留下内容的边界，位置换算成输出的 bitmap 中从左上角算起的位置。 */
+            page_width = out_width;
+            page_height = out_height;
+            crop_page(&page_crop, buffer, &crop_x, &crop_y, &out_width, &out_height);
+            crop_width = out_width;
+            crop_height = out_height;
+            transform_rect(page_width, page_height, page_op, &crop_x, &crop_y, &crop_width, &crop_height);
+            if ( TRANSFORM_SWAPS_AXES(page_op) ) {
+                page_width = resampler.dst_height;
+                page_height = resampler.dst_width;
+            }
+            if ( out_format == OUTPUT_FORMAT_BMP ) {
+                transform_rect(page_width, page_height, TRANSFORM_FLIP_VERTICAL, &crop_x, &crop_y, &crop_width, &crop_height);
+            }
+            fprintf(stderr, "DEBUG: Page %d cropped to %ux%u at (%u, %u) of %ux%u\n",
+                page, crop_width, crop_height, crop_x, crop_y, page_width, page_height);
+        }
+
+        /* 完整读完的页面与之前的某一页相同时，重用那一页的输出文件。 */
+        same = NULL;
+        if ( Dedup && y == header.cupsHeight ) {
+            pagehash_final(&page_hash, digest);
+            if ( ( same = pagehash_table_find(&pages, digest) ) != NULL ) {
+                fprintf(stderr, "DEBUG: Page %d is identical to an earlier page (%s)\n", page, same->path);
+            }
+        }
+
         /*
          * 输出 bitmap 文件。
          */
-        sprintf(filename, "/tmp/%05d.bmp", page);
-        fprintf(stderr, "[++] Opening file: %s\n", filename);
-        fp = fopen(filename, "wb");
-        if ( ColorMode == 1 ) {
-            /* 对像素阵做上下反转处理。 */
-            pixel_24bit_matrix_upsidedown(buffer, header.cupsWidth, header.cupsHeight);
-            init_24bit_header(
-                &file_header,
-                &info_header,
-                header.cupsWidth,
-                header.cupsHeight
-            );
-            /* 输出到文件。 */
-            if ( bitmap_24bit_write(file_header, info_header, buffer, fp) != FUNCTION_SUCCESS ) {
-                log_error("ERROR", "Output failure!");
-            }
+        sprintf(filename, "/tmp/%05u.%s", ++ file_index, pnm_extension(out_format, &header));
+        if ( Crop ) {
+            crop_json_page(crop_file, page, filename + 5, crop_x, crop_y, crop_width, crop_height, page_width, page_height);
+        }
+        if ( same != NULL ) {
+            /* 与之前的某一页相同：直接链接到那一页的文件，不再变换和写出。 */
+            clone_file(&sink, same->path, file_index, 1);
         } else {
-            init_8bit_w_palette(&b8_palette);
-            pixel_8bit_matrix_upsidedown(buffer, header.cupsWidth, header.cupsHeight);
-            init_8bit_header(
-                &file_header,
-                &info_header,
-                header.cupsWidth,
-                header.cupsHeight
-            );
-            /* 输出到文件。 */
-            if ( bitmap_8bit_write(file_header, info_header, b8_palette, buffer, fp) != FUNCTION_SUCCESS ) {
+            fprintf(stderr, "[++] Opening file: %s\n", filename);
+            unlink(filename);
+            if ( ( out_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644) ) == -1 ) {
+                log_error("Error", "Unable to open output file!");
+                break;
+            }
+            output_begin_file(&sink, out_fd);
+            x_res = resampler.dst_x_res;
+            y_res = resampler.dst_y_res;
+            if ( TRANSFORM_SWAPS_AXES(page_op) ) {
+                x_res = resampler.dst_y_res;
+                y_res = resampler.dst_x_res;
+            }
+
+            if ( out_format != OUTPUT_FORMAT_BMP ) {
+                /* raster 输出：每页是一个完整的 raster 流，按需旋转后逐行编码，全为灰色的彩色页面按 8 位灰度输出。 */
+                pixel_size = ( ColorMode == 1 )? sizeof(bitmap_24bit_pixel): sizeof(bitmap_8bit_pixel);
+                if ( ColorMode == 1 && page_gray ) {
+                    fprintf(stderr, "DEBUG: Page %d is gray, writing 8-bit gray raster\n", page);
+                    buffer = bitmap_24bit_to_8bit(buffer, (size_t) out_width * out_height);
+                    pixel_size = sizeof(bitmap_8bit_pixel);
+                }
+                TRACE_BEGIN("flip", page);
+                if ( ! transform_page(&buffer, &out_width, &out_height, pixel_size, page_op) ) {
+                    log_error("Error", "Unable to transform page!");
+                }
+                TRACE_END("flip");
+                TRACE_BEGIN("encode", page);
+                if (
+                    ! rasterout_open(&raster, out_format, raster_cups, &sink)
+                    || ! rasterout_write_page(&raster, &header, buffer, out_width, out_height, pixel_size,
+                            x_res, y_res, TRANSFORM_SWAPS_AXES(page_op))
+                ) {
+                    log_error("ERROR", "Output failure!");
+                }
+                rasterout_close(&raster);
+                TRACE_END("encode");
+            } else if ( ColorMode == 1 && ! page_gray && ! page_indexed ) {
+                /* 对像素阵做上下反转（以及按需旋转）处理。 */
+                TRACE_BEGIN("flip", page);
+                if ( ! transform_page(&buffer, &out_width, &out_height, sizeof(bitmap_24bit_pixel), page_op) ) {
+                    log_error("Error", "Unable to transform color page!");
+                }
+                TRACE_END("flip");
+                TRACE_BEGIN("header init", page);
+                init_24bit_header(
+                    &file_header,
+                    &info_header,
+                    out_width,
+                    out_height
+                );
+                set_bitmap_resolution(&info_header, x_res, y_res);
+                TRACE_END("header init");
+                /* 输出到文件。 */
+                TRACE_BEGIN("encode", page);
+                if ( bitmap_write_sink(file_header, info_header, NULL, buffer, &sink) != FUNCTION_SUCCESS ) {
+                    log_error("ERROR", "Output failure!");
+                }
+                TRACE_END("encode");
+            } else {
+                init_8bit_w_palette(&b8_palette);
+                if ( ColorMode == 1 && page_gray ) {
+                    /* 全为灰色的彩色页面：压缩为 8 位像素阵，按灰度输出。 */
+                    fprintf(stderr, "DEBUG: Page %d is gray, writing an 8-bit bitmap\n", page);
+                    buffer = bitmap_24bit_to_8bit(buffer, (size_t) out_width * out_height);
+                } else if ( ColorMode == 1 ) {
+                    /* 不超过 256 种颜色的彩色页面：换成调色板下标，输出带调色板的 8 位 bitmap。 */
+                    fprintf(stderr, "DEBUG: Page %d has %u colors, writing an indexed 8-bit bitmap\n", page, PageColors.count);
+                    buffer = palette_index_page(&PageColors, buffer, (size_t) out_width * out_height);
+                    b8_palette = PageColors.palette;
+                }
+                TRACE_BEGIN("flip", page);
+                if ( ! transform_page(&buffer, &out_width, &out_height, sizeof(bitmap_8bit_pixel), page_op) ) {
+                    log_error("Error", "Unable to transform b/w page!");
+                }
+                TRACE_END("flip");
+                TRACE_BEGIN("header init", page);
+                init_8bit_header(
+                    &file_header,
+                    &info_header,
+                    out_width,
+                    out_height
+                );
+                set_bitmap_resolution(&info_header, x_res, y_res);
+                TRACE_END("header init");
+                /* 输出到文件。 */
+                TRACE_BEGIN("encode", page);
+                if ( bitmap_write_sink(file_header, info_header, &b8_palette, buffer, &sink) != FUNCTION_SUCCESS ) {
+                    log_error("ERROR", "Output failure!");
+                }
+                TRACE_END("encode");
+            }
+            if ( ! output_end_file(&sink) ) {
                 log_error("ERROR", "Output failure!");
             }
+            fprintf(stderr, "[++] Closing file: %s\n", filename);
+        }
+
+        if ( Dedup && same == NULL && y == header.cupsHeight ) {
+            pagehash_table_add(&pages, digest, 0, 0, filename);
+        }
+
+        /* 多份输出。 */
+        for ( copy = 1; copy < copies && ! collate; copy ++ ) {
+            clone_file(&sink, filename, ++ file_index, 0);
+        }
+        if ( copies > 1 && collate && ( names = (char **) realloc(written, ( num_written + 1 ) * sizeof(char *)) ) != NULL ) {
+            written = names;
+            written[num_written ++] = strdup(filename);
         }
-        fprintf(stderr, "[++] Closing file: %s\n", filename);
-        fclose(fp);
 
         /* 释放内存。 */
         free(buffer);
         free(line);
+        free(row_buffer);
+        row_buffer = NULL;
+        resample_free(&resampler);
 
         /* 显示进度并结束当前页。 */
         log_debug("Info", "Finishing page");
@@ -235,8 +796,65 @@ main(
         }
     }
 
+    /* 逐份输出时，第一份写完后整份拷贝出剩下的几份。 */
+    if ( written != NULL ) {
+        for ( copy = 1; copy < copies && ! CancelJob; copy ++ ) {
+            for ( y = 0; y < num_written; y ++ ) {
+                if ( written[y] != NULL ) {
+                    clone_file(&sink, written[y], ++ file_index, 0);
+                }
+            }
+        }
+        for ( y = 0; y < num_written; y ++ ) {
+            free(written[y]);
+        }
+        free(written);
+    }
+    if ( ReflinkedFiles + CopiedFiles + LinkedFiles > 0 ) {
+        fprintf(stderr, "DEBUG: Copies: %u files hard-linked, %u files reflinked, %u files copied in kernel\n",
+            LinkedFiles, ReflinkedFiles, CopiedFiles);
+    }
+    if ( ConvertedRows > 0 ) {
+        fprintf(stderr, "DEBUG: %llu of %llu rows (%.1f%%) were solid and filled without per-pixel conversion\n",
+            SolidRows, ConvertedRows, 100.0 * SolidRows / ConvertedRows);
+    }
+    if ( pages.hits > 0 ) {
+        fprintf(stderr, "DEBUG: %u of %d pages reused the output of an identical page\n", pages.hits, printed);
+    }
+    if ( printed < page ) {
+        fprintf(stderr, "DEBUG: Skipped %d pages not selected by page-ranges or page-set\n", page - printed);
+    }
+    pagehash_table_free(&pages);
+    if ( ! crop_json_close(crop_file) ) {
+        log_debug("Info", "Unable to write the crop file.");
+    }
+    if ( Coverage ) {
+        coverage_report("job-ink-coverage", &job_coverage);
+        if ( ! coverage_json_close(coverage_file, &job_coverage) ) {
+            log_debug("Info", "Unable to write the coverage file.");
+        }
+    }
+    if ( Tiled && ! tile_writer_finish(&Tiles) ) {
+        log_error("ERROR", "Output failure!");
+    }
+    workpool_free(&Workers);
+
+    /* 等待所有在途的写请求完成，关闭剩余的文件。 */
+    if ( ! output_close(&sink) ) {
+        log_error("ERROR", "Output failure!");
+    }
+
+    /* 关闭 raster 流。 */
+    if ( indexed ) {
+        rasterindex_close(&raster_index);
+    } else {
+        cupsRasterClose(ras);
+        input_close(&input);
+    }
+
     /* 结束打印任务。 */
     rtd_shutdown(&job);
+    colorlut_free(ColorLut);
 
     /* 显示最终状态。 */
     if (page == 0) {
@@ -374,6 +992,32 @@ output_line_color(
     bitmap_24bit_pixel  pixel;
     bitmap_24bit_pixel  line_buffer[num_pixels];
 
+    /* 整行都是同一种颜色（多半是白色）时只转换第一个像素，再填满这一行。 */
+    if ( num_pixels > 1 && bitmap_row_is_solid(line, header->cupsBytesPerLine, ( header->cupsBitsPerPixel + 7 ) / 8) ) {
+        if ( ColorLut != NULL ) {
+            colorlut_convert_color(ColorLut, line, header->cupsBitsPerColor, 1, output_stream);
+        } else if ( header->cupsBitsPerColor == 8 ) {
+            set_24bit_pixel_color(output_stream, line[0], line[1], line[2]);
+        } else {
+            sread(&pixel_48bit_buffer, sizeof(pixel_48bit_buffer), 1, line);
+            set_24bit_pixel_color(
+                output_stream,
+                ( ( pixel_48bit_buffer[0] + 129 ) / 257 ),
+                ( ( pixel_48bit_buffer[1] + 129 ) / 257 ),
+                ( ( pixel_48bit_buffer[2] + 129 ) / 257 )
+            );
+        }
+        bitmap_fill_row(output_stream, num_pixels, sizeof(bitmap_24bit_pixel), StreamRows);
+        __atomic_fetch_add(&SolidRows, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+
+    if ( ColorLut != NULL ) {
+        /* 颜色查找表和像素转换在同一个循环里完成，数据只过一遍。 */
+        colorlut_convert_color(ColorLut, line, header->cupsBitsPerColor, num_pixels, output_stream);
+        return 1;
+    }
+
     do {
         if ( header->cupsBitsPerColor == 8 ) {
             sread(&pixel_buffer, sizeof(pixel_buffer), 1, line);
@@ -412,7 +1056,7 @@ output_line_color(
             );
         }
         swrite(&pixel, sizeof(pixel), 1, &( line_buffer[pixels_count] ));
-    } while ( pixels_count ++ < num_pixels );
+    } while ( ++ pixels_count < num_pixels );
     swrite(line_buffer, sizeof(bitmap_24bit_pixel) * num_pixels, 1, output_stream);
 
     return 1;
@@ -434,6 +1078,26 @@ output_line_bw(
     bitmap_8bit_pixel   pixel;
     bitmap_8bit_pixel   line_buffer[num_pixels];
 
+    /* 整行都是同一个灰度时只转换第一个像素，再填满这一行。 */
+    if ( num_pixels > 1 && bitmap_row_is_solid(line, header->cupsBytesPerLine, ( header->cupsBitsPerPixel + 7 ) / 8) ) {
+        if ( ColorLut != NULL ) {
+            colorlut_convert_bw(ColorLut, line, header->cupsBitsPerColor, 1, output_stream);
+        } else if ( header->cupsBitsPerColor == 8 ) {
+            set_8bit_pixel_color(output_stream, line[0]);
+        } else {
+            sread(&pixel_16bit_buffer, sizeof(pixel_16bit_buffer), 1, line);
+            set_8bit_pixel_color(output_stream, (uint8_t) ( ( pixel_16bit_buffer + 129 ) / 257 ));
+        }
+        bitmap_fill_row(output_stream, num_pixels, sizeof(bitmap_8bit_pixel), StreamRows);
+        __atomic_fetch_add(&SolidRows, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+
+    if ( ColorLut != NULL ) {
+        colorlut_convert_bw(ColorLut, line, header->cupsBitsPerColor, num_pixels, output_stream);
+        return 1;
+    }
+
     do {
         if ( header->cupsBitsPerColor == 8 ) {
             sread(&pixel_buffer, sizeof(pixel_buffer), 1, line);
@@ -452,12 +1116,135 @@ output_line_bw(
             );
         }
         swrite(&pixel, sizeof(pixel), 1, &( line_buffer[pixels_count] ));
-    } while ( pixels_count ++ < num_pixels );
+    } while ( ++ pixels_count < num_pixels );
     swrite(line_buffer, sizeof(bitmap_8bit_pixel) * num_pixels, 1, output_stream);
 
     return 1;
 }
 
+/*
+ * convert_rows() - 转换一段行中的第 task 小段，由线程池调用。
+ */
+static void
+convert_rows(
+    void                *data,          /* 输入 - 这一段行 */
+    unsigned            task            /* 输入 - 小段编号 */
+) {
+    band_t              *band = (band_t *) data;
+    unsigned            row = task * WORKPOOL_TASK_ROWS,
+                        last = row + WORKPOOL_TASK_ROWS;
+    unsigned char       *line;
+    uint8_t             *output;
+    coverage_t          coverage;       /* 这一小段的墨水覆盖率统计 */
+    int                 gray;           /* 是否还需要检查灰色 */
+
+    if ( last > band->num_rows ) {
+        last = band->num_rows;
+    }
+    __atomic_fetch_add(&ConvertedRows, last - row, __ATOMIC_RELAXED);
+    if ( band->index != NULL ) {
+        /* 从最近的检查点解码这一小段的行。 */
+        TRACE_BEGIN("decode rows", band->first_row + row);
+        if ( ! rasterindex_read_rows(
+                band->index,
+                band->page,
+                band->first_row + row,
+                last - row,
+                band->rows + (size_t) row * band->header->cupsBytesPerLine
+        ) ) {
+            band->failed = 1;
+        }
+        TRACE_END("decode rows");
+        if ( band->failed ) {
+            return;
+        }
+    }
+    TRACE_BEGIN("convert rows", row);
+    if ( Coverage ) {
+        coverage_reset(&coverage, PageCoverage.channels);
+    }
+    gray = __atomic_load_n(&band->gray, __ATOMIC_RELAXED);
+    for ( ; row < last; row ++) {
+        line = band->rows + (size_t) row * band->header->cupsBytesPerLine;
+        output = band->output + row * band->output_stride;
+        if ( ColorMode == 1 ) {
+            if ( ! output_line_color(band->header, line, (bitmap_24bit_pixel *) output) ) {
+                band->failed = 1;
+            }
+        } else {
+            if ( ! output_line_bw(band->header, line, (bitmap_8bit_pixel *) output) ) {
+                band->failed = 1;
+            }
+        }
+        if ( gray && ! bitmap_24bit_is_gray((bitmap_24bit_pixel *) output, band->header->cupsWidth) ) {
+            /* 有一行不是灰色，其他小段也不必再检查。 */
+            gray = 0;
+            __atomic_store_n(&band->gray, 0, __ATOMIC_RELAXED);
+        }
+        if ( Coverage ) {
+            /* 刚转换好的行还在缓存中，马上统计。 */
+            coverage_add(&coverage, output, band->header->cupsWidth);
+        }
+    }
+    if ( Coverage ) {
+        coverage_merge(&PageCoverage, &coverage);
+    }
+    TRACE_END("convert rows");
+}
+
+/*
+ * read_header() - 读入下一页的页头，有页索引时直接从索引中取。
+ */
+static int                              /* 输出 - 1 成功，0 没有下一页 */
+read_header(
+    cups_raster_t       *ras,           /* 输入 - raster 流 */
+    const rasterindex_t *index,         /* 输入 - 页索引，可为 NULL */
+    unsigned            page,           /* 输入 - 页号（从 0 开始） */
+    cups_page_header2_t *header         /* 输出 - 页头 */
+) {
+    int                 result;
+
+    TRACE_BEGIN("read header", page);
+    if ( index != NULL ) {
+        result = rasterindex_read_header(index, page, header);
+    } else {
+        result = cupsRasterReadHeader2(ras, header);
+    }
+    TRACE_END("read header");
+
+    return result;
+}
+
+/*
+ * skip_page() - 跳过当前页的像素数据。不压缩的流在输入层跳过（能 lseek() 时直接
+ *               lseek()），压缩的流只能逐行解码，但不做转换。
+ */
+static int                              /* 输出 - 1 成功，0 数据不完整 */
+skip_page(
+    cups_raster_t       *ras,           /* 输入 - raster 流 */
+    input_stream_t      *input,         /* 输入 - 输入流 */
+    cups_page_header2_t *header         /* 输入 - 页头 */
+) {
+    unsigned char       *line;
+    unsigned            y;
+
+    if ( input_uncompressed(input) ) {
+        return input_skip(input, (unsigned long long) header->cupsBytesPerLine * header->cupsHeight);
+    }
+
+    if ( ( line = (unsigned char *) malloc(header->cupsBytesPerLine) ) == NULL ) {
+        return 0;
+    }
+    for (y = 0; y < header->cupsHeight; y ++) {
+        if ( cupsRasterReadPixels(ras, line, header->cupsBytesPerLine) == 0 ) {
+            break;
+        }
+    }
+    free(line);
+
+    return y == header->cupsHeight;
+}
+
 /*
  * end_page() - 结束处理当前页面。
  */
@@ -467,9 +1254,72 @@ end_page(                       /* 输出 - 1 成功，0 失败 */
     cups_page_header2_t *header /* 输入 - 页头 */
 ) {
     fprintf(stderr, "END_OF_PAGE\n");
+    TRACE_END("page");
     return FUNCTION_SUCCESS;
 }
 
+/*
+ * clone_file() - 把已经写完的输出文件拷贝为编号为 file_index 的输出文件，扩展名
+ *                与源文件相同。hardlink 为 1 时先试硬链接；拷贝前先等源文件的
+ *                在途写请求完成。
+ *
+ *                目标文件可能是上一个任务留下的硬链接，总是先删除再创建，免得
+ *                截断与它共享数据的文件。
+ */
+static int                                  /* 输出 - 1 成功，0 失败 */
+clone_file(
+    output_sink_t       *sink,              /* 输入 - 输出流 */
+    const char          *source,            /* 输入 - 源文件名 */
+    unsigned            file_index,         /* 输入 - 目标文件的编号 */
+    int                 hardlink            /* 输入 - 是否可以用硬链接 */
+) {
+    char                target[256];
+    const char          *extension = strrchr(source, '.');
+    int                 src_fd, dst_fd, result;
+
+    sprintf(target, "/tmp/%05u.%s", file_index, ( extension != NULL )? extension + 1: "bmp");
+    unlink(target);
+
+    if ( hardlink && link(source, target) == 0 ) {
+        fprintf(stderr, "[++] Linking file: %s -> %s\n", source, target);
+        LinkedFiles ++;
+        return FUNCTION_SUCCESS;
+    }
+
+    if ( ! output_sync(sink) ) {
+        return FUNCTION_FAILURE;
+    }
+    fprintf(stderr, "[++] Cloning file: %s -> %s\n", source, target);
+
+    if ( ( src_fd = open(source, O_RDONLY) ) == -1 ) {
+        log_error("Error", "Unable to open output file!");
+        return FUNCTION_FAILURE;
+    }
+    if ( ( dst_fd = open(target, O_WRONLY | O_CREAT | O_TRUNC, 0644) ) == -1 ) {
+        log_error("Error", "Unable to open output file!");
+        close(src_fd);
+        return FUNCTION_FAILURE;
+    }
+
+    result = output_copy_file(src_fd, dst_fd);
+    close(src_fd);
+    if ( close(dst_fd) != 0 ) {
+        result = OUTPUT_COPY_FAILED;
+    }
+
+    switch ( result ) {
+        case OUTPUT_COPY_REFLINK:
+            ReflinkedFiles ++;
+            return FUNCTION_SUCCESS;
+        case OUTPUT_COPY_RANGE:
+            CopiedFiles ++;
+            return FUNCTION_SUCCESS;
+        default:
+            log_error("ERROR", "Unable to copy output file!");
+            return FUNCTION_FAILURE;
+    }
+}
+
 /*
  * rtd_shutdown() - 结束当前任务。
  */
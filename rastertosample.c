@@ -25,16 +25,35 @@
  */
 
 #include "sample.h"
+#include "linecodec.h"
+#include "pagerange.h"
+#include "separation.h"
+#include "options.h"
 #include <cups/raster.h>
 #include <signal.h>
 
 static int  CancelJob = 0;          /* 设为 1 时取消当前任务 */
-
-static int  Setup(ppd_file_t *ppd, job_data_t *job);
-static int  StartPage(ppd_file_t *ppd, job_data_t *job, cups_page_header2_t *header);
-static int  OutputLine(ppd_file_t *ppd, cups_page_header2_t *header, unsigned char *line);
-static int  EndPage(ppd_file_t *ppd, job_data_t *job, cups_page_header2_t *header);
-static int  Shutdown(ppd_file_t *ppd, job_data_t *job);
+static int  Compression = 0;        /* 设为 1 时按行压缩 raster 数据 */
+static linecodec_t      Codec;      /* 行编码器 */
+static unsigned char    *Scratch = NULL;    /* 16 位数据转为 8 位后的行 */
+static int  SkipRows = 0;           /* 设为 1 时用 SKIP/REPEAT 代替空白行和重复行 */
+static linecodec_rows_t Rows;       /* 空白行与重复行的合并 */
+static unsigned         RowsSkipped = 0,    /* 本页用 SKIP 省掉的行数 */
+                        RowsRepeated = 0;   /* 本页用 REPEAT 省掉的行数 */
+static unsigned long long   PageBytes = 0;  /* 本页发出的字节数 */
+static int  FirstPage = 1;          /* 还没有结束过页面 */
+static separation_t     Separation; /* RGB 到 CMYK 的分色 */
+static int  Separate = 0;           /* 本页是否分色 */
+static size_t           RowBytes = 0;   /* 发给设备的每行字节数 */
+static uint8_t          Blank = 0xff;   /* 空白行的字节值，CMYK 为 0 */
+
+static int  Setup(ppdcache_t *ppd, job_data_t *job);
+static int  StartPage(ppdcache_t *ppd, job_data_t *job, cups_page_header2_t *header);
+static int  OutputLine(ppdcache_t *ppd, cups_page_header2_t *header, unsigned char *line);
+static int  FlushRows(unsigned skip, unsigned repeat);
+static int  SkipPage(cups_raster_t *ras, int fd, int seekable, cups_page_header2_t *header);
+static int  EndPage(ppdcache_t *ppd, job_data_t *job, cups_page_header2_t *header);
+static int  Shutdown(ppdcache_t *ppd, job_data_t *job);
 static void SignalHandler(int sig);
 
 /*
@@ -45,7 +64,7 @@ main(
     int argc,       /* 输入 - 命令行参数个数。 */
     char *argv[]    /* 输入 - 命令行参数内容。 */
 ) {
-    ppd_file_t          *ppd;       /* 用于打印机的 PPD 文件 */
+    ppdcache_t          *ppd;       /* 用于打印机的 PPD 文件 */
     job_data_t          job;        /* Job data */
     int                 page = 0;   /* 当前页数 */
     int                 fd;         /* raster 数据的文件描述符 */
@@ -53,6 +72,14 @@ main(
     cups_page_header2_t header;     /* 当前页头数据 */
     unsigned            y;          /* 当前行 */
     unsigned char       *line;      /* 行缓冲 */
+    progress_t          progress = { 0, 0, 0 };    /* 打印进度，由状态线程报告 */
+    const char          *interval;  /* 状态轮询间隔（秒） */
+    const char          *compression;   /* 行压缩方式 */
+    pagerange_t         ranges;         /* page-ranges 与 page-set 选中的页面 */
+    int                 ranged,         /* 是否只打印选中的页面 */
+                        seekable = 0,   /* 不选中的页面能否用 lseek() 跳过 */
+                        skipped = 0;    /* 跳过的页数 */
+    uint32_t            sync;           /* raster 流的同步字 */
 
     // sleep(30);      // sleep to make it attachable by GDB
 
@@ -65,11 +92,35 @@ main(
     /* 注册一个信号处理器。 */
     signal(SIGTERM, SignalHandler);
 
+    /* 整块缓冲标准输出，每行只做一次 fwrite()。 */
+    setvbuf(stdout, NULL, _IOFBF, SAMPLE_OUTPUT_BUFFER);
+
+    /* 行压缩，用 sample-compression=auto 打开。 */
+    compression = cupsGetOption("sample-compression", job.num_options, job.options);
+    Compression = ( compression != NULL && ! strcasecmp(compression, "auto") );
+
+    /* 空白行和重复行用 SKIP/REPEAT 命令代替，用 sample-skip-rows=true 打开。 */
+    SkipRows = job_option_bool("sample-skip-rows", job.num_options, job.options, 0);
+
+    /*
+     * RGB 页面分色为 CMYK 再发给设备，用 sample-separation=chunked 或 planar 打开。
+     * 查找表按 PPD 的 cupsAllGamma、cupsAllDensity、cupsBlackGeneration 和
+     * cupsUnderColorRemoval 属性生成一次。
+     */
+    separation_init(&Separation, ppd, cupsGetOption("sample-separation", job.num_options, job.options));
+
     /* 准备打印任务。 */
     if ( ! Setup(ppd, &job) ) {
         return EXIT_FAILURE;
     }
 
+    /*
+     * 状态轮询和进度报告放到单独的线程里，按时间间隔进行，
+     * 间隔可以用 sample-status-interval 选项（秒）设置。
+     */
+    interval = cupsGetOption("sample-status-interval", job.num_options, job.options);
+    StartStatusThread(ppd, ( interval != NULL )? atof(interval): STATUS_DEFAULT_INTERVAL, &progress);
+
     /* 打开 raster 流。 */
     if ( argc >= 6 ) {
         if ( ( fd = open(argv[6], O_RDONLY) ) == -1 ) {
@@ -81,6 +132,16 @@ main(
     }
     ras = cupsRasterOpen(fd, CUPS_RASTER_READ);
 
+    /*
+     * 从文件读入时按 page-ranges 和 page-set 挑选页面。libcups 读不压缩的流时不做
+     * 缓冲，不选中的页面可以直接 lseek() 过去。
+     */
+    ranged = ( argc >= 7 && pagerange_init(&ranges, job.num_options, job.options) );
+    if ( ranged && pread(fd, &sync, sizeof(sync), 0) == sizeof(sync) ) {
+        seekable = ( sync == CUPS_RASTER_SYNC || sync == CUPS_RASTER_REVSYNC
+                    || sync == CUPS_RASTER_SYNCv1 || sync == CUPS_RASTER_REVSYNCv1 );
+    }
+
     /* 处理页面。 */
     while ( cupsRasterReadHeader2(ras, &header) ) {
         /* 检查是否有任务取消。 */
@@ -88,6 +149,16 @@ main(
             break;
         }
 
+        /* 没有选中的页面不发给设备。 */
+        if ( ranged && ! pagerange_wanted(&ranges, (unsigned) page + 1) ) {
+            page ++;
+            if ( pagerange_done(&ranges, page) || ! SkipPage(ras, fd, seekable, &header) ) {
+                break;
+            }
+            skipped ++;
+            continue;
+        }
+
         /* 为这一行分配内存。 */
         fprintf(stderr, "DEBUG: cupsBytesPerLine=%u\n", header.cupsBytesPerLine);
 
@@ -106,6 +177,10 @@ main(
             break;
         }
 
+        __atomic_store_n(&(progress.row), 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&(progress.height), header.cupsHeight, __ATOMIC_RELAXED);
+        __atomic_store_n(&(progress.page), page, __ATOMIC_RELAXED);
+
         /* 打印页面上的每一行。 */
         for ( y = 0; y < header.cupsHeight; y ++ ) {
             /* 检查是否有任务取消。 */
@@ -113,15 +188,8 @@ main(
                 break;
             }
 
-            /* 显示进度。 */
-            if ( ( y & 128 ) == 0 ) {
-                fprintf(stdout, "++ Printing page %d, %.0f%% completed\n", page, (100.0 * y / header.cupsHeight));
-                puts("LEVELS");
-                fflush(stdout);
-            }
-
-            /* 根据设备检查状态信息。 */
-            GetStatus(ppd, 0.0);
+            /* 更新进度，由状态线程显示。 */
+            __atomic_store_n(&(progress.row), y, __ATOMIC_RELAXED);
 
             /* 读写每一行。 */
             if ( cupsRasterReadPixels(ras, line, header.cupsBytesPerLine) > 0 ) {
@@ -144,11 +212,17 @@ main(
         }
     }
 
-    /* 检查打印机状态。 */
+    if ( skipped > 0 ) {
+        fprintf(stderr, "DEBUG: Skipped %d pages not selected by page-ranges or page-set\n", skipped);
+    }
+
+    /* 停止状态线程，最后检查一次打印机状态。 */
+    StopStatusThread();
     GetStatus(ppd, 1.0);
 
     /* 结束打印任务。 */
     Shutdown(ppd, &job);
+    ppdcache_close(ppd);
 
     /* 显示最终状态。 */
     if ( page == 0 ) {
@@ -165,7 +239,7 @@ main(
  */
 static int              /* 输出 - 1 成功，0 失败 */
 Setup(
-    ppd_file_t  *ppd,   /* 输入 - 打印机用 PPD 文件 */
+    ppdcache_t  *ppd,   /* 输入 - 打印机用 PPD 文件 */
     job_data_t  *job    /* 输入 - 任务数据 */
 ) {
     /* 参数发送到打印机。 */
@@ -181,7 +255,7 @@ Setup(
  */
 static int                          /* 输出 - 1 成功，0 失败 */
 StartPage(
-    ppd_file_t *ppd,                /* 输入 - 打印机用 PPD 文件 */
+    ppdcache_t *ppd,                /* 输入 - 打印机用 PPD 文件 */
     job_data_t *job,                /* 输入 - 任务数据 */
     cups_page_header2_t *header     /* 输入 - 页头 */
 ) {
@@ -196,15 +270,54 @@ StartPage(
         return 0;
     } else if (
         header->cupsColorSpace != CUPS_CSPACE_W &&
-        header->cupsColorSpace != CUPS_CSPACE_RGB
+        header->cupsColorSpace != CUPS_CSPACE_RGB &&
+        header->cupsColorSpace != CUPS_CSPACE_SRGB
     ) {
         LogMessage("ERROR", "Bad cupsColorSpace");
         return 0;
     }
 
-    /* 页面设置指令发送到打印机。 */
+    /* RGB 页面分色后每个像素四个字节，空白行为全 0。 */
+    Separate = ( Separation.layout != SEPARATION_NONE && header->cupsNumColors == 3 );
+    RowBytes = (size_t) header->cupsWidth * ( Separate? 4: header->cupsNumColors );
+    Blank = Separate? 0x00: 0xff;
+
+    /* 页面设置指令发送到打印机。锁住 stdout，状态线程的输出不会插在中间。 */
+    flockfile(stdout);
     printf("PAGE %u %u %u %u\n", header->Margins[0], header->Margins[1], header->PageSize[0], header->PageSize[1]);
-    printf("RASTER %u %u %u\n", header->cupsWidth, header->cupsHeight, header->cupsNumColors);
+    if ( Separate ) {
+        printf("RASTER %u %u 4%s\n", header->cupsWidth, header->cupsHeight,
+            ( Separation.layout == SEPARATION_PLANAR )? " PLANAR": "");
+    } else {
+        printf("RASTER %u %u %u\n", header->cupsWidth, header->cupsHeight, header->cupsNumColors);
+    }
+    funlockfile(stdout);
+
+    /* 16 位数据先转为 8 位；压缩时每页从全零的种子行开始。 */
+    if ( header->cupsBitsPerColor == 16 ) {
+        if ( ( Scratch = malloc(header->cupsBytesPerLine / 2) ) == NULL ) {
+            LogMessage("ERROR", "Unable to allocate line memory!");
+            return 0;
+        }
+    }
+    if ( Separate && ! separation_start_page(&Separation, header->cupsWidth) ) {
+        LogMessage("ERROR", "Unable to allocate separation memory!");
+        return 0;
+    }
+    if ( Compression ) {
+        if ( ! linecodec_init(&Codec, RowBytes) ) {
+            LogMessage("ERROR", "Unable to allocate compression buffers!");
+            return 0;
+        }
+    }
+    if ( SkipRows ) {
+        if ( ! linecodec_rows_init(&Rows, RowBytes, Blank) ) {
+            LogMessage("ERROR", "Unable to allocate line memory!");
+            return 0;
+        }
+    }
+    RowsSkipped = RowsRepeated = 0;
+    PageBytes = 0;
 
     return 1;
 }
@@ -214,18 +327,20 @@ StartPage(
  */
 static int                          /* 输出 - 1 成功，0 失败 */
 OutputLine(
-    ppd_file_t          *ppd,       /* 输入 - 打印机用 PPD 文件 */
+    ppdcache_t          *ppd,       /* 输入 - 打印机用 PPD 文件 */
     cups_page_header2_t *header,    /* 输入 - 页头 */
     unsigned char       *line       /* 输入 - Raster 数据 */
 ) {
-    /* 将一行 raster 数据发送到打印机。 */
-    if ( header->cupsBitsPerColor == 8 ) {
-        /* 将 8 位数据发送到打印机。 */
-        printf("LINE %d\n", header->cupsBytesPerLine);
-        return ( fwrite(line, 1, header->cupsBytesPerLine, stdout) == header->cupsBytesPerLine );
-    } else {
+    const unsigned char *row = line;    /* 要发送的行 */
+    size_t              width = header->cupsBytesPerLine;
+    const uint8_t       *data;
+    size_t              length;
+    const char          *command = "LINE";
+    int                 result;
+
+    if ( header->cupsBitsPerColor == 16 ) {
         /*
-         * 将 16 位数据发送到打印机。通常是要做抖动处理的，但是这里只将 48 位 RGB
+         * 16 位数据。通常是要做抖动处理的，但是这里只将 48 位 RGB
          * 数据转为 24 位。
          *
          * 这个公式：
@@ -234,23 +349,127 @@ OutputLine(
          * (65535 / 255 = 257)。
          */
 
-        unsigned short  *pixel;     /* 当前像素 */
-        int             count;      /* 剩余计数 */
+        const unsigned short    *pixel = ( const unsigned short * ) line;  /* 当前像素 */
+        size_t                  index;
 
-        printf("LINE %d\n", header->cupsBytesPerLine / 2);
+        width /= 2;
+        for ( index = 0; index < width; index ++ ) {
+            Scratch[index] = ( pixel[index] + 129 ) / 257;
+        }
+        row = Scratch;
+    }
 
-        for (
-            pixel = ( unsigned short * ) line, count = header->cupsBytesPerLine / 2;
-            count > 0;
-            count --, pixel ++
-        ) {
-            if ( putchar(( *pixel + 129 ) / 257) == EOF ) {
-                return 0;
-            }
+    /* RGB 分色为 CMYK。 */
+    if ( Separate ) {
+        row = separation_convert(&Separation, row);
+        width = RowBytes;
+    }
+
+    /*
+     * 空白行和与上一行相同的行先只计数，遇到其他行或页面结束时
+     * 再发出一条 SKIP/REPEAT 命令。
+     */
+    if ( SkipRows ) {
+        unsigned        skip, repeat;   /* 这一行之前要发出的 SKIP/REPEAT 行数 */
+        int             send = linecodec_rows_push(&Rows, row, &skip, &repeat);
+
+        if ( ! FlushRows(skip, repeat) ) {
+            return 0;
+        }
+        if ( ! send ) {
+            return 1;
         }
+    }
 
-        return 1;
+    data = row;
+    length = width;
+    if ( Compression ) {
+        switch ( linecodec_encode(&Codec, row, &data, &length) ) {
+            case LINECODEC_PACKBITS :
+                command = "PACKBITS";
+                break;
+            case LINECODEC_DELTA :
+                command = "DELTA";
+                break;
+            default :
+                break;
+        }
     }
+
+    /* 将一行 raster 数据发送到打印机。整行锁住 stdout，状态线程的输出不会插在中间。 */
+    flockfile(stdout);
+    PageBytes += printf("%s %zu\n", command, length) + length;
+    result = ( fwrite(data, 1, length, stdout) == length );
+    funlockfile(stdout);
+
+    return result;
+}
+
+/*
+ * FlushRows() - 发出 SKIP/REPEAT 命令，先 SKIP 后 REPEAT。SKIP 之后设备端的上一行为空白行。
+ */
+static int                          /* 输出 - 1 成功，0 失败 */
+FlushRows(
+    unsigned            skip,       /* 输入 - 空白行数 */
+    unsigned            repeat      /* 输入 - 重复行数 */
+) {
+    int                 written,    /* 命令的字节数 */
+                        result = 1;
+
+    if ( skip > 0 ) {
+        if ( ( written = printf("SKIP %u\n", skip) ) > 0 ) {
+            PageBytes += written;
+        } else {
+            result = 0;
+        }
+
+        if ( Compression ) {
+            linecodec_set_seed(&Codec, Rows.blank_row);
+        }
+        RowsSkipped += skip;
+    }
+
+    if ( repeat > 0 ) {
+        if ( ( written = printf("REPEAT %u\n", repeat) ) > 0 ) {
+            PageBytes += written;
+        } else {
+            result = 0;
+        }
+
+        RowsRepeated += repeat;
+    }
+
+    return result;
+}
+
+/*
+ * SkipPage() - 跳过没有选中的页面：不压缩的流直接 lseek()，压缩的流逐行解码后丢掉。
+ */
+static int                          /* 输出 - 1 成功，0 失败 */
+SkipPage(
+    cups_raster_t       *ras,       /* 输入 - raster 流 */
+    int                 fd,         /* 输入 - raster 数据的文件描述符 */
+    int                 seekable,   /* 输入 - 能否 lseek() */
+    cups_page_header2_t *header     /* 输入 - 页头 */
+) {
+    unsigned char       *line;
+    unsigned            y;
+
+    if ( seekable ) {
+        return lseek(fd, (off_t) header->cupsBytesPerLine * header->cupsHeight, SEEK_CUR) >= 0;
+    }
+
+    if ( ( line = malloc(header->cupsBytesPerLine) ) == NULL ) {
+        return 0;
+    }
+    for ( y = 0; y < header->cupsHeight; y ++ ) {
+        if ( cupsRasterReadPixels(ras, line, header->cupsBytesPerLine) == 0 ) {
+            break;
+        }
+    }
+    free(line);
+
+    return y == header->cupsHeight;
 }
 
 /*
@@ -258,10 +477,40 @@ OutputLine(
  */
 static int
 EndPage(
-    ppd_file_t          *ppd,   /* 输入 - 打印机用 PPD 文件 */
+    ppdcache_t          *ppd,   /* 输入 - 打印机用 PPD 文件 */
     job_data_t          *job,   /* 输入 - 任务数据 */
     cups_page_header2_t *header /* 输入 - 页头 */
 ) {
+    /* 发出页尾的 SKIP/REPEAT 命令。 */
+    if ( SkipRows && Rows.previous != NULL ) {
+        unsigned        skip, repeat;
+
+        linecodec_rows_flush(&Rows, &skip, &repeat);
+        FlushRows(skip, repeat);
+        fprintf(stderr, "DEBUG: Page sent %llu bytes of row data, %u rows skipped, %u rows repeated\n",
+            PageBytes, RowsSkipped, RowsRepeated);
+    }
+    linecodec_rows_free(&Rows);
+
+    /* 显示压缩率并释放行缓冲。 */
+    if ( Compression && Codec.seed != NULL ) {
+        fprintf(stderr, "DEBUG: Page compressed to %llu of %llu bytes (raw %llu, packbits %llu, delta %llu rows)\n",
+            Codec.bytes_out, Codec.bytes_in,
+            Codec.rows[LINECODEC_RAW], Codec.rows[LINECODEC_PACKBITS], Codec.rows[LINECODEC_DELTA]);
+        linecodec_free(&Codec);
+    }
+    free(Scratch);
+    Scratch = NULL;
+    if ( Separate ) {
+        separation_end_page(&Separation);
+    }
+
+    /* 第一页的耗时。 */
+    if ( FirstPage ) {
+        fprintf(stderr, "DEBUG: Time to first page %.1f ms\n", ElapsedTime());
+        FirstPage = 0;
+    }
+
     /* 向打印机（大嘘）发送结束页面指令。 */
     puts("ENDPAGE");
     return 1;
@@ -272,7 +521,7 @@ EndPage(
  */
 static int              /* 输出 - 1 成功，0 失败 */
 Shutdown(
-    ppd_file_t *ppd,    /* 输入 - 打印机用 PPD 文件 */
+    ppdcache_t *ppd,    /* 输入 - 打印机用 PPD 文件 */
     job_data_t *job     /* 输入 - 任务数据 */
 ) {
     puts("ENDDOCUMENT");
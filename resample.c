@@ -0,0 +1,683 @@
+/*
+ * resample.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 分辨率重采样。RIP 送来的 raster 常常是 600 或 1200 dpi，而有些目标设备只需要
+ * 300 dpi。这里的重采样器按行接收转换好的像素，只保留一个滚动的行窗口：
+ *
+ * 1. 整数倍缩小的盒式滤波直接对块内像素求和再平均。
+ * 2. 其他情况使用可分离滤波：先对每一行做横向滤波存入窗口，凑齐一个输出行所需
+ *    的源行后再做纵向滤波。两个方向都用 GCC 的向量扩展一次处理 4 个采样：源行
+ *    先整行转为 float，横向每次取 4 个源像素，纵向每次算 4 个输出采样。
+ */
+
+#include "resample.h"
+#include <math.h>
+
+/* 一次处理 4 个 float 的向量类型（GCC 向量扩展）。 */
+typedef float resample_v4sf __attribute__ ((vector_size (16)));
+typedef int32_t resample_v4si __attribute__ ((vector_size (16)));
+typedef uint16_t resample_v8hu __attribute__ ((vector_size (16)));
+typedef uint8_t resample_v16qu __attribute__ ((vector_size (16)));
+
+/*
+ * resample_kernel() - 计算滤波核在 x 处的值。
+ */
+static double                           /* 输出 - 权值 */
+resample_kernel(
+    resample_filter_t   filter,         /* 输入 - 滤波器 */
+    double              x               /* 输入 - 与中心的距离 */
+) {
+    switch ( filter ) {
+        case RESAMPLE_BOX:
+            return ( ( x > -0.5 && x <= 0.5 )? 1.0: 0.0 );
+        case RESAMPLE_BILINEAR:
+            x = fabs(x);
+            return ( ( x < 1.0 )? ( 1.0 - x ): 0.0 );
+        case RESAMPLE_LANCZOS:
+            if ( x == 0.0 ) {
+                return 1.0;
+            }
+            if ( x <= -3.0 || x >= 3.0 ) {
+                return 0.0;
+            }
+            return ( 3.0 * sin(M_PI * x) * sin(M_PI * x / 3.0) / ( M_PI * M_PI * x * x ) );
+        default:
+            return 0.0;
+    }
+}
+
+/*
+ * resample_kernel_support() - 滤波核的半径。
+ */
+static double
+resample_kernel_support(
+    resample_filter_t   filter
+) {
+    switch ( filter ) {
+        case RESAMPLE_BOX:
+            return 0.5;
+        case RESAMPLE_BILINEAR:
+            return 1.0;
+        case RESAMPLE_LANCZOS:
+            return 3.0;
+        default:
+            return 0.0;
+    }
+}
+
+/*
+ * resample_build_spans() - 为一个方向计算每个输出位置的取样区间和归一化权值。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+resample_build_spans(
+    resample_filter_t   filter,         /* 输入 - 滤波器 */
+    unsigned            src_size,       /* 输入 - 源尺寸 */
+    unsigned            dst_size,       /* 输入 - 输出尺寸 */
+    resample_span_t     **spans,        /* 输出 - 取样区间 */
+    float               **weights,      /* 输出 - 权值表 */
+    unsigned            *max_count      /* 输出 - 最大取样个数 */
+) {
+    double      scale = (double) src_size / dst_size,
+                filter_scale = ( scale > 1.0 )? scale: 1.0,
+                support = resample_kernel_support(filter) * filter_scale,
+                center, total;
+    unsigned    taps = (unsigned) ceil(support) * 2 + 1;
+    unsigned    index, jndex;
+    int         first, last;
+    float       *w;
+
+    if (
+        ( *spans = (resample_span_t *) calloc(dst_size, sizeof(resample_span_t)) ) == NULL ||
+        ( *weights = (float *) calloc((size_t) dst_size * taps, sizeof(float)) ) == NULL
+    ) {
+        free(*spans);
+        *spans = NULL;
+        return FUNCTION_FAILURE;
+    }
+
+    *max_count = 1;
+    for ( index = 0; index < dst_size; index ++ ) {
+        center = ( index + 0.5 ) * scale;
+        /* 超出边界的部分直接截掉，再对剩下的权值归一化。 */
+        if ( ( first = (int) ( center - support + 0.5 ) ) < 0 ) {
+            first = 0;
+        }
+        if ( ( last = (int) ( center + support + 0.5 ) ) > (int) src_size ) {
+            last = src_size;
+        }
+        if ( last - first > (int) taps ) {
+            last = first + taps;
+        }
+        if ( last <= first ) {
+            /* 极端的放大比例下保证每个输出位置至少有一个源像素。 */
+            first = ( (unsigned) center < src_size )? (int) center: (int) src_size - 1;
+            last = first + 1;
+        }
+
+        w = *weights + (size_t) index * taps;
+        total = 0.0;
+        for ( jndex = 0; jndex < (unsigned) ( last - first ); jndex ++ ) {
+            w[jndex] = resample_kernel(filter, ( first + jndex - center + 0.5 ) / filter_scale);
+            total += w[jndex];
+        }
+        if ( total == 0.0 ) {
+            w[0] = 1.0f;
+            total = 1.0;
+            last = first + 1;
+        }
+        for ( jndex = 0; jndex < (unsigned) ( last - first ); jndex ++ ) {
+            w[jndex] /= total;
+        }
+
+        ( *spans )[index].start = first;
+        ( *spans )[index].count = last - first;
+        ( *spans )[index].weight_offset = index * taps;
+        if ( (unsigned) ( last - first ) > *max_count ) {
+            *max_count = last - first;
+        }
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * resample_filter_from_name() - 由选项值得到滤波器。
+ */
+resample_filter_t                       /* 输出 - 滤波器，无法识别时为盒式 */
+resample_filter_from_name(
+    const char          *name           /* 输入 - 选项值 */
+) {
+    if ( name == NULL ) {
+        return RESAMPLE_BOX;
+    } else if ( !strcasecmp(name, "bilinear") ) {
+        return RESAMPLE_BILINEAR;
+    } else if ( !strcasecmp(name, "lanczos") ) {
+        return RESAMPLE_LANCZOS;
+    } else if ( !strcasecmp(name, "none") ) {
+        return RESAMPLE_NONE;
+    }
+
+    return RESAMPLE_BOX;
+}
+
+/*
+ * resample_init() - 初始化重采样器。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+resample_init(
+    resample_t          *rs,            /* 输入 - 重采样器 */
+    resample_filter_t   filter,         /* 输入 - 滤波器 */
+    unsigned            channels,       /* 输入 - 每个像素的字节数 */
+    unsigned            src_width,      /* 输入 - 源图像宽度 */
+    unsigned            src_height,     /* 输入 - 源图像高度 */
+    unsigned            dst_width,      /* 输入 - 输出图像宽度 */
+    unsigned            dst_height      /* 输入 - 输出图像高度 */
+) {
+    unsigned    max_x, max_y;
+
+    memset(rs, 0, sizeof(resample_t));
+    rs->filter = filter;
+    rs->channels = channels;
+    rs->src_width = src_width;
+    rs->src_height = src_height;
+    rs->dst_width = dst_width;
+    rs->dst_height = dst_height;
+
+    if ( filter == RESAMPLE_NONE ) {
+        return FUNCTION_SUCCESS;
+    }
+    if ( src_width == 0 || src_height == 0 || dst_width == 0 || dst_height == 0 ) {
+        return FUNCTION_FAILURE;
+    }
+
+    /* 整数倍缩小：每个输出像素正好对应一个 box_x * box_y 的源像素块。 */
+    if ( filter == RESAMPLE_BOX ) {
+        rs->box_x = ( src_width + dst_width - 1 ) / dst_width;
+        rs->box_y = ( src_height + dst_height - 1 ) / dst_height;
+        if (
+            ( src_width + rs->box_x - 1 ) / rs->box_x == dst_width &&
+            ( src_height + rs->box_y - 1 ) / rs->box_y == dst_height
+        ) {
+            rs->integer_box = 1;
+            rs->box_sums = (uint32_t *) calloc((size_t) dst_width * channels, sizeof(uint32_t));
+            return ( rs->box_sums != NULL )? FUNCTION_SUCCESS: FUNCTION_FAILURE;
+        }
+    }
+
+    if (
+        ! resample_build_spans(filter, src_width, dst_width, &rs->x_spans, &rs->x_weights, &max_x) ||
+        ! resample_build_spans(filter, src_height, dst_height, &rs->y_spans, &rs->y_weights, &max_y)
+    ) {
+        resample_free(rs);
+        return FUNCTION_FAILURE;
+    }
+
+    rs->ring_rows = max_y;
+    if (
+        ( rs->ring = (float *) malloc(sizeof(float) * rs->ring_rows * dst_width * channels) ) == NULL ||
+        ( max_x >= 4 && ( rs->row = (float *) malloc(sizeof(float) * src_width * channels) ) == NULL )
+    ) {
+        resample_free(rs);
+        return FUNCTION_FAILURE;
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * resample_setup_page() - 按任务选项为一页准备重采样器。
+ *
+ * 选项：
+ *     bitmap-resolution=300 或 300x600   目标分辨率 (dpi)
+ *     bitmap-resample=box|bilinear|lanczos
+ *
+ * 目标分辨率与页头的 HWResolution 相同，或没有指定时不做重采样，输出尺寸即页面
+ * 尺寸。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+resample_setup_page(
+    resample_t          *rs,            /* 输入 - 重采样器 */
+    bitmap_job_data_t   *job,           /* 输入 - 任务数据 */
+    cups_page_header2_t *header,        /* 输入 - 页头 */
+    unsigned            channels        /* 输入 - 每个像素的字节数 */
+) {
+    const char          *value;
+    unsigned            x_res = header->HWResolution[0],
+                        y_res = header->HWResolution[1],
+                        dst_width = header->cupsWidth,
+                        dst_height = header->cupsHeight;
+    resample_filter_t   filter = RESAMPLE_NONE;
+
+    if (
+        ( value = cupsGetOption("bitmap-resolution", job->num_options, job->options) ) != NULL &&
+        header->HWResolution[0] > 0 && header->HWResolution[1] > 0
+    ) {
+        switch ( sscanf(value, "%ux%u", &x_res, &y_res) ) {
+            case 1:
+                y_res = x_res;
+                /* fall through */
+            case 2:
+                break;
+            default:
+                log_error("Warning", "Bad bitmap-resolution, resampling disabled.");
+                x_res = header->HWResolution[0];
+                y_res = header->HWResolution[1];
+        }
+
+        if ( x_res == 0 || y_res == 0 ) {
+            x_res = header->HWResolution[0];
+            y_res = header->HWResolution[1];
+        }
+
+        if ( x_res != header->HWResolution[0] || y_res != header->HWResolution[1] ) {
+            filter = resample_filter_from_name(
+                cupsGetOption("bitmap-resample", job->num_options, job->options)
+            );
+        }
+    }
+
+    if ( filter != RESAMPLE_NONE ) {
+        dst_width = (unsigned) ( ( (unsigned long long) header->cupsWidth * x_res
+                                 + header->HWResolution[0] / 2 ) / header->HWResolution[0] );
+        dst_height = (unsigned) ( ( (unsigned long long) header->cupsHeight * y_res
+                                  + header->HWResolution[1] / 2 ) / header->HWResolution[1] );
+        if ( dst_width == 0 ) {
+            dst_width = 1;
+        }
+        if ( dst_height == 0 ) {
+            dst_height = 1;
+        }
+        fprintf(stderr, "DEBUG: Resampling %ux%u (%ux%u dpi) to %ux%u (%ux%u dpi)\n",
+            header->cupsWidth, header->cupsHeight,
+            header->HWResolution[0], header->HWResolution[1],
+            dst_width, dst_height, x_res, y_res);
+    } else {
+        x_res = header->HWResolution[0];
+        y_res = header->HWResolution[1];
+    }
+
+    if ( ! resample_init(rs, filter, channels, header->cupsWidth, header->cupsHeight, dst_width, dst_height) ) {
+        log_error("Error", "Unable to initialize resampler!");
+        return FUNCTION_FAILURE;
+    }
+    rs->dst_x_res = x_res;
+    rs->dst_y_res = y_res;
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * resample_to_float() - 把一行源像素转为 float。16 个字节一组，两次与 0 交错
+ *                       扩展为 32 位整数再转换，SSE2 下不需要逐个字节转换。
+ */
+static void
+resample_to_float(
+    const uint8_t       *src,           /* 输入 - 源像素 */
+    float               *dst,           /* 输出 - 转换后的采样 */
+    size_t              count           /* 输入 - 采样个数 */
+) {
+    const resample_v16qu    zero = { 0 };
+    const resample_v8hu     zero_hu = { 0 };
+    const resample_v8hu     low = { 0, 8, 1, 9, 2, 10, 3, 11 },
+                            high = { 4, 12, 5, 13, 6, 14, 7, 15 };
+    resample_v16qu          bytes;
+    resample_v8hu           half;
+    resample_v4sf           v[4];
+    size_t                  index;
+
+    for ( index = 0; index + 16 <= count; index += 16 ) {
+        memcpy(&bytes, src + index, sizeof(bytes));
+        half = (resample_v8hu) __builtin_shuffle(bytes, zero,
+            (resample_v16qu) { 0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23 });
+        v[0] = __builtin_convertvector((resample_v4si) __builtin_shuffle(half, zero_hu, low), resample_v4sf);
+        v[1] = __builtin_convertvector((resample_v4si) __builtin_shuffle(half, zero_hu, high), resample_v4sf);
+        half = (resample_v8hu) __builtin_shuffle(bytes, zero,
+            (resample_v16qu) { 8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31 });
+        v[2] = __builtin_convertvector((resample_v4si) __builtin_shuffle(half, zero_hu, low), resample_v4sf);
+        v[3] = __builtin_convertvector((resample_v4si) __builtin_shuffle(half, zero_hu, high), resample_v4sf);
+        memcpy(dst + index, v, sizeof(v));
+    }
+
+    for ( ; index < count; index ++ ) {
+        dst[index] = src[index];
+    }
+}
+
+/*
+ * resample_horizontal_short() - 横向取样都不到 4 个时（双线性等）直接逐个字节累加，
+ *                               整行转为 float 反而更慢。
+ */
+static void
+resample_horizontal_short(
+    resample_t          *rs,            /* 输入 - 重采样器 */
+    const uint8_t       *row,           /* 输入 - 源像素行 */
+    float               *output         /* 输出 - 横向滤波后的行 */
+) {
+    const unsigned      channels = rs->channels;
+    unsigned            index, jndex;
+    const resample_span_t *span;
+    const float         *w;
+    const uint8_t       *src;
+    float               sum[3];
+
+    for ( index = 0; index < rs->dst_width; index ++ ) {
+        span = rs->x_spans + index;
+        w = rs->x_weights + span->weight_offset;
+        src = row + (size_t) span->start * channels;
+
+        if ( channels == 1 ) {
+            sum[0] = 0.0f;
+            for ( jndex = 0; jndex < span->count; jndex ++ ) {
+                sum[0] += w[jndex] * src[jndex];
+            }
+            output[index] = sum[0];
+        } else {
+            sum[0] = sum[1] = sum[2] = 0.0f;
+            for ( jndex = 0; jndex < span->count; jndex ++, src += 3 ) {
+                sum[0] += w[jndex] * src[0];
+                sum[1] += w[jndex] * src[1];
+                sum[2] += w[jndex] * src[2];
+            }
+            output[index * 3] = sum[0];
+            output[index * 3 + 1] = sum[1];
+            output[index * 3 + 2] = sum[2];
+        }
+    }
+}
+
+/*
+ * resample_horizontal() - 对一行源像素做横向滤波，结果写入窗口中的一行。
+ *
+ * 每个输出像素一次累加 4 个源像素。RGB 的 4 个像素正好是 12 个采样、3 个向量，
+ * 权值按 RGB 排列展开（w0 w0 w0 w1 | w1 w1 w2 w2 | w2 w3 w3 w3），最后再把同一
+ * 通道的几个分量加起来；不满 4 个的尾部逐个累加。
+ */
+static void
+resample_horizontal(
+    resample_t          *rs,            /* 输入 - 重采样器 */
+    const uint8_t       *row,           /* 输入 - 源像素行 */
+    float               *output         /* 输出 - 横向滤波后的行 */
+) {
+    const unsigned      channels = rs->channels;
+    unsigned            index, jndex;
+    const resample_span_t *span;
+    const float         *w, *src;
+    resample_v4sf       wv, v, acc0, acc1, acc2;
+    float               lanes[12], sum[3];
+
+    if ( rs->row == NULL ) {
+        resample_horizontal_short(rs, row, output);
+        return;
+    }
+    resample_to_float(row, rs->row, (size_t) rs->src_width * channels);
+
+    for ( index = 0; index < rs->dst_width; index ++ ) {
+        span = rs->x_spans + index;
+        w = rs->x_weights + span->weight_offset;
+        src = rs->row + (size_t) span->start * channels;
+        acc0 = acc1 = acc2 = (resample_v4sf) { 0.0f, 0.0f, 0.0f, 0.0f };
+        jndex = 0;
+
+        if ( channels == 1 ) {
+            sum[0] = 0.0f;
+            if ( span->count >= 4 ) {
+                for ( ; jndex + 4 <= span->count; jndex += 4 ) {
+                    memcpy(&wv, w + jndex, sizeof(wv));
+                    memcpy(&v, src + jndex, sizeof(v));
+                    acc0 += wv * v;
+                }
+                memcpy(lanes, &acc0, sizeof(acc0));
+                sum[0] = ( lanes[0] + lanes[1] ) + ( lanes[2] + lanes[3] );
+            }
+            for ( ; jndex < span->count; jndex ++ ) {
+                sum[0] += w[jndex] * src[jndex];
+            }
+            output[index] = sum[0];
+        } else {
+            sum[0] = sum[1] = sum[2] = 0.0f;
+            if ( span->count >= 4 ) {
+                for ( ; jndex + 4 <= span->count; jndex += 4, src += 12 ) {
+                    memcpy(&wv, w + jndex, sizeof(wv));
+                    memcpy(&v, src, sizeof(v));
+                    acc0 += __builtin_shuffle(wv, (resample_v4si) { 0, 0, 0, 1 }) * v;
+                    memcpy(&v, src + 4, sizeof(v));
+                    acc1 += __builtin_shuffle(wv, (resample_v4si) { 1, 1, 2, 2 }) * v;
+                    memcpy(&v, src + 8, sizeof(v));
+                    acc2 += __builtin_shuffle(wv, (resample_v4si) { 2, 3, 3, 3 }) * v;
+                }
+                memcpy(lanes, &acc0, sizeof(acc0));
+                memcpy(lanes + 4, &acc1, sizeof(acc1));
+                memcpy(lanes + 8, &acc2, sizeof(acc2));
+                sum[0] = ( lanes[0] + lanes[3] ) + ( lanes[6] + lanes[9] );
+                sum[1] = ( lanes[1] + lanes[4] ) + ( lanes[7] + lanes[10] );
+                sum[2] = ( lanes[2] + lanes[5] ) + ( lanes[8] + lanes[11] );
+            }
+            for ( ; jndex < span->count; jndex ++, src += 3 ) {
+                sum[0] += w[jndex] * src[0];
+                sum[1] += w[jndex] * src[1];
+                sum[2] += w[jndex] * src[2];
+            }
+            output[index * 3] = sum[0];
+            output[index * 3 + 1] = sum[1];
+            output[index * 3 + 2] = sum[2];
+        }
+    }
+}
+
+/*
+ * resample_vertical() - 对窗口中的若干行做纵向滤波，输出一行 8 位像素。
+ */
+static void
+resample_vertical(
+    resample_t          *rs,            /* 输入 - 重采样器 */
+    const resample_span_t *span,        /* 输入 - 这一输出行的取样区间 */
+    uint8_t             *output         /* 输出 - 一行输出像素 */
+) {
+    const size_t        samples = (size_t) rs->dst_width * rs->channels;
+    const float         *w = rs->y_weights + span->weight_offset;
+    const float         *rows[span->count];
+    resample_v4sf       acc, v;
+    float               lanes[4], value;
+    size_t              index;
+    unsigned            jndex, lane;
+
+    for ( jndex = 0; jndex < span->count; jndex ++ ) {
+        rows[jndex] = rs->ring + (size_t) ( ( span->start + jndex ) % rs->ring_rows ) * samples;
+    }
+
+    for ( index = 0; index + 4 <= samples; index += 4 ) {
+        acc = (resample_v4sf) { 0.0f, 0.0f, 0.0f, 0.0f };
+        for ( jndex = 0; jndex < span->count; jndex ++ ) {
+            memcpy(&v, rows[jndex] + index, sizeof(v));
+            acc += v * w[jndex];
+        }
+        /* 取整并截断到 0 ~ 255，Lanczos 的负瓣可能越界。 */
+        acc += 0.5f;
+        memcpy(lanes, &acc, sizeof(lanes));
+        for ( lane = 0; lane < 4; lane ++ ) {
+            output[index + lane] = ( lanes[lane] <= 0.0f )? 0:
+                                   ( lanes[lane] >= 255.0f )? 255: (uint8_t) lanes[lane];
+        }
+    }
+
+    for ( ; index < samples; index ++ ) {
+        value = 0.5f;
+        for ( jndex = 0; jndex < span->count; jndex ++ ) {
+            value += rows[jndex][index] * w[jndex];
+        }
+        output[index] = ( value <= 0.0f )? 0: ( value >= 255.0f )? 255: (uint8_t) value;
+    }
+}
+
+/*
+ * resample_push_box() - 整数倍盒式滤波：累加一行，凑满 box_y 行后输出一行。
+ */
+static unsigned                         /* 输出 - 输出的行数 */
+resample_push_box(
+    resample_t          *rs,            /* 输入 - 重采样器 */
+    const uint8_t       *row,           /* 输入 - 源像素行 */
+    uint8_t             *output         /* 输出 - 输出行 */
+) {
+    const unsigned      channels = rs->channels;
+    unsigned            index, jndex, channel, rows, cols;
+    uint32_t            *sums;
+
+    for ( index = 0; index < rs->dst_width; index ++ ) {
+        sums = rs->box_sums + (size_t) index * channels;
+        cols = rs->src_width - index * rs->box_x;
+        if ( cols > rs->box_x ) {
+            cols = rs->box_x;
+        }
+        for ( jndex = 0; jndex < cols; jndex ++ ) {
+            for ( channel = 0; channel < channels; channel ++ ) {
+                sums[channel] += *row ++;
+            }
+        }
+    }
+
+    rs->src_row ++;
+    if ( rs->src_row % rs->box_y != 0 && rs->src_row != rs->src_height ) {
+        return 0;
+    }
+
+    /* 最后一块可能不满，按实际的行数和列数求平均。 */
+    rows = rs->src_row - rs->dst_row * rs->box_y;
+    for ( index = 0; index < rs->dst_width; index ++ ) {
+        uint32_t area;
+
+        cols = rs->src_width - index * rs->box_x;
+        if ( cols > rs->box_x ) {
+            cols = rs->box_x;
+        }
+        area = cols * rows;
+        sums = rs->box_sums + (size_t) index * channels;
+        for ( channel = 0; channel < channels; channel ++ ) {
+            *output ++ = (uint8_t) ( ( sums[channel] + area / 2 ) / area );
+            sums[channel] = 0;
+        }
+    }
+    rs->dst_row ++;
+
+    return 1;
+}
+
+/*
+ * resample_push_row() - 送入一行源像素。凑齐输出行所需的源行后，把输出行依次写到
+ *                       output 中。
+ */
+unsigned                                /* 输出 - 这次写出的输出行数 */
+resample_push_row(
+    resample_t          *rs,            /* 输入 - 重采样器 */
+    const uint8_t       *row,           /* 输入 - 源像素行 */
+    uint8_t             *output         /* 输出 - 输出行的写入位置 */
+) {
+    const size_t        row_bytes = (size_t) rs->dst_width * rs->channels;
+    const resample_span_t *span;
+    unsigned            emitted = 0;
+
+    if ( rs->filter == RESAMPLE_NONE ) {
+        memcpy(output, row, (size_t) rs->src_width * rs->channels);
+        rs->src_row ++;
+        rs->dst_row ++;
+        return 1;
+    }
+
+    if ( rs->src_row >= rs->src_height ) {
+        return 0;
+    }
+
+    if ( rs->integer_box ) {
+        return resample_push_box(rs, row, output);
+    }
+
+    resample_horizontal(rs, row, rs->ring + (size_t) ( rs->src_row % rs->ring_rows ) * row_bytes);
+    rs->src_row ++;
+
+    /* 输出所有取样区间已经完整落在窗口里的行。 */
+    while ( rs->dst_row < rs->dst_height ) {
+        span = rs->y_spans + rs->dst_row;
+        if ( span->start + span->count > rs->src_row ) {
+            break;
+        }
+        resample_vertical(rs, span, output + emitted * row_bytes);
+        rs->dst_row ++;
+        emitted ++;
+    }
+
+    return emitted;
+}
+
+/*
+ * resample_max_rows() - resample_push_row() 一次最多输出的行数，调用者据此留出
+ *                       写入位置后面的空间。
+ */
+unsigned                                /* 输出 - 行数 */
+resample_max_rows(
+    const resample_t    *rs             /* 输入 - 重采样器 */
+) {
+    unsigned            src_row, dst_row = 0,
+                        emitted, max_rows = 1;
+
+    if ( rs->filter == RESAMPLE_NONE || rs->integer_box ) {
+        return 1;
+    }
+
+    /* 按 resample_push_row() 的条件模拟一遍。 */
+    for ( src_row = 1; src_row <= rs->src_height; src_row ++ ) {
+        for ( emitted = 0; dst_row < rs->dst_height; dst_row ++, emitted ++ ) {
+            if ( rs->y_spans[dst_row].start + rs->y_spans[dst_row].count > src_row ) {
+                break;
+            }
+        }
+        if ( emitted > max_rows ) {
+            max_rows = emitted;
+        }
+    }
+
+    return max_rows;
+}
+
+/*
+ * resample_free() - 释放重采样器占用的内存。
+ */
+void
+resample_free(
+    resample_t          *rs             /* 输入 - 重采样器 */
+) {
+    free(rs->box_sums);
+    free(rs->x_spans);
+    free(rs->y_spans);
+    free(rs->x_weights);
+    free(rs->y_weights);
+    free(rs->ring);
+    free(rs->row);
+    rs->box_sums = NULL;
+    rs->x_spans = rs->y_spans = NULL;
+    rs->x_weights = rs->y_weights = NULL;
+    rs->ring = NULL;
+    rs->row = NULL;
+}
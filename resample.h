@@ -0,0 +1,89 @@
+/*
+ * resample.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_RESAMPLE_H
+#define __LEISRASTERFILTER_RESAMPLE_H
+
+#include "bitmap.h"
+#include <cups/raster.h>
+
+/*
+ * 重采样使用的滤波器。
+ */
+typedef enum {
+    RESAMPLE_NONE = 0,      /* 不做重采样 */
+    RESAMPLE_BOX,           /* 盒式（面积平均）滤波，整数倍缩小时走快速路径 */
+    RESAMPLE_BILINEAR,      /* 可分离双线性滤波 */
+    RESAMPLE_LANCZOS        /* 可分离 Lanczos-3 滤波 */
+} resample_filter_t;
+
+/*
+ * 一个输出像素（或输出行）在源数据中的取样区间。
+ */
+typedef struct {
+    unsigned    start;          /* 第一个源像素（源行）的下标 */
+    unsigned    count;          /* 取样个数 */
+    unsigned    weight_offset;  /* 权值在权值表中的起始位置 */
+} resample_span_t;
+
+/*
+ * 重采样器状态。源数据按行依次送入，只保留滚动的行窗口，不需要整页缓冲。
+ */
+typedef struct {
+    resample_filter_t   filter;         /* 滤波器 */
+    unsigned            channels,       /* 每个像素的字节数（1 或 3） */
+                        src_width,      /* 源图像宽度 */
+                        src_height,     /* 源图像高度 */
+                        dst_width,      /* 输出图像宽度 */
+                        dst_height,     /* 输出图像高度 */
+                        dst_x_res,      /* 输出横向分辨率 (dpi) */
+                        dst_y_res;      /* 输出纵向分辨率 (dpi) */
+
+    int                 integer_box;    /* 为 1 时使用整数倍盒式快速路径 */
+    unsigned            box_x,          /* 横向合并像素数 */
+                        box_y;          /* 纵向合并行数 */
+    uint32_t            *box_sums;      /* 盒式滤波的累加器 */
+
+    resample_span_t     *x_spans,       /* 横向取样区间 */
+                        *y_spans;       /* 纵向取样区间 */
+    float               *x_weights,     /* 横向权值表 */
+                        *y_weights;     /* 纵向权值表 */
+    unsigned            ring_rows;      /* 滚动窗口的行数 */
+    float               *ring;          /* 横向处理过的行组成的滚动窗口 */
+    float               *row;           /* 转为 float 的源像素行，横向取样都不到 4 个时为 NULL */
+
+    unsigned            src_row,        /* 已经送入的源行数 */
+                        dst_row;        /* 已经输出的行数 */
+} resample_t;
+
+extern resample_filter_t resample_filter_from_name(const char *name);
+extern int resample_init(resample_t *rs, resample_filter_t filter, unsigned channels, unsigned src_width, unsigned src_height, unsigned dst_width, unsigned dst_height);
+extern int resample_setup_page(resample_t *rs, bitmap_job_data_t *job, cups_page_header2_t *header, unsigned channels);
+extern unsigned resample_push_row(resample_t *rs, const uint8_t *row, uint8_t *output);
+extern unsigned resample_max_rows(const resample_t *rs);
+extern void resample_free(resample_t *rs);
+
+#endif
@@ -33,6 +33,8 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include "ppdcache.h"
 
 /* 
  * 任务数据。
@@ -46,8 +48,24 @@ typedef struct {
     cups_option_t   *options;       /* 命令行选项 */
 } job_data_t;
 
-extern int          GetStatus(ppd_file_t *ppd, double timeout);
-extern ppd_file_t   *Initialize(int argc, char *argv[], job_data_t *job);
+/*
+ * 打印进度。行循环只更新这里的数值，由状态线程按时间间隔报告。
+ */
+
+typedef struct {
+    int             page;           /* 当前页数 */
+    unsigned        row,            /* 当前行 */
+                    height;         /* 当前页的行数 */
+} progress_t;
+
+#define STATUS_DEFAULT_INTERVAL 1.0 /* 状态轮询和进度报告的默认间隔（秒） */
+#define SAMPLE_OUTPUT_BUFFER    ( 256 * 1024 )  /* 标准输出的缓冲大小 */
+
+extern int          GetStatus(ppdcache_t *ppd, double timeout);
+extern int          StartStatusThread(ppdcache_t *ppd, double interval, const progress_t *progress);
+extern void         StopStatusThread(void);
+extern ppdcache_t   *Initialize(int argc, char *argv[], job_data_t *job);
+extern double       ElapsedTime(void);
 extern void         LogMessage(char *prefix, char *content);
 
 #endif
@@ -0,0 +1,282 @@
+/*
+ * sampledevice.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 这是一个假想的打印设备：从标准输入（或给定的文件）读入 rastertosample 输出的设备流，
+ * 按 README 中的协议解码每一行，检查流是否完整、合法，并统计每页收到的字节数。
+ * 给出 -o 前缀时把解码后的页面存为 PGM/PPM 文件（CMYK 页面存为 PAM 文件），便于和原始 raster 对比。
+ *
+ *     ./rastertosample ... | ./sampledevice [-o 前缀] [文件]
+ */
+
+#include "linecodec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * 一页的解码状态。
+ */
+typedef struct {
+    int             number;         /* 页数 */
+    unsigned        width,          /* 每行像素数 */
+                    height,         /* 行数 */
+                    colors;         /* 颜色数，4 为 CMYK */
+    int             planar;         /* CMYK 的行是否按平面排列 */
+    uint8_t         blank;          /* 空白行的字节值 */
+    size_t          row_bytes;      /* 每行字节数 */
+    unsigned        rows;           /* 已经收到的行数 */
+    int             have_previous;  /* 本页是否已经有上一行 */
+    uint8_t         *row,           /* 上一行，也是 DELTA 的种子行 */
+                    *data;          /* 编码后的数据 */
+    FILE            *fp;            /* 页面输出文件 */
+    unsigned long long  bytes;      /* 本页收到的字节数 */
+    unsigned        commands[6];    /* 各命令的次数：LINE PACKBITS DELTA SKIP REPEAT 其他 */
+} device_page_t;
+
+/*
+ * fail() - 显示错误。
+ */
+static int                          /* 输出 - 总是 0 */
+fail(
+    device_page_t   *page,
+    const char      *message
+) {
+    fprintf(stderr, "sampledevice: page %d row %u: %s\n", page->number, page->rows, message);
+    return 0;
+}
+
+/*
+ * emit_rows() - 把上一行交给“打印头”count 次。
+ */
+static int                          /* 输出 - 1 成功，0 失败 */
+emit_rows(
+    device_page_t   *page,
+    unsigned        count
+) {
+    if ( count > page->height - page->rows ) {
+        return fail(page, "too many rows");
+    }
+
+    page->rows += count;
+    if ( page->fp != NULL && page->planar ) {
+        /* 按平面排列的 CMYK 行交错成 PAM 的像素再写出。 */
+        unsigned    x, plane;
+        uint8_t     *pixels = (uint8_t *) malloc(page->row_bytes);
+
+        for (x = 0; pixels != NULL && x < page->width; x ++) {
+            for (plane = 0; plane < 4; plane ++) {
+                pixels[x * 4 + plane] = page->row[plane * page->width + x];
+            }
+        }
+        while ( pixels != NULL && count -- > 0 ) {
+            fwrite(pixels, 1, page->row_bytes, page->fp);
+        }
+        free(pixels);
+        return 1;
+    }
+    while ( page->fp != NULL && count -- > 0 ) {
+        fwrite(page->row, 1, page->row_bytes, page->fp);
+    }
+
+    return 1;
+}
+
+/*
+ * end_page() - 结束一页并显示统计。
+ */
+static int                          /* 输出 - 1 成功，0 失败 */
+end_page(
+    device_page_t   *page
+) {
+    int             ok = 1;
+
+    if ( page->row == NULL ) {
+        return fail(page, "ENDPAGE without RASTER");
+    }
+    if ( page->rows != page->height ) {
+        ok = fail(page, "page ended early");
+    }
+
+    printf("page %d: %ux%ux%u%s, %llu bytes of row data (%.1f%% of raw); LINE %u PACKBITS %u DELTA %u SKIP %u REPEAT %u\n",
+        page->number, page->width, page->height, page->colors, page->planar? " planar": "", page->bytes,
+        100.0 * page->bytes / ( (double) page->row_bytes * page->height + ( page->height == 0 ) ),
+        page->commands[0], page->commands[1], page->commands[2], page->commands[3], page->commands[4]);
+
+    if ( page->fp != NULL ) {
+        fclose(page->fp);
+        page->fp = NULL;
+    }
+    free(page->row);
+    free(page->data);
+    page->row = page->data = NULL;
+
+    return ok;
+}
+
+/*
+ * row_command() - 解析 LINE/PACKBITS/DELTA 命令。
+ */
+static int                          /* 输出 - 1 是行数据命令，0 不是 */
+row_command(
+    const char          *command,
+    linecodec_method_t  *method,
+    size_t              *length
+) {
+    if ( sscanf(command, "LINE %zu", length) == 1 ) {
+        *method = LINECODEC_RAW;
+    } else if ( sscanf(command, "PACKBITS %zu", length) == 1 ) {
+        *method = LINECODEC_PACKBITS;
+    } else if ( sscanf(command, "DELTA %zu", length) == 1 ) {
+        *method = LINECODEC_DELTA;
+    } else {
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * main() - 程序主入口。
+ */
+int                                 /* 输出 - 0 流合法，1 有错误 */
+main(
+    int argc,                       /* 输入 - 命令行参数个数。 */
+    char *argv[]                    /* 输入 - 命令行参数内容。 */
+) {
+    FILE            *in = stdin;
+    const char      *prefix = NULL;
+    char            command[256],
+                    filename[1024];
+    device_page_t   page;
+    size_t          length;
+    unsigned        count;
+    int             index,
+                    ok = 1,
+                    pages = 0;
+    linecodec_method_t  method;
+
+    for ( index = 1; index < argc; index ++ ) {
+        if ( ! strcmp(argv[index], "-o") && index + 1 < argc ) {
+            prefix = argv[++ index];
+        } else if ( ( in = fopen(argv[index], "rb") ) == NULL ) {
+            perror(argv[index]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    memset(&page, 0, sizeof(page));
+
+    while ( ok && fgets(command, sizeof(command), in) != NULL ) {
+        if ( ! strncmp(command, "RASTER ", 7) ) {
+            if ( page.row != NULL ) {
+                ok = fail(&page, "RASTER inside a page");
+                break;
+            }
+            memset(&page, 0, sizeof(page));
+            page.number = ++ pages;
+            if ( sscanf(command, "RASTER %u %u %u", &page.width, &page.height, &page.colors) != 3
+                    || ( page.colors != 1 && page.colors != 3 && page.colors != 4 ) ) {
+                ok = fail(&page, "bad RASTER command");
+                break;
+            }
+            /* CMYK 的空白行为全 0，行可以按平面排列。 */
+            page.planar = ( page.colors == 4 && strstr(command, " PLANAR") != NULL );
+            page.blank = ( page.colors == 4 )? 0x00: 0xff;
+            page.row_bytes = (size_t) page.width * page.colors;
+            page.row = (uint8_t *) calloc(1, page.row_bytes + 1);
+            page.data = (uint8_t *) malloc(LINECODEC_BOUND(page.row_bytes));
+            if ( prefix != NULL ) {
+                snprintf(filename, sizeof(filename), "%s%05d.%s", prefix, page.number,
+                    ( page.colors == 1 )? "pgm": ( page.colors == 3 )? "ppm": "pam");
+                if ( ( page.fp = fopen(filename, "wb") ) != NULL ) {
+                    if ( page.colors == 4 ) {
+                        fprintf(page.fp, "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\nTUPLTYPE CMYK\nENDHDR\n",
+                            page.width, page.height);
+                    } else {
+                        fprintf(page.fp, "P%c\n%u %u\n255\n", ( page.colors == 1 )? '5': '6', page.width, page.height);
+                    }
+                }
+            }
+        } else if ( row_command(command, &method, &length) ) {
+            if ( page.row == NULL ) {
+                ok = fail(&page, "row data outside a page");
+                break;
+            }
+            if ( length > LINECODEC_BOUND(page.row_bytes) || fread(page.data, 1, length, in) != length ) {
+                ok = fail(&page, "truncated or oversized row data");
+                break;
+            }
+            if ( ! linecodec_decode(method, page.data, length, page.row, page.row_bytes) ) {
+                ok = fail(&page, "undecodable row data");
+                break;
+            }
+            page.bytes += strlen(command) + length;
+            page.commands[( method == LINECODEC_RAW )? 0: ( method == LINECODEC_PACKBITS )? 1: 2] ++;
+            page.have_previous = 1;
+            ok = emit_rows(&page, 1);
+        } else if ( sscanf(command, "SKIP %u", &count) == 1 ) {
+            if ( page.row == NULL ) {
+                ok = fail(&page, "SKIP outside a page");
+                break;
+            }
+            /* 空白行，之后的上一行也是空白行。 */
+            memset(page.row, page.blank, page.row_bytes);
+            page.have_previous = 1;
+            page.bytes += strlen(command);
+            page.commands[3] ++;
+            ok = emit_rows(&page, count);
+        } else if ( sscanf(command, "REPEAT %u", &count) == 1 ) {
+            if ( page.row == NULL || ! page.have_previous ) {
+                ok = fail(&page, "REPEAT without a previous row");
+                break;
+            }
+            page.bytes += strlen(command);
+            page.commands[4] ++;
+            ok = emit_rows(&page, count);
+        } else if ( ! strncmp(command, "ENDPAGE", 7) ) {
+            ok = end_page(&page);
+        } else if (
+            strncmp(command, "DOCUMENT", 8) && strncmp(command, "ENDDOCUMENT", 11) &&
+            strncmp(command, "AUTHOR ", 7) && strncmp(command, "TITLE ", 6) &&
+            strncmp(command, "PAGE ", 5) && strncmp(command, "LEVELS", 6) &&
+            strncmp(command, "++", 2)
+        ) {
+            ok = fail(&page, "unknown command");
+        }
+    }
+
+    if ( page.row != NULL ) {
+        if ( ok ) {
+            ok = fail(&page, "stream ended inside a page");
+        }
+        end_page(&page);
+    }
+
+    printf("%d page(s), stream %s\n", pages, ok? "OK": "INVALID");
+
+    return ok? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,228 @@
+/*
+ * separation.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * RGB 到 CMYK 的分色。rastertosample 的设备是 CMYK 的，RGB 行在发出之前按
+ * 三张查找表分色：先对每个像素查表得到 C、M、Y，由其中最小的值（灰成分）查出
+ * K 和要去掉的底色，写成四个平面；再在 SSE2 下一次 16 个像素做饱和减法去掉
+ * 底色，按需要交错成每个像素四个字节。查找表在任务开始时生成一次。
+ */
+
+#include "separation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * separation_number() - 取一个数值属性，没有或不合法时用默认值。
+ */
+static double                           /* 输出 - 数值 */
+separation_number(
+    const ppdcache_t    *ppd,           /* 输入 - PPD 缓存 */
+    const char          *name,          /* 输入 - 属性名称 */
+    double              value           /* 输入 - 默认值 */
+) {
+    const char          *attr = ppdcache_attr(ppd, name, NULL);
+    double              number;
+
+    if ( attr != NULL && sscanf(attr, "%lf", &number) == 1 && number > 0.0 ) {
+        return number;
+    }
+
+    return value;
+}
+
+/*
+ * separation_init() - 按 sample-separation 选项和 PPD 属性准备分色。
+ */
+int                                     /* 输出 - 1 要分色，0 不分色 */
+separation_init(
+    separation_t        *sep,           /* 输出 - 分色 */
+    const ppdcache_t    *ppd,           /* 输入 - PPD 缓存，可以为 NULL */
+    const char          *layout         /* 输入 - chunked、planar 或 NULL */
+) {
+    const char          *attr;
+    double              gamma,
+                        density,
+                        lower = 0.0,    /* 开始生成 K 的灰成分（0 到 1） */
+                        upper = 1.0,    /* 灰成分全部换成 K 的位置 */
+                        fraction,
+                        value;
+    unsigned            index;
+
+    memset(sep, 0, sizeof(separation_t));
+    if ( layout == NULL || ( strcasecmp(layout, "chunked") && strcasecmp(layout, "planar") ) ) {
+        return 0;
+    }
+    sep->layout = strcasecmp(layout, "planar")? SEPARATION_CHUNKED: SEPARATION_PLANAR;
+
+    gamma = separation_number(ppd, "cupsAllGamma", 1.0);
+    density = separation_number(ppd, "cupsAllDensity", 1.0);
+    if ( ( attr = ppdcache_attr(ppd, "cupsBlackGeneration", NULL) ) != NULL
+            && ( sscanf(attr, "%lf%lf", &lower, &upper) != 2 || lower < 0.0 || upper > 1.0 || lower >= upper ) ) {
+        fprintf(stderr, "DEBUG: Bad cupsBlackGeneration \"%s\", using \"0 1\"\n", attr);
+        lower = 0.0;
+        upper = 1.0;
+    }
+    fraction = separation_number(ppd, "cupsUnderColorRemoval", 1.0);
+    if ( fraction > 1.0 ) {
+        fraction = 1.0;
+    }
+
+    for ( index = 0; index < 256; index ++ ) {
+        value = 255.0 * density * pow(( 255 - index ) / 255.0, gamma);
+        sep->cmy[index] = ( value >= 255.0 )? 255: (uint8_t) ( value + 0.5 );
+
+        /* 灰成分在 lower 以下不生成 K，在 upper 以上全部换成 K，中间逐渐增加。 */
+        value = index / 255.0;
+        if ( value <= lower ) {
+            value = 0.0;
+        } else if ( value < upper ) {
+            value *= ( value - lower ) / ( upper - lower );
+        }
+        sep->black[index] = (uint8_t) ( 255.0 * value + 0.5 );
+        sep->removal[index] = (uint8_t) ( sep->black[index] * fraction + 0.5 );
+    }
+
+    fprintf(stderr, "DEBUG: Separating RGB into %s CMYK (gamma %.2f, density %.2f, black %.2f-%.2f, UCR %.2f)\n",
+        ( sep->layout == SEPARATION_PLANAR )? "planar": "chunked", gamma, density, lower, upper, fraction);
+
+    return 1;
+}
+
+/*
+ * separation_start_page() - 按页面宽度分配行缓冲。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+separation_start_page(
+    separation_t        *sep,           /* 输入/输出 - 分色 */
+    unsigned            width           /* 输入 - 每行像素数 */
+) {
+    sep->width = width;
+    sep->planes = (uint8_t *) malloc((size_t) width * 4);
+    sep->amounts = (uint8_t *) malloc(width);
+    sep->output = ( sep->layout == SEPARATION_CHUNKED )? (uint8_t *) malloc((size_t) width * 4): sep->planes;
+    if ( sep->planes == NULL || sep->amounts == NULL || sep->output == NULL ) {
+        separation_end_page(sep);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * separation_convert() - 对一行 8 位 RGB 像素分色。
+ */
+const uint8_t *                         /* 输出 - 分色后的行（width * 4 字节） */
+separation_convert(
+    separation_t        *sep,           /* 输入/输出 - 分色 */
+    const uint8_t       *rgb            /* 输入 - RGB 像素 */
+) {
+    const size_t        width = sep->width;
+    uint8_t             *c = sep->planes,
+                        *m = c + width,
+                        *y = m + width,
+                        *k = y + width,
+                        *u = sep->amounts,
+                        *out = sep->output,
+                        gray;
+    size_t              x = 0;
+
+    /* 查表：C、M、Y，以及由灰成分得到的 K 和要去掉的底色。 */
+    for ( x = 0; x < width; x ++, rgb += 3 ) {
+        c[x] = sep->cmy[rgb[0]];
+        m[x] = sep->cmy[rgb[1]];
+        y[x] = sep->cmy[rgb[2]];
+        gray = ( c[x] < m[x] )? c[x]: m[x];
+        gray = ( gray < y[x] )? gray: y[x];
+        k[x] = sep->black[gray];
+        u[x] = sep->removal[gray];
+    }
+
+    /* 去掉底色，按需要交错成每个像素四个字节。 */
+    x = 0;
+#ifdef __SSE2__
+    for ( ; x + 16 <= width; x += 16 ) {
+        __m128i     vu = _mm_loadu_si128((const __m128i *) ( u + x )),
+                    vc = _mm_subs_epu8(_mm_loadu_si128((const __m128i *) ( c + x )), vu),
+                    vm = _mm_subs_epu8(_mm_loadu_si128((const __m128i *) ( m + x )), vu),
+                    vy = _mm_subs_epu8(_mm_loadu_si128((const __m128i *) ( y + x )), vu),
+                    vk,
+                    cm,
+                    yk;
+
+        if ( sep->layout == SEPARATION_PLANAR ) {
+            _mm_storeu_si128((__m128i *) ( c + x ), vc);
+            _mm_storeu_si128((__m128i *) ( m + x ), vm);
+            _mm_storeu_si128((__m128i *) ( y + x ), vy);
+            continue;
+        }
+        vk = _mm_loadu_si128((const __m128i *) ( k + x ));
+        cm = _mm_unpacklo_epi8(vc, vm);
+        yk = _mm_unpacklo_epi8(vy, vk);
+        _mm_storeu_si128((__m128i *) ( out + x * 4 ), _mm_unpacklo_epi16(cm, yk));
+        _mm_storeu_si128((__m128i *) ( out + x * 4 + 16 ), _mm_unpackhi_epi16(cm, yk));
+        cm = _mm_unpackhi_epi8(vc, vm);
+        yk = _mm_unpackhi_epi8(vy, vk);
+        _mm_storeu_si128((__m128i *) ( out + x * 4 + 32 ), _mm_unpacklo_epi16(cm, yk));
+        _mm_storeu_si128((__m128i *) ( out + x * 4 + 48 ), _mm_unpackhi_epi16(cm, yk));
+    }
+#endif
+    for ( ; x < width; x ++ ) {
+        c[x] = ( c[x] > u[x] )? c[x] - u[x]: 0;
+        m[x] = ( m[x] > u[x] )? m[x] - u[x]: 0;
+        y[x] = ( y[x] > u[x] )? y[x] - u[x]: 0;
+        if ( sep->layout == SEPARATION_CHUNKED ) {
+            out[x * 4] = c[x];
+            out[x * 4 + 1] = m[x];
+            out[x * 4 + 2] = y[x];
+            out[x * 4 + 3] = k[x];
+        }
+    }
+
+    return sep->output;
+}
+
+/*
+ * separation_end_page() - 释放行缓冲。
+ */
+void
+separation_end_page(
+    separation_t        *sep            /* 输入/输出 - 分色 */
+) {
+    if ( sep->output != sep->planes ) {
+        free(sep->output);
+    }
+    free(sep->planes);
+    free(sep->amounts);
+    sep->planes = sep->amounts = sep->output = NULL;
+}
@@ -0,0 +1,66 @@
+/*
+ * separation.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_SEPARATION_H
+#define __LEISRASTERFILTER_SEPARATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ppdcache.h"
+
+/*
+ * 分色后每行的排列方式。
+ */
+typedef enum {
+    SEPARATION_NONE = 0,        /* 不分色，RGB 直接发给设备 */
+    SEPARATION_CHUNKED,         /* 每个像素 C、M、Y、K 四个字节 */
+    SEPARATION_PLANAR           /* 一行先是全部的 C，再是 M、Y、K */
+} separation_layout_t;
+
+/*
+ * RGB 到 CMYK 的分色。查找表在任务开始时按 PPD 属性生成一次：
+ *
+ *     cmy[v]      RGB 的一个分量 v 对应的 C/M/Y 值（按 cupsAllGamma 和 cupsAllDensity）
+ *     black[g]    C、M、Y 中最小的值为 g 时生成的 K（按 cupsBlackGeneration）
+ *     removal[g]  同时从 C、M、Y 中去掉的量（底色去除，按 cupsUnderColorRemoval）
+ */
+typedef struct {
+    separation_layout_t layout;     /* 排列方式 */
+    uint8_t             cmy[256],   /* RGB 分量到 C/M/Y */
+                        black[256], /* 黑版生成 */
+                        removal[256];   /* 底色去除 */
+    unsigned            width;      /* 每行像素数 */
+    uint8_t             *planes,    /* 查表后的 C、M、Y、K 平面 */
+                        *amounts,   /* 每个像素要去掉的底色 */
+                        *output;    /* 分色后的行 */
+} separation_t;
+
+extern int separation_init(separation_t *sep, const ppdcache_t *ppd, const char *layout);
+extern int separation_start_page(separation_t *sep, unsigned width);
+extern const uint8_t *separation_convert(separation_t *sep, const uint8_t *rgb);
+extern void separation_end_page(separation_t *sep);
+
+#endif
@@ -0,0 +1,494 @@
+/*
+ * tile.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 分块输出。整页缓冲的大小和 bitmap 头部中的 bi_data_size、bf_size 都受 32 位
+ * 的限制，2400 dpi 的大幅面横幅一页就可能超过 4 GB。分块输出不分配整页缓冲：
+ *
+ * 1. 转换（和重采样）好的行依次攒进一条，一条的高度为块高度。
+ * 2. 攒满一条就按块宽度切开，每块由线程池并行编码为一个独立的 bitmap，写成
+ *    单独的文件，或者按顺序写进 tar 格式的输出流。
+ * 3. 每页另有一个 JSON 清单，记录每块的文件名、位置和尺寸。
+ *
+ * 块的大小有上限，每块都能放进 32 位的 bitmap 头部；条缓冲和偏移量都用 64 位
+ * 计算，页面大小只受磁盘空间限制。
+ */
+
+#include "tile.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+static const uint8_t    tile_zeros[TILE_TAR_BLOCK * 2];     /* tar 的填充和结束块 */
+
+/*
+ * tile_options() - 按 bitmap-tile 选项得到块的尺寸：一个数为正方形的边长，
+ *                  或者“宽x高”。
+ */
+int                                     /* 输出 - 1 分块输出，0 不分块 */
+tile_options(
+    bitmap_job_data_t   *job,           /* 输入 - 任务数据 */
+    unsigned            *tile_width,    /* 输出 - 块的宽度 */
+    unsigned            *tile_height    /* 输出 - 块的高度 */
+) {
+    const char          *value = cupsGetOption("bitmap-tile", job->num_options, job->options);
+    unsigned            width = 0, height = 0;
+
+    *tile_width = *tile_height = 0;
+    if ( value == NULL ) {
+        return 0;
+    }
+
+    switch ( sscanf(value, "%ux%u", &width, &height) ) {
+        case 1:
+            height = width;
+            break;
+        case 2:
+            break;
+        default:
+            log_error("Error", "Invalid bitmap-tile option, writing whole pages.");
+            return 0;
+    }
+    if ( width == 0 || height == 0 || width > TILE_MAX_SIZE || height > TILE_MAX_SIZE ) {
+        log_error("Error", "Tile size out of range, writing whole pages.");
+        return 0;
+    }
+
+    *tile_width = width;
+    *tile_height = height;
+    fprintf(stderr, "DEBUG: Writing pages as %ux%u tiles\n", width, height);
+
+    return 1;
+}
+
+/*
+ * tile_writer_init() - 初始化分块输出。
+ */
+void
+tile_writer_init(
+    tile_writer_t       *tw,            /* 输出 - 分块输出 */
+    unsigned            tile_width,     /* 输入 - 块的宽度 */
+    unsigned            tile_height,    /* 输入 - 块的高度 */
+    const char          *directory,     /* 输入 - 输出目录，为 NULL 时写 tar */
+    output_sink_t       *sink,          /* 输入 - tar 的输出流 */
+    workpool_t          *pool,          /* 输入 - 编码用的线程池 */
+    int                 auto_gray       /* 输入 - 是否把灰色的彩色块输出为 8 位 */
+) {
+    memset(tw, 0, sizeof(tile_writer_t));
+    tw->tile_width = tile_width;
+    tw->tile_height = tile_height;
+    tw->directory = directory;
+    tw->sink = sink;
+    tw->pool = pool;
+    tw->auto_gray = auto_gray;
+}
+
+/*
+ * tile_append() - 往清单后面追加格式化的文本。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+tile_append(
+    tile_writer_t       *tw,            /* 输入 - 分块输出 */
+    const char          *format,        /* 输入 - 格式 */
+    ...
+) {
+    va_list             args;
+    int                 length;
+    char                *manifest;
+
+    for ( ; ; ) {
+        va_start(args, format);
+        length = vsnprintf(tw->manifest + tw->manifest_size, tw->manifest_alloc - tw->manifest_size, format, args);
+        va_end(args);
+        if ( length < 0 ) {
+            return FUNCTION_FAILURE;
+        }
+        if ( tw->manifest_size + length < tw->manifest_alloc ) {
+            tw->manifest_size += length;
+            return FUNCTION_SUCCESS;
+        }
+        if ( ( manifest = (char *) realloc(tw->manifest, tw->manifest_alloc * 2 + length + 1) ) == NULL ) {
+            return FUNCTION_FAILURE;
+        }
+        tw->manifest = manifest;
+        tw->manifest_alloc = tw->manifest_alloc * 2 + length + 1;
+    }
+}
+
+/*
+ * tile_write_file() - 把一段数据写成文件。先删掉旧文件，免得改写到别的文件的
+ *                     硬链接。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+tile_write_file(
+    const char          *path,          /* 输入 - 文件路径 */
+    const uint8_t       *data,          /* 输入 - 数据 */
+    size_t              size            /* 输入 - 字节数 */
+) {
+    int                 fd;
+    ssize_t             bytes;
+
+    unlink(path);
+    if ( ( fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) ) == -1 ) {
+        return FUNCTION_FAILURE;
+    }
+    while ( size > 0 ) {
+        if ( ( bytes = write(fd, data, size) ) < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            close(fd);
+            return FUNCTION_FAILURE;
+        }
+        data += bytes;
+        size -= bytes;
+    }
+
+    return ( close(fd) == 0 )? FUNCTION_SUCCESS: FUNCTION_FAILURE;
+}
+
+/*
+ * tile_tar_entry() - 往输出流写一个 ustar 条目。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+tile_tar_entry(
+    tile_writer_t       *tw,            /* 输入 - 分块输出 */
+    const char          *name,          /* 输入 - 条目名 */
+    const void          *data,          /* 输入 - 数据 */
+    size_t              size            /* 输入 - 字节数 */
+) {
+    uint8_t             header[TILE_TAR_BLOCK];
+    unsigned            checksum = 0,
+                        index;
+
+    memset(header, 0, sizeof(header));
+    snprintf((char *) header, 100, "%s", name);
+    memcpy(header + 100, "0000644", 8);
+    memcpy(header + 108, "0000000", 8);
+    memcpy(header + 116, "0000000", 8);
+    snprintf((char *) header + 124, 12, "%011llo", (unsigned long long) size);
+    snprintf((char *) header + 136, 12, "%011llo", (unsigned long long) time(NULL));
+    memset(header + 148, ' ', 8);
+    header[156] = '0';
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    for ( index = 0; index < TILE_TAR_BLOCK; index ++ ) {
+        checksum += header[index];
+    }
+    snprintf((char *) header + 148, 8, "%06o", checksum);
+
+    tw->archive = 1;
+    if (
+        ! output_write(tw->sink, header, TILE_TAR_BLOCK)
+        || ! output_write(tw->sink, data, size)
+        || ! output_write(tw->sink, tile_zeros, ( TILE_TAR_BLOCK - size % TILE_TAR_BLOCK ) % TILE_TAR_BLOCK)
+    ) {
+        return FUNCTION_FAILURE;
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * tile_encode() - 把当前这一条中的第 task 块编码为 bitmap，由线程池调用。
+ *                 写文件时顺便写出。
+ */
+static void
+tile_encode(
+    void                *data,          /* 输入 - 分块输出 */
+    unsigned            task            /* 输入 - 块在这一条中的序号 */
+) {
+    tile_writer_t       *tw = (tile_writer_t *) data;
+    tile_t              *tile = &(tw->tiles[task]);
+    const uint8_t       *origin = tw->strip + (size_t) tile->x * tw->channels,
+                        *src;
+    bitmap_file_header  file_header;
+    bitmap_info_header  info_header;
+    bitmap_8bit_palette palette;
+    size_t              header_bytes, out_row, pad, column;
+    uint8_t             *dst;
+    unsigned            row;
+    int                 gray = ( tw->channels == 1 );
+    char                path[1024];
+
+    TRACE_BEGIN("encode tile", task);
+
+    /* 全为灰色的彩色块按 8 位灰度输出。 */
+    if ( ! gray && tw->auto_gray ) {
+        for ( gray = 1, row = 0; gray && row < tile->height; row ++ ) {
+            gray = bitmap_24bit_is_gray(
+                (const bitmap_24bit_pixel *) ( origin + (size_t) row * tw->row_bytes ),
+                tile->width
+            );
+        }
+    }
+    tile->bits = gray? 8: 24;
+
+    if ( gray ) {
+        init_8bit_header(&file_header, &info_header, tile->width, tile->height);
+        header_bytes = sizeof(bitmap_file_header) + sizeof(bitmap_info_header) + sizeof(bitmap_8bit_palette);
+    } else {
+        init_24bit_header(&file_header, &info_header, tile->width, tile->height);
+        header_bytes = sizeof(bitmap_file_header) + sizeof(bitmap_info_header);
+    }
+    set_bitmap_resolution(&info_header, tw->x_res, tw->y_res);
+    out_row = (size_t) tile->width * ( tile->bits / 8 );
+    pad = ( 4 - out_row % 4 ) % 4;
+    tile->size = header_bytes + ( out_row + pad ) * tile->height;
+
+    if ( ( tile->data = (uint8_t *) malloc(tile->size) ) == NULL ) {
+        tile->failed = 1;
+        TRACE_END("encode tile");
+        return;
+    }
+    memcpy(tile->data, &file_header, sizeof(bitmap_file_header));
+    memcpy(tile->data + sizeof(bitmap_file_header), &info_header, sizeof(bitmap_info_header));
+    if ( gray ) {
+        init_8bit_w_palette(&palette);
+        memcpy(tile->data + sizeof(bitmap_file_header) + sizeof(bitmap_info_header), &palette, sizeof(bitmap_8bit_palette));
+    }
+
+    /* bitmap 的行从下往上存。 */
+    for ( row = 0; row < tile->height; row ++ ) {
+        src = origin + (size_t) ( tile->height - 1 - row ) * tw->row_bytes;
+        dst = tile->data + header_bytes + ( out_row + pad ) * row;
+        if ( gray && tw->channels == 3 ) {
+            for ( column = 0; column < tile->width; column ++ ) {
+                dst[column] = src[column * 3];
+            }
+        } else {
+            memcpy(dst, src, out_row);
+        }
+        memset(dst + out_row, 0, pad);
+    }
+
+    if ( tw->directory != NULL ) {
+        snprintf(path, sizeof(path), "%s/%05u-%04u-%04u.bmp", tw->directory, tw->index, tw->strip_number, task);
+        if ( ! tile_write_file(path, tile->data, tile->size) ) {
+            tile->failed = 1;
+        }
+        free(tile->data);
+        tile->data = NULL;
+    }
+
+    TRACE_END("encode tile");
+}
+
+/*
+ * tile_flush_strip() - 把攒好的一条的前 rows 行切块输出。
+ */
+static int                              /* 输出 - 1 成功，0 失败 */
+tile_flush_strip(
+    tile_writer_t       *tw,            /* 输入 - 分块输出 */
+    unsigned            rows            /* 输入 - 行数 */
+) {
+    tile_t              *tile;
+    unsigned            column;
+    char                name[64];
+    int                 failure = FUNCTION_SUCCESS;
+
+    TRACE_BEGIN("tile strip", tw->strip_number);
+
+    for ( column = 0; column < tw->columns; column ++ ) {
+        tile = &(tw->tiles[column]);
+        memset(tile, 0, sizeof(tile_t));
+        tile->x = column * tw->tile_width;
+        tile->y = tw->strip_number * tw->tile_height;
+        tile->width = ( tw->width - tile->x < tw->tile_width )? tw->width - tile->x: tw->tile_width;
+        tile->height = rows;
+    }
+    workpool_run(tw->pool, tile_encode, tw, tw->columns);
+
+    /* 按顺序写进 tar 并记入清单。 */
+    for ( column = 0; column < tw->columns; column ++ ) {
+        tile = &(tw->tiles[column]);
+        snprintf(name, sizeof(name), "%05u-%04u-%04u.bmp", tw->index, tw->strip_number, column);
+        if ( ! tile->failed && tw->directory == NULL ) {
+            tile->failed = ! tile_tar_entry(tw, name, tile->data, tile->size);
+        }
+        free(tile->data);
+        tile->data = NULL;
+        if ( tile->failed ) {
+            failure = FUNCTION_FAILURE;
+            continue;
+        }
+        tile_append(tw, "%s\n    {\"file\": \"%s\", \"row\": %u, \"column\": %u, \"x\": %u, \"y\": %u, "
+            "\"width\": %u, \"height\": %u, \"bits\": %u, \"bytes\": %llu}",
+            ( tw->tiles_written == 0 )? "": ",", name, tw->strip_number, column, tile->x, tile->y,
+            tile->width, tile->height, tile->bits, (unsigned long long) tile->size);
+        tw->tiles_written ++;
+        tw->bytes_written += tile->size;
+    }
+
+    /* 把多出来的行移到这一条的开头。 */
+    tw->strip_rows -= rows;
+    if ( tw->strip_rows > 0 ) {
+        memmove(tw->strip, tw->strip + (size_t) rows * tw->row_bytes, (size_t) tw->strip_rows * tw->row_bytes);
+    }
+    tw->strip_number ++;
+
+    TRACE_END("tile strip");
+
+    if ( failure == FUNCTION_FAILURE ) {
+        log_error("Error", "Unable to write tile!");
+    }
+    return failure;
+}
+
+/*
+ * tile_page_begin() - 开始一页。max_push_rows 为一次 tile_page_advance() 最多
+ *                     增加的行数。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+tile_page_begin(
+    tile_writer_t       *tw,            /* 输入 - 分块输出 */
+    unsigned            index,          /* 输入 - 页面编号，用于文件名 */
+    unsigned            width,          /* 输入 - 页面宽度 */
+    unsigned            height,         /* 输入 - 页面高度 */
+    unsigned            channels,       /* 输入 - 每个像素的字节数，1 或 3 */
+    unsigned            x_res,          /* 输入 - 横向分辨率 (dpi) */
+    unsigned            y_res,          /* 输入 - 纵向分辨率 (dpi) */
+    unsigned            max_push_rows   /* 输入 - 每次最多增加的行数 */
+) {
+    tw->index = index;
+    tw->width = width;
+    tw->height = height;
+    tw->channels = channels;
+    tw->x_res = x_res;
+    tw->y_res = y_res;
+    tw->row_bytes = (size_t) width * channels;
+    tw->strip_rows = 0;
+    tw->strip_number = 0;
+    tw->strip_capacity = tw->tile_height + ( ( max_push_rows > 0 )? max_push_rows - 1: 0 );
+    tw->columns = ( width + tw->tile_width - 1 ) / tw->tile_width;
+    tw->tiles_written = 0;
+    tw->bytes_written = 0;
+    tw->manifest_size = 0;
+
+    if (
+        ( tw->strip = (uint8_t *) malloc(tw->row_bytes * tw->strip_capacity + 1) ) == NULL
+        || ( tw->tiles = (tile_t *) calloc(tw->columns + 1, sizeof(tile_t)) ) == NULL
+    ) {
+        log_error("Error", "Unable to allocate tile strip memory!");
+        free(tw->strip);
+        tw->strip = NULL;
+        return FUNCTION_FAILURE;
+    }
+
+    return tile_append(tw, "{\n  \"page\": %u,\n  \"width\": %u,\n  \"height\": %u,\n"
+        "  \"x_resolution\": %u,\n  \"y_resolution\": %u,\n"
+        "  \"tile_width\": %u,\n  \"tile_height\": %u,\n  \"tiles\": [",
+        index, width, height, x_res, y_res, tw->tile_width, tw->tile_height);
+}
+
+/*
+ * tile_page_rows() - 下一行的写入位置，后面至少还能放 max_push_rows 行。
+ */
+uint8_t *                               /* 输出 - 写入位置 */
+tile_page_rows(
+    tile_writer_t       *tw             /* 输入 - 分块输出 */
+) {
+    return tw->strip + (size_t) tw->strip_rows * tw->row_bytes;
+}
+
+/*
+ * tile_page_advance() - 写入了 rows 行，攒满一条就输出。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+tile_page_advance(
+    tile_writer_t       *tw,            /* 输入 - 分块输出 */
+    unsigned            rows            /* 输入 - 行数 */
+) {
+    tw->strip_rows += rows;
+    while ( tw->strip_rows >= tw->tile_height ) {
+        if ( ! tile_flush_strip(tw, tw->tile_height) ) {
+            return FUNCTION_FAILURE;
+        }
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * tile_page_end() - 输出剩下的行和清单，结束一页。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+tile_page_end(
+    tile_writer_t       *tw             /* 输入 - 分块输出 */
+) {
+    char                path[1024];
+    int                 failure = FUNCTION_SUCCESS;
+
+    if ( tw->strip == NULL ) {
+        return FUNCTION_FAILURE;
+    }
+    if ( tw->strip_rows > 0 && ! tile_flush_strip(tw, tw->strip_rows) ) {
+        failure = FUNCTION_FAILURE;
+    }
+
+    if ( ! tile_append(tw, "\n  ]\n}\n") ) {
+        failure = FUNCTION_FAILURE;
+    } else if ( tw->directory != NULL ) {
+        snprintf(path, sizeof(path), "%s/%05u.json", tw->directory, tw->index);
+        if ( ! tile_write_file(path, (const uint8_t *) tw->manifest, tw->manifest_size) ) {
+            failure = FUNCTION_FAILURE;
+        }
+    } else {
+        snprintf(path, sizeof(path), "%05u.json", tw->index);
+        if ( ! tile_tar_entry(tw, path, tw->manifest, tw->manifest_size) ) {
+            failure = FUNCTION_FAILURE;
+        }
+    }
+    fprintf(stderr, "DEBUG: Page %u written as %llu tiles, %llu bytes\n", tw->index, tw->tiles_written, tw->bytes_written);
+
+    free(tw->strip);
+    free(tw->tiles);
+    tw->strip = NULL;
+    tw->tiles = NULL;
+
+    return failure;
+}
+
+/*
+ * tile_writer_finish() - 结束分块输出，写 tar 时补上结束块。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+tile_writer_finish(
+    tile_writer_t       *tw             /* 输入 - 分块输出 */
+) {
+    int                 failure = FUNCTION_SUCCESS;
+
+    if ( tw->archive && ! output_write(tw->sink, tile_zeros, sizeof(tile_zeros)) ) {
+        failure = FUNCTION_FAILURE;
+    }
+    free(tw->manifest);
+    tw->manifest = NULL;
+    tw->manifest_alloc = tw->manifest_size = 0;
+
+    return failure;
+}
@@ -0,0 +1,93 @@
+/*
+ * tile.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_TILE_H
+#define __LEISRASTERFILTER_TILE_H
+
+#include "bitmap.h"
+#include "workpool.h"
+
+#define TILE_MAX_SIZE           16384   /* 块的最大宽度和高度（像素） */
+#define TILE_TAR_BLOCK          512     /* tar 的块大小 */
+
+/*
+ * 一块的输出。
+ */
+typedef struct {
+    uint8_t             *data;          /* 编码好的 bitmap，写进 tar 之前暂存 */
+    size_t              size;           /* 字节数 */
+    unsigned            x,              /* 在页面中的位置 */
+                        y,
+                        width,          /* 尺寸 */
+                        height,
+                        bits;           /* 每个像素的位数，8 或 24 */
+    int                 failed;         /* 编码或写入失败时为 1 */
+} tile_t;
+
+/*
+ * 分块输出。页面按行攒满一条（块高度的行数）就切成若干块，由线程池并行编码，
+ * 每块是一个单独的 bitmap，另有一个 JSON 清单记录每块的位置。directory 不为
+ * NULL 时每块写成目录下的文件，否则按 tar 格式依次写进输出流。
+ */
+typedef struct {
+    unsigned            tile_width,     /* 块的宽度 */
+                        tile_height;    /* 块的高度 */
+    const char          *directory;     /* 输出目录，为 NULL 时写 tar */
+    output_sink_t       *sink;          /* tar 的输出流 */
+    workpool_t          *pool;          /* 编码用的线程池 */
+    int                 auto_gray;      /* 为 1 时把全为灰色的彩色块输出为 8 位 */
+
+    unsigned            index,          /* 当前页的编号，用于文件名 */
+                        width,          /* 当前页的宽度 */
+                        height,         /* 当前页的高度 */
+                        channels,       /* 每个像素的字节数，1 或 3 */
+                        x_res,          /* 分辨率 (dpi) */
+                        y_res;
+    size_t              row_bytes;      /* 每行的字节数 */
+    uint8_t             *strip;         /* 正在攒的一条 */
+    unsigned            strip_rows,     /* 这一条已有的行数 */
+                        strip_capacity, /* 这一条最多能放的行数 */
+                        strip_number,   /* 这一条的编号 */
+                        columns;        /* 每条的块数 */
+    tile_t              *tiles;         /* 这一条的块 */
+
+    char                *manifest;      /* 当前页的清单 */
+    size_t              manifest_size,
+                        manifest_alloc;
+    unsigned long long  tiles_written,  /* 已输出的块数 */
+                        bytes_written;  /* 已输出的字节数 */
+    int                 archive;        /* 已经往输出流写过 tar 条目时为 1 */
+} tile_writer_t;
+
+extern int tile_options(bitmap_job_data_t *job, unsigned *tile_width, unsigned *tile_height);
+extern void tile_writer_init(tile_writer_t *tw, unsigned tile_width, unsigned tile_height, const char *directory, output_sink_t *sink, workpool_t *pool, int auto_gray);
+extern int tile_page_begin(tile_writer_t *tw, unsigned index, unsigned width, unsigned height, unsigned channels, unsigned x_res, unsigned y_res, unsigned max_push_rows);
+extern uint8_t *tile_page_rows(tile_writer_t *tw);
+extern int tile_page_advance(tile_writer_t *tw, unsigned rows);
+extern int tile_page_end(tile_writer_t *tw);
+extern int tile_writer_finish(tile_writer_t *tw);
+
+#endif
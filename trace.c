@@ -0,0 +1,213 @@
+/*
+ * trace.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 时间线记录。计数器只能说明总共花了多少时间，看不出各阶段之间在哪里等待；
+ * 这里记录每个阶段的开始和结束时刻，退出时写成 trace JSON，可以直接拖进
+ * chrome://tracing 或 ui.perfetto.dev 查看。
+ *
+ * 每个线程第一次记录时分配自己的缓冲，用 CAS 挂到全局链表上，之后只有这个
+ * 线程往里写，不需要加锁。缓冲按块增长，块中的事件数写完事件后才更新。
+ */
+
+#define _GNU_SOURCE
+
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+
+typedef struct {
+    const char          *name;          /* 事件名 */
+    uint64_t            timestamp;      /* 时刻 (ns) */
+    long long           value;          /* 参数 */
+    char                phase;          /* 'B' 开始，'E' 结束 */
+} trace_record_t;
+
+typedef struct trace_chunk_s {
+    struct trace_chunk_s    *next;      /* 下一块 */
+    unsigned                count;      /* 已写入的事件数 */
+    trace_record_t          records[TRACE_CHUNK_EVENTS];
+} trace_chunk_t;
+
+typedef struct trace_thread_s {
+    struct trace_thread_s   *next;      /* 下一个线程 */
+    pid_t                   tid;        /* 线程 id */
+    trace_chunk_t           *first,     /* 第一块缓冲 */
+                            *last;      /* 正在写的一块 */
+    unsigned long long      dropped;    /* 分配不到缓冲而丢掉的事件数 */
+} trace_thread_t;
+
+int                         TraceEnabled = 0;
+static const char           *TracePath = NULL;
+static uint64_t             TraceStart = 0;     /* trace_init() 的时刻 */
+static trace_thread_t       *TraceThreads = NULL;
+static __thread trace_thread_t  *TraceSelf = NULL;
+
+/*
+ * trace_now() - 单调时钟的当前时刻 (ns)。
+ */
+static uint64_t
+trace_now(void) {
+    struct timespec     ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * trace_thread() - 取得当前线程的缓冲，第一次调用时分配并挂到链表上。
+ */
+static trace_thread_t *
+trace_thread(void) {
+    trace_thread_t      *self;
+
+    if ( TraceSelf != NULL ) {
+        return TraceSelf;
+    }
+    if ( ( self = (trace_thread_t *) calloc(1, sizeof(trace_thread_t)) ) == NULL ) {
+        return NULL;
+    }
+    self->tid = (pid_t) syscall(SYS_gettid);
+    self->next = __atomic_load_n(&TraceThreads, __ATOMIC_RELAXED);
+    while ( ! __atomic_compare_exchange_n(&TraceThreads, &(self->next), self, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED) ) {
+    }
+
+    return ( TraceSelf = self );
+}
+
+/*
+ * trace_event() - 记录一个事件。
+ */
+void
+trace_event(
+    const char          *name,          /* 输入 - 事件名 */
+    char                phase,          /* 输入 - 'B' 开始，'E' 结束 */
+    long long           value           /* 输入 - 参数 */
+) {
+    trace_thread_t      *self = trace_thread();
+    trace_chunk_t       *chunk;
+    trace_record_t      *record;
+    uint64_t            timestamp = trace_now();
+
+    if ( self == NULL ) {
+        return;
+    }
+    chunk = self->last;
+    if ( chunk == NULL || chunk->count == TRACE_CHUNK_EVENTS ) {
+        if ( ( chunk = (trace_chunk_t *) malloc(sizeof(trace_chunk_t)) ) == NULL ) {
+            self->dropped ++;
+            return;
+        }
+        chunk->next = NULL;
+        chunk->count = 0;
+        if ( self->last == NULL ) {
+            __atomic_store_n(&(self->first), chunk, __ATOMIC_RELEASE);
+        } else {
+            __atomic_store_n(&(self->last->next), chunk, __ATOMIC_RELEASE);
+        }
+        self->last = chunk;
+    }
+
+    record = &(chunk->records[chunk->count]);
+    record->name = name;
+    record->timestamp = timestamp;
+    record->value = value;
+    record->phase = phase;
+    __atomic_store_n(&(chunk->count), chunk->count + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * trace_dump() - 退出时把所有线程的事件写成 trace JSON。
+ */
+static void
+trace_dump(void) {
+    FILE                *file;
+    trace_thread_t      *thread;
+    trace_chunk_t       *chunk;
+    const trace_record_t    *record;
+    unsigned            index, count;
+    unsigned long long  total = 0,
+                        dropped = 0;
+    const pid_t         pid = getpid();
+
+    TraceEnabled = 0;
+    if ( ( file = fopen(TracePath, "w") ) == NULL ) {
+        fprintf(stderr, "DEBUG: Unable to write trace to %s: %s\n", TracePath, strerror(errno));
+        return;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+        pid, pid, program_invocation_short_name);
+    for ( thread = __atomic_load_n(&TraceThreads, __ATOMIC_ACQUIRE); thread != NULL; thread = thread->next ) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            pid, thread->tid, ( thread->tid == pid )? "main": "worker");
+        for ( chunk = __atomic_load_n(&(thread->first), __ATOMIC_ACQUIRE); chunk != NULL; chunk = __atomic_load_n(&(chunk->next), __ATOMIC_ACQUIRE) ) {
+            count = __atomic_load_n(&(chunk->count), __ATOMIC_ACQUIRE);
+            for ( index = 0; index < count; index ++ ) {
+                record = &(chunk->records[index]);
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+                    record->name, record->phase, ( record->timestamp - TraceStart ) / 1000.0, pid, thread->tid);
+                if ( record->phase == 'B' ) {
+                    fprintf(file, ",\"args\":{\"value\":%lld}", record->value);
+                }
+                fputc('}', file);
+            }
+            total += count;
+        }
+        dropped += thread->dropped;
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    if ( fclose(file) != 0 ) {
+        fprintf(stderr, "DEBUG: Unable to write trace to %s: %s\n", TracePath, strerror(errno));
+        return;
+    }
+    fprintf(stderr, "DEBUG: Wrote %llu trace events to %s (%llu dropped)\n", total, TracePath, dropped);
+}
+
+/*
+ * trace_init() - 按环境变量打开时间线记录，退出时写出。
+ */
+void
+trace_init(void) {
+    TracePath = getenv(TRACE_ENV);
+    if ( TracePath == NULL || TracePath[0] == '\0' ) {
+        return;
+    }
+
+    TraceStart = trace_now();
+    if ( atexit(trace_dump) != 0 ) {
+        return;
+    }
+    TraceEnabled = 1;
+}
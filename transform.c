@@ -0,0 +1,411 @@
+/*
+ * transform.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 页面几何变换：上下翻转、左右镜像以及 90/180/270 度旋转。
+ *
+ * 1. 上下翻转按整行交换，每次交换是三次 memcpy。
+ * 2. 左右镜像先把一行拷到临时行，再用 GCC 向量扩展的 __builtin_shuffle 一次倒序
+ *    16 个 8 位像素（或 5 个 24 位像素）写回。
+ * 3. 旋转（以及转置）分块进行，每块 TRANSFORM_TILE x TRANSFORM_TILE 个像素，
+ *    使源和目标的访问都落在缓存里。
+ */
+
+#include "transform.h"
+#include <stddef.h>
+
+#define TRANSFORM_TILE  32  /* 分块的边长（像素） */
+
+/* 16 字节的向量类型（GCC 向量扩展）。 */
+typedef uint8_t transform_v16qu __attribute__ ((vector_size (16)));
+
+/* 倒序 16 个 8 位像素。 */
+static const transform_v16qu reverse_8bit_mask = {
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+};
+
+/* 倒序前 5 个 24 位像素，第 16 个字节随便取，会被下一次写入覆盖。 */
+static const transform_v16qu reverse_24bit_mask = {
+    12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2, 15
+};
+
+/*
+ * transform_flip_vertical() - 原地上下翻转像素阵，按整行交换。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+transform_flip_vertical(
+    uint8_t             *pixels,        /* 输入 - 像素阵 */
+    unsigned            width,          /* 输入 - 宽度 */
+    unsigned            height,         /* 输入 - 高度 */
+    unsigned            pixel_size      /* 输入 - 每个像素的字节数 */
+) {
+    const size_t        row_bytes = (size_t) width * pixel_size;
+    uint8_t             *line_buffer,
+                        *top,
+                        *bottom;
+
+    if ( height < 2 ) {
+        return FUNCTION_SUCCESS;
+    }
+    if ( ( line_buffer = (uint8_t *) malloc(row_bytes) ) == NULL ) {
+        return FUNCTION_FAILURE;
+    }
+
+    for (
+        top = pixels, bottom = pixels + ( height - 1 ) * row_bytes;
+        top < bottom;
+        top += row_bytes, bottom -= row_bytes
+    ) {
+        memcpy(line_buffer, top, row_bytes);
+        memcpy(top, bottom, row_bytes);
+        memcpy(bottom, line_buffer, row_bytes);
+    }
+
+    free(line_buffer);
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * transform_mirror_row() - 把 src 中的一行倒序写入 dst。
+ *                          src 末尾至少要多出 16 个可读字节。
+ */
+static void
+transform_mirror_row(
+    const uint8_t       *src,           /* 输入 - 源行 */
+    uint8_t             *dst,           /* 输出 - 目标行 */
+    unsigned            width,          /* 输入 - 宽度 */
+    unsigned            pixel_size      /* 输入 - 每个像素的字节数 */
+) {
+    transform_v16qu     v;
+    unsigned            index = 0;
+
+    if ( pixel_size == 1 ) {
+        for ( ; index + 16 <= width; index += 16 ) {
+            memcpy(&v, src + width - 16 - index, sizeof(v));
+            v = __builtin_shuffle(v, reverse_8bit_mask);
+            memcpy(dst + index, &v, sizeof(v));
+        }
+        for ( ; index < width; index ++ ) {
+            dst[index] = src[width - 1 - index];
+        }
+    } else if ( pixel_size == 3 ) {
+        /* 每次写 16 个字节，其中有效的 15 个字节是 5 个像素，最后一个字节会被覆盖。 */
+        for ( ; index + 6 <= width; index += 5 ) {
+            memcpy(&v, src + ( width - 5 - index ) * 3, sizeof(v));
+            v = __builtin_shuffle(v, reverse_24bit_mask);
+            memcpy(dst + index * 3, &v, sizeof(v));
+        }
+        for ( ; index < width; index ++ ) {
+            memcpy(dst + index * 3, src + ( width - 1 - index ) * 3, 3);
+        }
+    } else {
+        for ( ; index < width; index ++ ) {
+            memcpy(dst + index * pixel_size, src + ( width - 1 - index ) * pixel_size, pixel_size);
+        }
+    }
+}
+
+/*
+ * transform_mirror() - 原地左右镜像像素阵。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+transform_mirror(
+    uint8_t             *pixels,        /* 输入 - 像素阵 */
+    unsigned            width,          /* 输入 - 宽度 */
+    unsigned            height,         /* 输入 - 高度 */
+    unsigned            pixel_size      /* 输入 - 每个像素的字节数 */
+) {
+    const size_t        row_bytes = (size_t) width * pixel_size;
+    uint8_t             *line_buffer;
+    unsigned            index;
+
+    /* 多留 16 个字节，让向量读取不越界。 */
+    if ( ( line_buffer = (uint8_t *) malloc(row_bytes + sizeof(transform_v16qu)) ) == NULL ) {
+        return FUNCTION_FAILURE;
+    }
+
+    for ( index = 0; index < height; index ++ ) {
+        memcpy(line_buffer, pixels + index * row_bytes, row_bytes);
+        transform_mirror_row(line_buffer, pixels + index * row_bytes, width, pixel_size);
+    }
+
+    free(line_buffer);
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * transform_rotate() - 把 src 按 op 变换后写入 dst，分块处理。
+ *                      op 交换宽和高时，dst 的宽为 height、高为 width。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+transform_rotate(
+    const uint8_t       *src,           /* 输入 - 源像素阵 */
+    uint8_t             *dst,           /* 输出 - 目标像素阵 */
+    unsigned            width,          /* 输入 - 源宽度 */
+    unsigned            height,         /* 输入 - 源高度 */
+    unsigned            pixel_size,     /* 输入 - 每个像素的字节数 */
+    transform_op_t      op              /* 输入 - 变换 */
+) {
+    const ptrdiff_t     ps = pixel_size,
+                        stride = (ptrdiff_t) width * pixel_size;
+    const unsigned      dst_width = TRANSFORM_SWAPS_AXES(op)? height: width,
+                        dst_height = TRANSFORM_SWAPS_AXES(op)? width: height;
+    const uint8_t       *base,          /* dst(0, 0) 对应的源像素 */
+                        *s;
+    ptrdiff_t           step_r,         /* dst 下移一行时源指针的偏移 */
+                        step_c;         /* dst 右移一列时源指针的偏移 */
+    uint8_t             *d;
+    unsigned            tile_r, tile_c, r, c, r_end, c_end;
+
+    if ( width == 0 || height == 0 ) {
+        return FUNCTION_SUCCESS;
+    }
+
+    switch ( op ) {
+        case TRANSFORM_NONE:
+            base = src, step_r = stride, step_c = ps;
+            break;
+        case TRANSFORM_FLIP_VERTICAL:
+            base = src + ( height - 1 ) * stride, step_r = -stride, step_c = ps;
+            break;
+        case TRANSFORM_MIRROR:
+            base = src + ( width - 1 ) * ps, step_r = stride, step_c = -ps;
+            break;
+        case TRANSFORM_ROTATE_180:
+            base = src + ( height - 1 ) * stride + ( width - 1 ) * ps, step_r = -stride, step_c = -ps;
+            break;
+        case TRANSFORM_TRANSPOSE:
+            base = src, step_r = ps, step_c = stride;
+            break;
+        case TRANSFORM_ROTATE_90:
+            base = src + ( height - 1 ) * stride, step_r = ps, step_c = -stride;
+            break;
+        case TRANSFORM_ROTATE_270:
+            base = src + ( width - 1 ) * ps, step_r = -ps, step_c = stride;
+            break;
+        case TRANSFORM_TRANSVERSE:
+            base = src + ( height - 1 ) * stride + ( width - 1 ) * ps, step_r = -ps, step_c = -stride;
+            break;
+        default:
+            return FUNCTION_FAILURE;
+    }
+
+    for ( tile_r = 0; tile_r < dst_height; tile_r += TRANSFORM_TILE ) {
+        r_end = ( tile_r + TRANSFORM_TILE < dst_height )? tile_r + TRANSFORM_TILE: dst_height;
+
+        for ( tile_c = 0; tile_c < dst_width; tile_c += TRANSFORM_TILE ) {
+            c_end = ( tile_c + TRANSFORM_TILE < dst_width )? tile_c + TRANSFORM_TILE: dst_width;
+
+            for ( r = tile_r; r < r_end; r ++ ) {
+                s = base + r * step_r + tile_c * step_c;
+                d = dst + ( (size_t) r * dst_width + tile_c ) * pixel_size;
+
+                if ( pixel_size == 1 ) {
+                    for ( c = tile_c; c < c_end; c ++, s += step_c ) {
+                        *d ++ = *s;
+                    }
+                } else if ( pixel_size == 3 ) {
+                    for ( c = tile_c; c < c_end; c ++, s += step_c, d += 3 ) {
+                        d[0] = s[0];
+                        d[1] = s[1];
+                        d[2] = s[2];
+                    }
+                } else {
+                    for ( c = tile_c; c < c_end; c ++, s += step_c, d += pixel_size ) {
+                        memcpy(d, s, pixel_size);
+                    }
+                }
+            }
+        }
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * transform_page() - 对整页像素阵做变换。不交换宽高的变换原地完成；交换宽高的
+ *                    变换会分配一块新的缓冲，并释放原来的缓冲。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+transform_page(
+    void                **pixels,       /* 输入/输出 - 像素阵 */
+    unsigned            *width,         /* 输入/输出 - 宽度 */
+    unsigned            *height,        /* 输入/输出 - 高度 */
+    unsigned            pixel_size,     /* 输入 - 每个像素的字节数 */
+    transform_op_t      op              /* 输入 - 变换 */
+) {
+    uint8_t             *rotated;
+    unsigned            swap;
+
+    switch ( op ) {
+        case TRANSFORM_NONE:
+            return FUNCTION_SUCCESS;
+        case TRANSFORM_FLIP_VERTICAL:
+            return transform_flip_vertical(*pixels, *width, *height, pixel_size);
+        case TRANSFORM_MIRROR:
+            return transform_mirror(*pixels, *width, *height, pixel_size);
+        case TRANSFORM_ROTATE_180:
+            return transform_flip_vertical(*pixels, *width, *height, pixel_size)
+                && transform_mirror(*pixels, *width, *height, pixel_size);
+        default:
+            break;
+    }
+
+    if ( ( rotated = (uint8_t *) malloc((size_t) *width * *height * pixel_size) ) == NULL ) {
+        return FUNCTION_FAILURE;
+    }
+    if ( ! transform_rotate(*pixels, rotated, *width, *height, pixel_size, op) ) {
+        free(rotated);
+        return FUNCTION_FAILURE;
+    }
+
+    free(*pixels);
+    *pixels = rotated;
+    swap = *width;
+    *width = *height;
+    *height = swap;
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * transform_rect() - 求源像素阵中的一个矩形在变换后的像素阵中的位置。
+ */
+void
+transform_rect(
+    unsigned            width,          /* 输入 - 源宽度 */
+    unsigned            height,         /* 输入 - 源高度 */
+    transform_op_t      op,             /* 输入 - 变换 */
+    unsigned            *x,             /* 输入/输出 - 矩形左上角的列 */
+    unsigned            *y,             /* 输入/输出 - 矩形左上角的行 */
+    unsigned            *rect_width,    /* 输入/输出 - 矩形的宽度 */
+    unsigned            *rect_height    /* 输入/输出 - 矩形的高度 */
+) {
+    const unsigned      left = *x,
+                        top = *y,
+                        right = width - *x - *rect_width,   /* 到右边的距离 */
+                        bottom = height - *y - *rect_height;/* 到下边的距离 */
+    unsigned            swap;
+
+    /* 翻转时左上角到对边的距离成为新的坐标，交换宽高时行列互换。 */
+    switch ( op ) {
+        case TRANSFORM_FLIP_VERTICAL:
+            *y = bottom;
+            break;
+        case TRANSFORM_MIRROR:
+            *x = right;
+            break;
+        case TRANSFORM_ROTATE_180:
+            *x = right, *y = bottom;
+            break;
+        case TRANSFORM_TRANSPOSE:
+            *x = top, *y = left;
+            break;
+        case TRANSFORM_ROTATE_90:
+            *x = bottom, *y = left;
+            break;
+        case TRANSFORM_ROTATE_270:
+            *x = top, *y = right;
+            break;
+        case TRANSFORM_TRANSVERSE:
+            *x = bottom, *y = right;
+            break;
+        default:
+            break;
+    }
+    if ( TRANSFORM_SWAPS_AXES(op) ) {
+        swap = *rect_width;
+        *rect_width = *rect_height;
+        *rect_height = swap;
+    }
+}
+
+/*
+ * transform_bitmap_op() - 按任务的 orientation-requested 选项，得到 raster 像素阵
+ *                         变为 bitmap 像素阵所需的变换。
+ *
+ * raster 的行从上到下排列，bitmap 从下到上，所以结果总是“先旋转、再上下翻转”
+ * 合成之后的变换：
+ *
+ *     3 (portrait)             上下翻转
+ *     4 (landscape)            逆时针 90 度，合成为转置
+ *     5 (reverse-landscape)    顺时针 90 度，合成为反转置
+ *     6 (reverse-portrait)     180 度，合成为左右镜像
+ */
+transform_op_t                          /* 输出 - 变换 */
+transform_bitmap_op(
+    bitmap_job_data_t   *job            /* 输入 - 任务数据 */
+) {
+    const char          *value = cupsGetOption("orientation-requested", job->num_options, job->options);
+
+    if ( value == NULL ) {
+        return TRANSFORM_FLIP_VERTICAL;
+    }
+
+    switch ( atoi(value) ) {
+        case 4:
+            return TRANSFORM_TRANSPOSE;
+        case 5:
+            return TRANSFORM_TRANSVERSE;
+        case 6:
+            return TRANSFORM_MIRROR;
+        default:
+            return TRANSFORM_FLIP_VERTICAL;
+    }
+}
+
+/*
+ * transform_raster_op() - 按任务的 orientation-requested 选项，得到输出 raster 时
+ *                         所需的变换。raster 的行从上到下排列，只需要旋转：
+ *
+ *     3 (portrait)             不变换
+ *     4 (landscape)            逆时针 90 度
+ *     5 (reverse-landscape)    顺时针 90 度
+ *     6 (reverse-portrait)     180 度
+ */
+transform_op_t                          /* 输出 - 变换 */
+transform_raster_op(
+    bitmap_job_data_t   *job            /* 输入 - 任务数据 */
+) {
+    const char          *value = cupsGetOption("orientation-requested", job->num_options, job->options);
+
+    if ( value == NULL ) {
+        return TRANSFORM_NONE;
+    }
+
+    switch ( atoi(value) ) {
+        case 4:
+            return TRANSFORM_ROTATE_270;
+        case 5:
+            return TRANSFORM_ROTATE_90;
+        case 6:
+            return TRANSFORM_ROTATE_180;
+        default:
+            return TRANSFORM_NONE;
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ * transform.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_TRANSFORM_H
+#define __LEISRASTERFILTER_TRANSFORM_H
+
+#include "bitmap.h"
+
+/*
+ * 页面的几何变换。按目标像素阵与源像素阵的对应关系分为 8 种（二面体群）：
+ *
+ *     TRANSFORM_NONE             dst(r, c) = src(r, c)
+ *     TRANSFORM_FLIP_VERTICAL    dst(r, c) = src(H - 1 - r, c)
+ *     TRANSFORM_MIRROR           dst(r, c) = src(r, W - 1 - c)
+ *     TRANSFORM_ROTATE_180       dst(r, c) = src(H - 1 - r, W - 1 - c)
+ *     TRANSFORM_TRANSPOSE        dst(r, c) = src(c, r)
+ *     TRANSFORM_ROTATE_90        dst(r, c) = src(H - 1 - c, r)          （顺时针）
+ *     TRANSFORM_ROTATE_270       dst(r, c) = src(c, W - 1 - r)          （顺时针）
+ *     TRANSFORM_TRANSVERSE       dst(r, c) = src(H - 1 - c, W - 1 - r)
+ *
+ * 后四种会交换宽和高，需要另外一块缓冲。
+ */
+typedef enum {
+    TRANSFORM_NONE = 0,
+    TRANSFORM_FLIP_VERTICAL,
+    TRANSFORM_MIRROR,
+    TRANSFORM_ROTATE_180,
+    TRANSFORM_TRANSPOSE,
+    TRANSFORM_ROTATE_90,
+    TRANSFORM_ROTATE_270,
+    TRANSFORM_TRANSVERSE
+} transform_op_t;
+
+/* 变换是否交换宽和高。 */
+#define TRANSFORM_SWAPS_AXES(op)    ( (op) >= TRANSFORM_TRANSPOSE )
+
+extern int transform_flip_vertical(uint8_t *pixels, unsigned width, unsigned height, unsigned pixel_size);
+extern int transform_mirror(uint8_t *pixels, unsigned width, unsigned height, unsigned pixel_size);
+extern int transform_rotate(const uint8_t *src, uint8_t *dst, unsigned width, unsigned height, unsigned pixel_size, transform_op_t op);
+extern int transform_page(void **pixels, unsigned *width, unsigned *height, unsigned pixel_size, transform_op_t op);
+extern void transform_rect(unsigned width, unsigned height, transform_op_t op, unsigned *x, unsigned *y, unsigned *rect_width, unsigned *rect_height);
+extern transform_op_t transform_bitmap_op(bitmap_job_data_t *job);
+extern transform_op_t transform_raster_op(bitmap_job_data_t *job);
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * transform_test.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 这是一个用于测试页面几何变换的小程序。它生成一张 A4 300 dpi 大小的页面，
+ * 检查 transform.c 中的翻转、镜像和旋转结果是否正确，并与原来逐像素交换的
+ * pixel_24bit_matrix_upsidedown() / pixel_8bit_matrix_upsidedown() 比较耗时。
+ */
+
+#include "bitmap.h"
+#include "transform.h"
+#include <time.h>
+
+const unsigned  width = 2480;
+const unsigned  height = 3508;
+
+/*
+ * now() - 单调时钟的当前时间（秒）。
+ */
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * fill() - 用与位置相关的数值填充像素阵。
+ */
+static void
+fill(
+    uint8_t     *pixels,
+    unsigned    pixel_size
+) {
+    size_t      index;
+
+    for ( index = 0; index < (size_t) width * height * pixel_size; index ++ ) {
+        pixels[index] = (uint8_t) ( index * 2654435761u >> 13 );
+    }
+}
+
+/*
+ * check() - 检查 dst 是否是 src 按 op 变换的结果。
+ */
+static int
+check(
+    const uint8_t   *src,
+    const uint8_t   *dst,
+    unsigned        pixel_size,
+    transform_op_t  op
+) {
+    unsigned        dst_width = TRANSFORM_SWAPS_AXES(op)? height: width,
+                    dst_height = TRANSFORM_SWAPS_AXES(op)? width: height,
+                    r, c, sr, sc;
+
+    for ( r = 0; r < dst_height; r ++ ) {
+        for ( c = 0; c < dst_width; c ++ ) {
+            switch ( op ) {
+                case TRANSFORM_FLIP_VERTICAL:   sr = height - 1 - r, sc = c; break;
+                case TRANSFORM_MIRROR:          sr = r, sc = width - 1 - c; break;
+                case TRANSFORM_ROTATE_180:      sr = height - 1 - r, sc = width - 1 - c; break;
+                case TRANSFORM_TRANSPOSE:       sr = c, sc = r; break;
+                case TRANSFORM_ROTATE_90:       sr = height - 1 - c, sc = r; break;
+                case TRANSFORM_ROTATE_270:      sr = c, sc = width - 1 - r; break;
+                case TRANSFORM_TRANSVERSE:      sr = height - 1 - c, sc = width - 1 - r; break;
+                default:                        sr = r, sc = c; break;
+            }
+            if ( memcmp(
+                    dst + ( (size_t) r * dst_width + c ) * pixel_size,
+                    src + ( (size_t) sr * width + sc ) * pixel_size,
+                    pixel_size
+            ) ) {
+                return FUNCTION_FAILURE;
+            }
+        }
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * run() - 测试一种像素大小。
+ */
+static int
+run(
+    unsigned        pixel_size
+) {
+    const size_t    bytes = (size_t) width * height * pixel_size;
+    uint8_t         *src = (uint8_t *) malloc(bytes),
+                    *legacy = (uint8_t *) malloc(bytes),
+                    *dst = (uint8_t *) malloc(bytes);
+    double          start, legacy_time, flip_time;
+    transform_op_t  op;
+    int             failure = FUNCTION_SUCCESS;
+
+    fill(src, pixel_size);
+
+    /* 原来的逐像素翻转。 */
+    memcpy(legacy, src, bytes);
+    start = now();
+    if ( pixel_size == 3 ) {
+        pixel_24bit_matrix_upsidedown((bitmap_24bit_pixel *) legacy, width, height);
+    } else {
+        pixel_8bit_matrix_upsidedown((bitmap_8bit_pixel *) legacy, width, height);
+    }
+    legacy_time = now() - start;
+
+    /* 按行交换的翻转。 */
+    memcpy(dst, src, bytes);
+    start = now();
+    transform_flip_vertical(dst, width, height, pixel_size);
+    flip_time = now() - start;
+
+    if ( memcmp(dst, legacy, bytes) || ! check(src, dst, pixel_size, TRANSFORM_FLIP_VERTICAL) ) {
+        log_error("ERROR", "Vertical flip mismatch!");
+        failure = FUNCTION_FAILURE;
+    }
+    printf("%2u-bit  upsidedown (legacy) %8.2f ms\n", pixel_size * 8, legacy_time * 1000);
+    printf("%2u-bit  flip (row swap)     %8.2f ms  (%.1fx)\n", pixel_size * 8, flip_time * 1000, legacy_time / flip_time);
+
+    memcpy(dst, src, bytes);
+    start = now();
+    transform_mirror(dst, width, height, pixel_size);
+    printf("%2u-bit  mirror              %8.2f ms\n", pixel_size * 8, ( now() - start ) * 1000);
+    if ( ! check(src, dst, pixel_size, TRANSFORM_MIRROR) ) {
+        log_error("ERROR", "Mirror mismatch!");
+        failure = FUNCTION_FAILURE;
+    }
+
+    for ( op = TRANSFORM_NONE; op <= TRANSFORM_TRANSVERSE; op ++ ) {
+        start = now();
+        transform_rotate(src, dst, width, height, pixel_size, op);
+        printf("%2u-bit  tiled op %u           %8.2f ms\n", pixel_size * 8, op, ( now() - start ) * 1000);
+        if ( ! check(src, dst, pixel_size, op) ) {
+            log_error("ERROR", "Tiled transform mismatch!");
+            failure = FUNCTION_FAILURE;
+        }
+    }
+
+    free(src);
+    free(legacy);
+    free(dst);
+
+    return failure;
+}
+
+/*
+ * rect() - 检查 transform_rect() 算出的矩形位置：在一张小页面上画一个矩形，
+ *          变换后找出它的边界来比较。
+ */
+static int
+rect(void) {
+    const unsigned  w = 37, h = 23;
+    uint8_t         src[37 * 23], dst[37 * 23];
+    unsigned        x, y, rw, rh, r, c, dst_width, left, top, right, bottom;
+    transform_op_t  op;
+    int             failure = FUNCTION_SUCCESS;
+
+    memset(src, 0, sizeof(src));
+    for ( r = 7; r < 7 + 9; r ++ ) {
+        memset(src + r * w + 5, 1, 11);
+    }
+    for ( op = TRANSFORM_NONE; op <= TRANSFORM_TRANSVERSE; op ++ ) {
+        transform_rotate(src, dst, w, h, 1, op);
+        dst_width = TRANSFORM_SWAPS_AXES(op)? h: w;
+        left = top = ~0U;
+        right = bottom = 0;
+        for ( r = 0; r < w * h / dst_width; r ++ ) {
+            for ( c = 0; c < dst_width; c ++ ) {
+                if ( dst[r * dst_width + c] ) {
+                    left = ( c < left )? c: left;
+                    right = ( c > right )? c: right;
+                    top = ( r < top )? r: top;
+                    bottom = ( r > bottom )? r: bottom;
+                }
+            }
+        }
+        x = 5, y = 7, rw = 11, rh = 9;
+        transform_rect(w, h, op, &x, &y, &rw, &rh);
+        if ( x != left || y != top || rw != right + 1 - left || rh != bottom + 1 - top ) {
+            log_error("ERROR", "Rectangle transform mismatch!");
+            failure = FUNCTION_FAILURE;
+        }
+    }
+    printf("rectangle mapping %s\n", ( failure == FUNCTION_SUCCESS )? "ok": "FAILED");
+
+    return failure;
+}
+
+/*
+ * main() - 程序主入口。
+ */
+int                                 /* 输出 - 0 成功，1 失败 */
+main(
+    int argc,                       /* 输入 - 命令行参数个数。 */
+    char *argv[]                    /* 输入 - 命令行参数内容。 */
+) {
+    int failure = FUNCTION_SUCCESS;
+
+    puts("A page transform testing tool distributed under the AGPL.");
+    puts("Copyright (c) 2023 Leisquid Li.\n");
+
+    if ( ! run(sizeof(bitmap_8bit_pixel)) ) {
+        failure = FUNCTION_FAILURE;
+    }
+    if ( ! run(sizeof(bitmap_24bit_pixel)) ) {
+        failure = FUNCTION_FAILURE;
+    }
+    if ( ! rect() ) {
+        failure = FUNCTION_FAILURE;
+    }
+
+    puts(( failure == FUNCTION_SUCCESS )? "All transforms passed.\nBye.": "Some transforms failed.\nBye.");
+
+    return ( failure == FUNCTION_SUCCESS )? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,216 @@
+/*
+ * uring.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#include "uring.h"
+#include "bitmap.h"
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/*
+ * uring_init() - 建立 io_uring 并映射提交队列、完成队列和 SQE 数组。
+ *                内核不支持（或被禁用）时返回失败，调用者应退回普通的写入。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+uring_init(
+    uring_t             *ring,          /* 输入 - io_uring */
+    unsigned            entries         /* 输入 - 队列深度 */
+) {
+    struct io_uring_params  params;
+    uint8_t             *sq, *cq;
+
+    memset(ring, 0, sizeof(uring_t));
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if ( ring->fd < 0 ) {
+        return FUNCTION_FAILURE;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if ( params.features & IORING_FEAT_SINGLE_MMAP ) {
+        if ( ring->cq_ring_size > ring->sq_ring_size ) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if ( ring->sq_ring == MAP_FAILED ) {
+        ring->sq_ring = NULL;
+        uring_exit(ring);
+        return FUNCTION_FAILURE;
+    }
+
+    if ( params.features & IORING_FEAT_SINGLE_MMAP ) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if ( ring->cq_ring == MAP_FAILED ) {
+            ring->cq_ring = NULL;
+            uring_exit(ring);
+            return FUNCTION_FAILURE;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if ( ring->sqes == MAP_FAILED ) {
+        ring->sqes = NULL;
+        uring_exit(ring);
+        return FUNCTION_FAILURE;
+    }
+
+    sq = (uint8_t *) ring->sq_ring;
+    cq = (uint8_t *) ring->cq_ring;
+    ring->sq_head = (unsigned *) ( sq + params.sq_off.head );
+    ring->sq_tail = (unsigned *) ( sq + params.sq_off.tail );
+    ring->sq_mask = (unsigned *) ( sq + params.sq_off.ring_mask );
+    ring->sq_array = (unsigned *) ( sq + params.sq_off.array );
+    ring->cq_head = (unsigned *) ( cq + params.cq_off.head );
+    ring->cq_tail = (unsigned *) ( cq + params.cq_off.tail );
+    ring->cq_mask = (unsigned *) ( cq + params.cq_off.ring_mask );
+    ring->cqes = (struct io_uring_cqe *) ( cq + params.cq_off.cqes );
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * uring_register_buffers() - 注册固定缓冲区，之后可以用 IORING_OP_WRITE_FIXED
+ *                            写出，内核不必每次都去固定这些页。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+uring_register_buffers(
+    uring_t             *ring,          /* 输入 - io_uring */
+    const struct iovec  *iovecs,        /* 输入 - 缓冲区 */
+    unsigned            count           /* 输入 - 缓冲区个数 */
+) {
+    return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iovecs, count) == 0;
+}
+
+/*
+ * uring_get_sqe() - 取一个空闲的 SQE 并清零。队列满时返回 NULL。
+ */
+struct io_uring_sqe *                   /* 输出 - SQE */
+uring_get_sqe(
+    uring_t             *ring           /* 输入 - io_uring */
+) {
+    const unsigned      head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    const unsigned      tail = *ring->sq_tail + ring->sq_pending;
+    const unsigned      index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe;
+
+    if ( tail - head > *ring->sq_mask ) {
+        return NULL;
+    }
+
+    sqe = &(ring->sqes[index]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_array[index] = index;
+    ring->sq_pending ++;
+
+    return sqe;
+}
+
+/*
+ * uring_submit() - 提交已填写的 SQE，并至少等待 wait_nr 个完成事件。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+uring_submit(
+    uring_t             *ring,          /* 输入 - io_uring */
+    unsigned            wait_nr         /* 输入 - 要等待的完成事件数 */
+) {
+    const unsigned      count = ring->sq_pending;
+    int                 result;
+
+    if ( count == 0 && wait_nr == 0 ) {
+        return FUNCTION_SUCCESS;
+    }
+
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + count, __ATOMIC_RELEASE);
+    ring->sq_pending = 0;
+
+    do {
+        result = (int) syscall(__NR_io_uring_enter, ring->fd, count, wait_nr,
+            ( wait_nr > 0 )? IORING_ENTER_GETEVENTS: 0, NULL, 0);
+    } while ( result < 0 && errno == EINTR );
+
+    return result >= 0;
+}
+
+/*
+ * uring_peek_cqe() - 取下一个完成事件，没有时返回 NULL。
+ */
+struct io_uring_cqe *                   /* 输出 - 完成事件 */
+uring_peek_cqe(
+    uring_t             *ring           /* 输入 - io_uring */
+) {
+    const unsigned      head = *ring->cq_head;
+
+    if ( head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) ) {
+        return NULL;
+    }
+
+    return &(ring->cqes[head & *ring->cq_mask]);
+}
+
+/*
+ * uring_cqe_seen() - 标记当前完成事件已经处理。
+ */
+void
+uring_cqe_seen(
+    uring_t             *ring           /* 输入 - io_uring */
+) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * uring_exit() - 释放 io_uring。调用者要先等所有请求完成。
+ */
+void
+uring_exit(
+    uring_t             *ring           /* 输入 - io_uring */
+) {
+    if ( ring->sqes != NULL ) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if ( ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring ) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if ( ring->sq_ring != NULL ) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if ( ring->fd >= 0 ) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(uring_t));
+    ring->fd = -1;
+}
@@ -0,0 +1,65 @@
+/*
+ * uring.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_URING_H
+#define __LEISRASTERFILTER_URING_H
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <stddef.h>
+
+/*
+ * 一个最小的 io_uring 封装，直接使用系统调用，不依赖 liburing。
+ * 只在单个线程里提交和收割。
+ */
+typedef struct {
+    int                 fd;             /* io_uring 的文件描述符 */
+    unsigned            *sq_head,       /* 提交队列 */
+                        *sq_tail,
+                        *sq_mask,
+                        *sq_array,
+                        sq_pending;     /* 已填写、尚未提交的 SQE 数 */
+    unsigned            *cq_head,       /* 完成队列 */
+                        *cq_tail,
+                        *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void                *sq_ring,
+                        *cq_ring;
+    size_t              sq_ring_size,
+                        cq_ring_size,
+                        sqes_size;
+} uring_t;
+
+extern int uring_init(uring_t *ring, unsigned entries);
+extern int uring_register_buffers(uring_t *ring, const struct iovec *iovecs, unsigned count);
+extern struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+extern int uring_submit(uring_t *ring, unsigned wait_nr);
+extern struct io_uring_cqe *uring_peek_cqe(uring_t *ring);
+extern void uring_cqe_seen(uring_t *ring);
+extern void uring_exit(uring_t *ring);
+
+#endif
@@ -0,0 +1,211 @@
+/*
+ * workpool.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 页内并行转换用的工作线程池。raster 行只能按顺序读，但读进来的一段行可以分成
+ * 几小段，由几个线程同时转换进页缓冲（或行缓冲）的不同位置，写入位置由行号决定，
+ * 所以转换完行的顺序不变。
+ *
+ * 任务用一个原子计数器领取，调用者也参与。每个工作线程领不到任务后才算做完这
+ * 一批，调用者要等所有工作线程都做完才返回，这样不会有上一批的线程领走下一批的
+ * 任务。
+ */
+
+#include "workpool.h"
+#include "bitmap.h"
+#include <unistd.h>
+
+/*
+ * workpool_work() - 领取并执行当前这批任务，直到领完。
+ */
+static void
+workpool_work(
+    workpool_t          *pool,          /* 输入 - 线程池 */
+    workpool_fn_t       fn,             /* 输入 - 任务函数 */
+    void                *data,          /* 输入 - 任务数据 */
+    unsigned            num_tasks       /* 输入 - 任务数 */
+) {
+    unsigned            task;
+
+    while ( ( task = __atomic_fetch_add(&(pool->next_task), 1, __ATOMIC_RELAXED) ) < num_tasks ) {
+        fn(data, task);
+    }
+}
+
+/*
+ * workpool_main() - 工作线程：等待新的一批任务并参与执行。
+ */
+static void *
+workpool_main(
+    void                *arg            /* 输入 - 线程池 */
+) {
+    workpool_t          *pool = (workpool_t *) arg;
+    unsigned            generation = 0;
+    workpool_fn_t       fn;
+    void                *data;
+    unsigned            num_tasks;
+
+    pthread_mutex_lock(&(pool->lock));
+    for ( ;; ) {
+        while ( ! pool->stop && pool->generation == generation ) {
+            pthread_cond_wait(&(pool->start), &(pool->lock));
+        }
+        if ( pool->stop ) {
+            break;
+        }
+        generation = pool->generation;
+        fn = pool->fn;
+        data = pool->data;
+        num_tasks = pool->num_tasks;
+        pthread_mutex_unlock(&(pool->lock));
+
+        workpool_work(pool, fn, data, num_tasks);
+
+        pthread_mutex_lock(&(pool->lock));
+        if ( -- pool->running == 0 ) {
+            pthread_cond_signal(&(pool->done));
+        }
+    }
+    pthread_mutex_unlock(&(pool->lock));
+
+    return NULL;
+}
+
+/*
+ * workpool_threads() - 由选项值得到线程数：数字，或者 "auto"（CPU 个数）。
+ */
+unsigned                                /* 输出 - 线程数（含调用者），1 到 WORKPOOL_MAX_THREADS */
+workpool_threads(
+    const char          *value          /* 输入 - 选项值，可为 NULL */
+) {
+    long                threads = 1;
+
+    if ( value != NULL && ! strcasecmp(value, "auto") ) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    } else if ( value != NULL ) {
+        threads = atol(value);
+    }
+
+    if ( threads < 1 ) {
+        threads = 1;
+    } else if ( threads > WORKPOOL_MAX_THREADS ) {
+        threads = WORKPOOL_MAX_THREADS;
+    }
+
+    return (unsigned) threads;
+}
+
+/*
+ * workpool_init() - 创建线程池。threads 为总线程数（含调用者），创建不了的
+ *                   工作线程就少用几个。
+ */
+int                                     /* 输出 - 1 成功，0 失败 */
+workpool_init(
+    workpool_t          *pool,          /* 输出 - 线程池 */
+    unsigned            threads         /* 输入 - 线程数（含调用者） */
+) {
+    unsigned            index;
+
+    memset(pool, 0, sizeof(workpool_t));
+    pthread_mutex_init(&(pool->lock), NULL);
+    pthread_cond_init(&(pool->start), NULL);
+    pthread_cond_init(&(pool->done), NULL);
+
+    if ( threads > WORKPOOL_MAX_THREADS ) {
+        threads = WORKPOOL_MAX_THREADS;
+    }
+    for ( index = 0; index + 1 < threads; index ++ ) {
+        if ( pthread_create(&(pool->threads[index]), NULL, workpool_main, pool) != 0 ) {
+            log_debug("Info", "Unable to start all conversion threads.");
+            break;
+        }
+        pool->num_threads ++;
+    }
+
+    return FUNCTION_SUCCESS;
+}
+
+/*
+ * workpool_run() - 执行 num_tasks 个任务，全部做完后返回。
+ */
+void
+workpool_run(
+    workpool_t          *pool,          /* 输入 - 线程池 */
+    workpool_fn_t       fn,             /* 输入 - 任务函数 */
+    void                *data,          /* 输入 - 任务数据 */
+    unsigned            num_tasks       /* 输入 - 任务数 */
+) {
+    unsigned            task;
+
+    if ( pool->num_threads == 0 || num_tasks <= 1 ) {
+        for ( task = 0; task < num_tasks; task ++ ) {
+            fn(data, task);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&(pool->lock));
+    pool->fn = fn;
+    pool->data = data;
+    pool->num_tasks = num_tasks;
+    __atomic_store_n(&(pool->next_task), 0, __ATOMIC_RELAXED);
+    pool->running = pool->num_threads;
+    pool->generation ++;
+    pthread_cond_broadcast(&(pool->start));
+    pthread_mutex_unlock(&(pool->lock));
+
+    workpool_work(pool, fn, data, num_tasks);
+
+    pthread_mutex_lock(&(pool->lock));
+    while ( pool->running > 0 ) {
+        pthread_cond_wait(&(pool->done), &(pool->lock));
+    }
+    pthread_mutex_unlock(&(pool->lock));
+}
+
+/*
+ * workpool_free() - 结束工作线程。
+ */
+void
+workpool_free(
+    workpool_t          *pool           /* 输入 - 线程池 */
+) {
+    unsigned            index;
+
+    pthread_mutex_lock(&(pool->lock));
+    pool->stop = 1;
+    pthread_cond_broadcast(&(pool->start));
+    pthread_mutex_unlock(&(pool->lock));
+
+    for ( index = 0; index < pool->num_threads; index ++ ) {
+        pthread_join(pool->threads[index], NULL);
+    }
+    pool->num_threads = 0;
+
+    pthread_mutex_destroy(&(pool->lock));
+    pthread_cond_destroy(&(pool->start));
+    pthread_cond_destroy(&(pool->done));
+}
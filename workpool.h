@@ -0,0 +1,65 @@
+/*
+ * workpool.h - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+#ifndef __LEISRASTERFILTER_WORKPOOL_H
+#define __LEISRASTERFILTER_WORKPOOL_H
+
+#include <pthread.h>
+
+#define WORKPOOL_MAX_THREADS    16      /* 线程数的上限（含调用者） */
+#define WORKPOOL_BAND_ROWS      32      /* 每个线程每次分到的行数 */
+#define WORKPOOL_TASK_ROWS      8       /* 每个任务的行数 */
+
+/*
+ * 任务函数：处理编号为 task 的任务。
+ */
+typedef void (*workpool_fn_t)(void *data, unsigned task);
+
+/*
+ * 工作线程池。workpool_run() 把一批任务分给工作线程和调用者一起做，全部做完才
+ * 返回；线程数为 1 时没有工作线程，任务直接在调用者中依次执行。
+ */
+typedef struct {
+    pthread_t           threads[WORKPOOL_MAX_THREADS];
+    unsigned            num_threads;    /* 工作线程数（不含调用者） */
+    pthread_mutex_t     lock;
+    pthread_cond_t      start,          /* 有新的一批任务 */
+                        done;           /* 一批任务做完了 */
+    workpool_fn_t       fn;             /* 当前这批任务 */
+    void                *data;
+    unsigned            num_tasks,      /* 任务数 */
+                        next_task,      /* 下一个要领取的任务 */
+                        running,        /* 还没做完这一批的工作线程数 */
+                        generation;     /* 批次编号 */
+    int                 stop;           /* 要求工作线程结束 */
+} workpool_t;
+
+extern unsigned workpool_threads(const char *value);
+extern int workpool_init(workpool_t *pool, unsigned threads);
+extern void workpool_run(workpool_t *pool, workpool_fn_t fn, void *data, unsigned num_tasks);
+extern void workpool_free(workpool_t *pool);
+
+#endif
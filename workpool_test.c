@@ -0,0 +1,209 @@
+/*
+ * workpool_test.c - a source code file of Leisrasterfilter
+ * Copyright (c) 2023 Leisquid Li.
+ *
+ * This file is part of Leisrasterfilter.
+ * Leisrasterfilter is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * Leisrasterfilter is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero General Public
+ * License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Leisrasterfilter. If not, see
+ * <https://www.gnu.org/licenses/agpl-3.0.txt>.
+ *
+ * 此文件是 Leisrasterfilter 的一部分。
+ * Leisrasterfilter 是自由软件：您可以在遵照自由软件基金会发布的「GNU Affero 通用
+ * 公共许可证」（第 3 版或者更新版本皆可）的前提下对其进行转载或者修改。
+ * 发布 Leisrasterfilter 的初衷是希望它能有一定的用处，但是并不为销售或特定用途等
+ * 情况做出任何担保。参见「GNU Affero 通用公共许可证」。
+ * 您应该随 Leisrasterfilter 获得了一份「GNU Affero 通用公共许可证」的副本。如果
+ * 没有，请看 <https://www.gnu.org/licenses/agpl-3.0.txt>。
+ */
+
+/*
+ * 这是一个用于测试页内并行转换的小程序。它检查 workpool.c 是否把每个任务都
+ * 恰好执行一次，再按 rastertobitmap 的分段方式把一张 A4 300 dpi 的 48 位 RGB
+ * 页面转为 24 位，比较 1 到 16 个线程的耗时，并检查结果与单线程的一致。
+ */
+
+#include "bitmap.h"
+#include "workpool.h"
+#include <time.h>
+
+const unsigned  width = 2480;
+const unsigned  height = 3508;
+
+/*
+ * 一段待转换的行，与 rastertobitmap.c 中的 band_t 相同，只是不需要页头。
+ */
+typedef struct {
+    const uint16_t      *rows;          /* 48 位像素行 */
+    uint8_t             *output;        /* 24 位像素行 */
+    unsigned            num_rows;       /* 行数 */
+} band_t;
+
+/*
+ * now() - 单调时钟的当前时间（秒）。
+ */
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * count_task() - 给任务计数。
+ */
+static void
+count_task(
+    void        *data,
+    unsigned    task
+) {
+    __atomic_add_fetch(&( ( (unsigned *) data )[task] ), 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * convert_rows() - 转换一段行中的第 task 小段，与 output_line_color() 的 16 位
+ *                  分支相同：(像素 + 129) / 257。
+ */
+static void
+convert_rows(
+    void                *data,
+    unsigned            task
+) {
+    band_t              *band = (band_t *) data;
+    unsigned            row = task * WORKPOOL_TASK_ROWS,
+                        last = row + WORKPOOL_TASK_ROWS;
+    size_t              index;
+
+    if ( last > band->num_rows ) {
+        last = band->num_rows;
+    }
+    for ( ; row < last; row ++) {
+        for ( index = 0; index < (size_t) width * 3; index ++ ) {
+            band->output[(size_t) row * width * 3 + index] =
+                (uint8_t) ( ( band->rows[(size_t) row * width * 3 + index] + 129 ) / 257 );
+        }
+    }
+}
+
+/*
+ * check_tasks() - 检查每个任务是否都恰好执行一次。
+ */
+static int
+check_tasks(
+    unsigned        threads
+) {
+    workpool_t      pool;
+    unsigned        counts[64];
+    unsigned        batch, num_tasks, task;
+    int             failure = FUNCTION_SUCCESS;
+
+    workpool_init(&pool, threads);
+    for ( batch = 0; batch < 2000; batch ++ ) {
+        num_tasks = batch % 64 + 1;
+        memset(counts, 0, sizeof(counts));
+        workpool_run(&pool, count_task, counts, num_tasks);
+        for ( task = 0; task < 64; task ++ ) {
+            if ( counts[task] != ( task < num_tasks ) ) {
+                failure = FUNCTION_FAILURE;
+            }
+        }
+    }
+    workpool_free(&pool);
+
+    return failure;
+}
+
+/*
+ * convert_page() - 用 threads 个线程分段转换整页，返回耗时（秒）。
+ */
+static double
+convert_page(
+    const uint16_t  *src,
+    uint8_t         *dst,
+    unsigned        threads
+) {
+    workpool_t      pool;
+    band_t          band;
+    unsigned        band_rows, y;
+    double          start;
+
+    workpool_init(&pool, threads);
+    band_rows = ( pool.num_threads > 0 )? WORKPOOL_BAND_ROWS * ( pool.num_threads + 1 ): 1;
+
+    start = now();
+    for ( y = 0; y < height; y += band.num_rows ) {
+        band.num_rows = ( height - y < band_rows )? height - y: band_rows;
+        band.rows = src + (size_t) y * width * 3;
+        band.output = dst + (size_t) y * width * 3;
+        workpool_run(&pool, convert_rows, &band, ( band.num_rows + WORKPOOL_TASK_ROWS - 1 ) / WORKPOOL_TASK_ROWS);
+    }
+    start = now() - start;
+
+    workpool_free(&pool);
+
+    return start;
+}
+
+/*
+ * main() - 程序主入口。
+ */
+int                                 /* 输出 - 0 成功，1 失败 */
+main(
+    int argc,                       /* 输入 - 命令行参数个数。 */
+    char *argv[]                    /* 输入 - 命令行参数内容。 */
+) {
+    const size_t    pixels = (size_t) width * height * 3;
+    uint16_t        *src = (uint16_t *) malloc(pixels * sizeof(uint16_t));
+    uint8_t         *reference = (uint8_t *) malloc(pixels),
+                    *dst = (uint8_t *) malloc(pixels);
+    double          single, elapsed;
+    unsigned        threads;
+    size_t          index;
+    int             failure = FUNCTION_SUCCESS;
+
+    puts("A row conversion thread pool testing tool distributed under the AGPL.");
+    puts("Copyright (c) 2023 Leisquid Li.\n");
+
+    if ( src == NULL || reference == NULL || dst == NULL ) {
+        puts("Out of memory.");
+        return EXIT_FAILURE;
+    }
+    for ( index = 0; index < pixels; index ++ ) {
+        src[index] = (uint16_t) ( index * 2654435761u >> 7 );
+    }
+
+    for ( threads = 1; threads <= WORKPOOL_MAX_THREADS; threads *= 2 ) {
+        if ( ! check_tasks(threads) ) {
+            printf("Tasks with %u threads: FAILED\n", threads);
+            failure = FUNCTION_FAILURE;
+        }
+    }
+
+    single = convert_page(src, reference, 1);
+    printf("%2u thread:  %7.2f ms\n", 1, single * 1000);
+    for ( threads = 2; threads <= WORKPOOL_MAX_THREADS; threads ++ ) {
+        memset(dst, 0, pixels);
+        elapsed = convert_page(src, dst, threads);
+        printf("%2u threads: %7.2f ms, %.2fx%s\n", threads, elapsed * 1000, single / elapsed,
+            memcmp(dst, reference, pixels)? ", FAILED": "");
+        if ( memcmp(dst, reference, pixels) ) {
+            failure = FUNCTION_FAILURE;
+        }
+    }
+
+    free(src);
+    free(reference);
+    free(dst);
+
+    puts(( failure == FUNCTION_SUCCESS )? "All conversions passed.\nBye.": "Some conversions failed.\nBye.");
+
+    return ( failure == FUNCTION_SUCCESS )? EXIT_SUCCESS: EXIT_FAILURE;
+}